@@ -0,0 +1,96 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+namespace utils
+{
+
+    /**
+     * A first-in, first-out queue between threads that holds at most `capacity` items: `push()` blocks while
+     * it is full and `pop()` blocks while it is empty, so a fast producer can never get more than `capacity`
+     * items ahead of a slow consumer. Either side can `close()` the queue to stop the other.
+     */
+    template<typename T>
+    class BoundedQueue
+    {
+
+    public:
+
+        explicit BoundedQueue(size_t capacity) :
+            capacity{ capacity == 0 ? 1 : capacity }
+        {
+        }
+
+        BoundedQueue(const BoundedQueue& other) = delete;
+
+        BoundedQueue& operator=(const BoundedQueue& other) = delete;
+
+        /**
+         * Waits for room in the queue and appends `item`. Returns `false` (and drops `item`) if the
+         * queue is closed.
+         */
+        bool push(T item)
+        {
+            std::unique_lock<std::mutex> lock{ mutex };
+            not_full.wait(lock, [this] { return closed || items.size() < capacity; });
+
+            if (closed)
+            {
+                return false;
+            }
+
+            items.push_back(std::move(item));
+            not_empty.notify_one();
+
+            return true;
+        }
+
+        /**
+         * Waits for an item and moves it into `item`. Returns `false` once the queue is closed and every
+         * item that was pushed before has been popped.
+         */
+        bool pop(T& item)
+        {
+            std::unique_lock<std::mutex> lock{ mutex };
+            not_empty.wait(lock, [this] { return closed || !items.empty(); });
+
+            if (items.empty())
+            {
+                return false;
+            }
+
+            item = std::move(items.front());
+            items.pop_front();
+            not_full.notify_one();
+
+            return true;
+        }
+
+        /**
+         * Wakes up every waiting thread: further calls to `push()` fail, and `pop()` fails as soon as the
+         * queue is empty.
+         */
+        void close()
+        {
+            std::lock_guard<std::mutex> lock{ mutex };
+            closed = true;
+
+            not_full.notify_all();
+            not_empty.notify_all();
+        }
+
+    private:
+
+        const size_t capacity;
+
+        std::mutex mutex;
+        std::condition_variable not_full;
+        std::condition_variable not_empty;
+        std::deque<T> items;
+        bool closed = false;
+    };
+
+}
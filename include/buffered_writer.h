@@ -0,0 +1,274 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace utils
+{
+
+    /**
+     * Progress of a long-running export, shared between the thread that writes the file and the thread
+     * that displays it (see `utils::ExportWorker`).
+     */
+    struct ExportProgress
+    {
+        std::atomic<size_t> items_total{ 0 };   // The number of vertices, indices, etc. to be written
+        std::atomic<size_t> items_written{ 0 };
+        std::atomic<size_t> bytes_written{ 0 };
+
+        // When set, the writers stop (and throw) at the next chunk, leaving the file incomplete
+        std::atomic<bool> cancel{ false };
+    };
+
+    /**
+     * Writes the decimal digits of `value` to `output` and returns a pointer past the last one.
+     */
+    inline char* write_uint(uint64_t value, char* output)
+    {
+        char digits[20];
+        size_t count = 0;
+        do
+        {
+            digits[count++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+
+        while (count != 0)
+        {
+            *output++ = digits[--count];
+        }
+
+        return output;
+    }
+
+    /**
+     * Writes the shortest decimal that reads back as exactly `value` to `output` (which must have room for
+     * 32 characters) and returns a pointer past the last character. Values that are written in fixed-point
+     * notation (as all vertices of a fibration are) never go through `printf()`: the number of fraction
+     * digits is found by rounding the value at increasing precision until the result converts back to it.
+     * Very small and very large values (which are rare) are left to `printf()` and `strtof()` instead.
+     */
+    inline char* write_float(float value, char* output)
+    {
+        static const double powers_of_ten[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13 };
+        const size_t max_fraction_digits = sizeof(powers_of_ten) / sizeof(powers_of_ten[0]) - 1;
+
+        const float magnitude = std::fabs(value);
+        if (std::signbit(value))
+        {
+            *output++ = '-';
+        }
+        if (magnitude == 0.0f)
+        {
+            *output++ = '0';
+            return output;
+        }
+
+        // Fixed-point notation with at most 9 significant digits (the most that a float can need) only fits
+        // into the table above in this range: anything else (including infinities and NaNs) is left to `printf()`
+        if (magnitude >= 1e-4f && magnitude < 1e7f)
+        {
+            for (size_t fraction_digits = 0; fraction_digits <= max_fraction_digits; ++fraction_digits)
+            {
+                const double scale = powers_of_ten[fraction_digits];
+                const uint64_t scaled = static_cast<uint64_t>(std::llround(magnitude * scale));
+                if (static_cast<float>(scaled / scale) != magnitude)
+                {
+                    continue;
+                }
+
+                const uint64_t divisor = static_cast<uint64_t>(scale);
+                output = write_uint(scaled / divisor, output);
+                if (fraction_digits != 0)
+                {
+                    // The fraction, with its leading zeros
+                    char digits[20];
+                    char* end = write_uint(scaled % divisor + divisor, digits);
+
+                    *output++ = '.';
+                    std::memcpy(output, digits + 1, end - digits - 1);
+                    output += end - digits - 1;
+                }
+                return output;
+            }
+        }
+
+        // 9 significant digits always convert back to the same float
+        int length = 0;
+        for (int precision = 1; precision <= 9; ++precision)
+        {
+            length = std::snprintf(output, 32, "%.*g", precision, magnitude);
+            if (std::strtof(output, nullptr) == magnitude)
+            {
+                break;
+            }
+        }
+
+        return output + length;
+    }
+
+    inline bool is_little_endian()
+    {
+        const uint16_t one = 1;
+        char first_byte;
+        std::memcpy(&first_byte, &one, 1);
+
+        return first_byte == 1;
+    }
+
+    /**
+     * Copies `value` to `output` in little-endian byte order (as binary file formats such as PLY and glTF
+     * expect it) and returns a pointer past the last byte.
+     */
+    template<typename T>
+    inline char* write_little_endian(T value, char* output)
+    {
+        std::memcpy(output, &value, sizeof(T));
+        if (!is_little_endian())
+        {
+            std::reverse(output, output + sizeof(T));
+        }
+
+        return output + sizeof(T);
+    }
+
+    /**
+     * Collects formatted output in a large buffer and writes it to a file in big sequential chunks. Throws a
+     * `std::runtime_error` if the file can't be opened or written to, or if `progress->cancel` is set.
+     */
+    class BufferedWriter
+    {
+    public:
+
+        static constexpr size_t default_buffer_size = 4 * 1024 * 1024;
+
+        explicit BufferedWriter(const std::string& filename, ExportProgress* progress = nullptr, size_t buffer_size = default_buffer_size) :
+            progress{ progress },
+            buffer(buffer_size),
+            file{ std::fopen(filename.c_str(), "wb") }
+        {
+            if (file == nullptr)
+            {
+                throw std::runtime_error("Could not open file for writing: " + filename);
+            }
+        }
+
+        ~BufferedWriter()
+        {
+            if (file != nullptr)
+            {
+                // Errors can't be reported from here: call `close()` to find out about them
+                std::fwrite(buffer.data(), 1, used, file);
+                std::fclose(file);
+            }
+        }
+
+        BufferedWriter(const BufferedWriter& other) = delete;
+
+        BufferedWriter& operator=(const BufferedWriter& other) = delete;
+
+        /**
+         * Returns a pointer to at least `count` bytes (at most the buffer size) that can be written to,
+         * which have to be handed back to `commit()`.
+         */
+        char* reserve(size_t count)
+        {
+            if (buffer.size() - used < count)
+            {
+                flush();
+            }
+
+            return buffer.data() + used;
+        }
+
+        /**
+         * Appends everything that was written to the space from `reserve()` up to (but not including) `end`.
+         */
+        void commit(const char* end)
+        {
+            used = end - buffer.data();
+        }
+
+        void write(const char* data, size_t count)
+        {
+            while (count != 0)
+            {
+                const size_t chunk = std::min(count, buffer.size());
+                std::memcpy(reserve(chunk), data, chunk);
+                used += chunk;
+                data += chunk;
+                count -= chunk;
+            }
+        }
+
+        void write(const std::string& text)
+        {
+            write(text.data(), text.size());
+        }
+
+        /**
+         * Writes out everything that is buffered.
+         */
+        void flush()
+        {
+            if (progress != nullptr && progress->cancel)
+            {
+                throw std::runtime_error("Export cancelled");
+            }
+
+            if (used != 0 && std::fwrite(buffer.data(), 1, used, file) != used)
+            {
+                throw std::runtime_error("Could not write to file");
+            }
+
+            bytes_written += used;
+            used = 0;
+
+            if (progress != nullptr)
+            {
+                progress->bytes_written = bytes_written;
+            }
+        }
+
+        /**
+         * Writes out everything that is buffered and closes the file.
+         */
+        void close()
+        {
+            flush();
+
+            const bool closed = std::fclose(file) == 0;
+            file = nullptr;
+
+            if (!closed)
+            {
+                throw std::runtime_error("Could not write to file");
+            }
+        }
+
+        /**
+         * Returns the number of bytes that have been written so far (including those that are still buffered).
+         */
+        size_t get_bytes_written() const
+        {
+            return bytes_written + used;
+        }
+
+    private:
+
+        ExportProgress* progress;
+        std::vector<char> buffer;
+        size_t used = 0;
+        size_t bytes_written = 0;
+        std::FILE* file;
+    };
+
+}
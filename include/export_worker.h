@@ -0,0 +1,149 @@
+#pragma once
+
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "buffered_writer.h"
+
+namespace utils
+{
+
+    /**
+     * A snapshot of the most recent export (see `ExportWorker::get_status()`).
+     */
+    struct ExportStatus
+    {
+        bool busy = false;
+        std::string filename;
+        size_t items_total = 0;
+        size_t items_written = 0;
+        size_t bytes_written = 0;
+        double seconds = 0.0;   // So far, if the export is still running
+        std::string error;      // Empty unless the export failed
+
+        float get_fraction() const
+        {
+            return items_total == 0 ? 0.0f : static_cast<float>(items_written) / static_cast<float>(items_total);
+        }
+
+        // Throughput in megabytes (2^20 bytes) per second
+        double get_megabytes_per_second() const
+        {
+            return seconds > 0.0 ? bytes_written / (1024.0 * 1024.0) / seconds : 0.0;
+        }
+    };
+
+    /**
+     * Runs one export at a time on a background thread, so that writing a large file doesn't block the
+     * render loop. The task is handed an `ExportProgress` to pass on to the writers (see `save_polyline_obj()`),
+     * which is how the UI learns how far along it is.
+     */
+    class ExportWorker
+    {
+    public:
+
+        ExportWorker() = default;
+
+        ~ExportWorker()
+        {
+            // Don't keep the application waiting for a large file that nobody will see finish
+            progress.cancel = true;
+
+            if (thread.joinable())
+            {
+                thread.join();
+            }
+        }
+
+        ExportWorker(const ExportWorker& other) = delete;
+
+        ExportWorker& operator=(const ExportWorker& other) = delete;
+
+        /**
+         * Starts running `task` (which writes `filename`) in the background. Returns `false` (and does nothing)
+         * if the previous export hasn't finished yet.
+         */
+        bool start(const std::string& filename, std::function<void(ExportProgress&)> task)
+        {
+            if (is_busy())
+            {
+                return false;
+            }
+            if (thread.joinable())
+            {
+                thread.join();
+            }
+
+            progress.items_total = 0;
+            progress.items_written = 0;
+            progress.bytes_written = 0;
+            progress.cancel = false;
+
+            {
+                std::lock_guard<std::mutex> lock{ mutex };
+                status = ExportStatus{};
+                status.busy = true;
+                status.filename = filename;
+                start_time = std::chrono::steady_clock::now();
+            }
+
+            thread = std::thread{ [this, task]
+            {
+                std::string error;
+                try
+                {
+                    task(progress);
+                }
+                catch (const std::exception& e)
+                {
+                    error = e.what();
+                }
+
+                std::lock_guard<std::mutex> lock{ mutex };
+                status.busy = false;
+                status.error = error;
+                status.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+            } };
+
+            return true;
+        }
+
+        bool is_busy() const
+        {
+            std::lock_guard<std::mutex> lock{ mutex };
+            return status.busy;
+        }
+
+        ExportStatus get_status() const
+        {
+            std::lock_guard<std::mutex> lock{ mutex };
+
+            ExportStatus snapshot = status;
+            snapshot.items_total = progress.items_total;
+            snapshot.items_written = progress.items_written;
+            snapshot.bytes_written = progress.bytes_written;
+            if (snapshot.busy)
+            {
+                snapshot.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+            }
+
+            return snapshot;
+        }
+
+    private:
+
+        mutable std::mutex mutex;
+        ExportProgress progress;
+
+        // Guarded by `mutex`
+        ExportStatus status;
+        std::chrono::steady_clock::time_point start_time;
+
+        std::thread thread;
+    };
+
+}
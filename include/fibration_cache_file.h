@@ -0,0 +1,544 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "buffered_writer.h"
+#include "fibration_worker.h"
+
+namespace hopf
+{
+
+    /**
+     * Returns a 64-bit checksum of `size` bytes at `data`, continuing from `seed` (the checksum of whatever
+     * came before them). It reads 32 bytes at a time into 4 independent lanes, so checking a cache file
+     * is limited by how fast it can be read rather than by the checksum itself.
+     */
+    inline uint64_t get_cache_checksum(const void* data, size_t size, uint64_t seed = 0)
+    {
+        const uint64_t prime_1 = 0x9E3779B185EBCA87ull;
+        const uint64_t prime_2 = 0xC2B2AE3D27D4EB4Full;
+
+        const auto rotate = [](uint64_t value, int bits) { return (value << bits) | (value >> (64 - bits)); };
+        const auto mix = [&](uint64_t lane, uint64_t word) { return rotate(lane + word * prime_2, 31) * prime_1; };
+
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        uint64_t lanes[4] = { seed + prime_1 + prime_2, seed + prime_2, seed, seed - prime_1 };
+
+        size_t offset = 0;
+        for (; offset + 32 <= size; offset += 32)
+        {
+            for (size_t i = 0; i < 4; ++i)
+            {
+                uint64_t word;
+                std::memcpy(&word, bytes + offset + i * 8, 8);
+                lanes[i] = mix(lanes[i], word);
+            }
+        }
+
+        uint64_t checksum = rotate(lanes[0], 1) + rotate(lanes[1], 7) + rotate(lanes[2], 12) + rotate(lanes[3], 18) + size;
+        for (; offset < size; ++offset)
+        {
+            checksum = rotate(checksum ^ (bytes[offset] * prime_1), 11) * prime_2;
+        }
+
+        // Let every bit of the input affect every bit of the result
+        checksum ^= checksum >> 33;
+        checksum *= prime_2;
+        checksum ^= checksum >> 29;
+
+        return checksum;
+    }
+
+    /**
+     * The layout of a `.hopfcache` file, which holds one finished `FibrationJob` (see `save_fibration_cache()`):
+     *
+     * - A header: the magic bytes `HOPFCACH`, the format version, the job (its output, its generator settings
+     *   and every field of its `Parameters`, see `visit_fibration_job()`), the number of base points, vertices and indices, the offset of
+     *   each array in the file, the size of the file and a checksum of all of the above and of the arrays
+     * - The base points, the vertices and the indices of the fibration, exactly as they are laid out in memory
+     *   (`Vertex`s and `uint32_t`s, little-endian), each starting on a page boundary
+     *
+     * Since the arrays don't have to be parsed (or even copied), a file can be mapped into memory and handed
+     * straight to `glNamedBufferStorage()` or to the exporters (see `FibrationCacheFile`).
+     */
+    namespace cache_file
+    {
+        const char magic[8] = { 'H', 'O', 'P', 'F', 'C', 'A', 'C', 'H' };
+        const uint32_t version = 1;
+        const size_t page_size = 4096;
+
+        inline size_t align_to_page(size_t offset)
+        {
+            return (offset + page_size - 1) / page_size * page_size;
+        }
+
+        template<typename T>
+        inline void append(std::string& header, const T& value)
+        {
+            header.append(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        /**
+         * Returns the part of the header that describes `job`: everything before the counts and offsets of the arrays.
+         */
+        inline std::string get_job_header(const FibrationJob& job)
+        {
+            std::string header{ magic, sizeof(magic) };
+            append(header, version);
+            append(header, static_cast<uint32_t>(page_size));
+            append(header, static_cast<uint32_t>(sizeof(Vertex)));
+
+            FibrationJobWriter writer{ header };
+            visit_fibration_job(job, writer);
+
+            return header;
+        }
+
+        // The last value of each enum in the header, which anything greater than was written by a different version
+        inline FiberOutput get_last_value(FiberOutput) { return FiberOutput::S3; }
+        inline SweepKernel get_last_value(SweepKernel) { return SweepKernel::PhaseTable; }
+        inline SweepIsa get_last_value(SweepIsa) { return SweepIsa::Avx512; }
+
+        /**
+         * Reads a header back from the front of the `size` bytes at `data`, one value after the other (and the
+         * fields of a job, when handed to `visit_fibration_job()`). Throws a `std::runtime_error` if the header
+         * runs past the end, or holds a value that this version can't have written.
+         */
+        class HeaderReader
+        {
+        public:
+
+            HeaderReader(const char* data, size_t size) :
+                data{ data },
+                size{ size }
+            {
+            }
+
+            void read(void* value, size_t count)
+            {
+                if (count > size - offset)
+                {
+                    throw std::runtime_error("Fibration cache file is truncated");
+                }
+                std::memcpy(value, data + offset, count);
+                offset += count;
+            }
+
+            template<typename T>
+            T read()
+            {
+                T value;
+                read(&value, sizeof(T));
+
+                return value;
+            }
+
+            template<typename T>
+            typename std::enable_if<!std::is_enum<T>::value>::type operator()(T& value)
+            {
+                value = static_cast<T>(read<StoredJobField<T>>());
+            }
+
+            template<typename T>
+            typename std::enable_if<std::is_enum<T>::value>::type operator()(T& value)
+            {
+                const uint32_t stored = read<uint32_t>();
+                if (stored > static_cast<uint32_t>(get_last_value(value)))
+                {
+                    throw std::runtime_error("Fibration cache file was written by a different version");
+                }
+                value = static_cast<T>(stored);
+            }
+
+            void operator()(std::string& value)
+            {
+                value.resize(read_count(sizeof(char)));
+                read(&value[0], value.size());
+            }
+
+            void operator()(std::vector<float>& values)
+            {
+                values.resize(read_count(sizeof(float)));
+                read(values.data(), values.size() * sizeof(float));
+            }
+
+            size_t get_offset() const
+            {
+                return offset;
+            }
+
+        private:
+
+            const char* data;
+            size_t size;
+            size_t offset = 0;
+
+            // The length of an array of `element_size` bytes each that follows, checked against the rest of the
+            // file before anything is allocated for it
+            uint32_t read_count(size_t element_size)
+            {
+                const uint32_t count = read<uint32_t>();
+                if (count > (size - offset) / element_size)
+                {
+                    throw std::runtime_error("Fibration cache file is truncated");
+                }
+
+                return count;
+            }
+        };
+
+        // The counts, the offsets, the file size and the checksum that follow the job
+        const size_t trailer_size = 8 * 8;
+    }
+
+    /**
+     * Writes the result of `job` (its base points and, unless `job.output` is `FiberOutput::None`, its
+     * fibration) to a `.hopfcache` file, which `FibrationCacheFile` can map back into memory without
+     * generating anything. Throws a `std::runtime_error` if the file can't be written.
+     */
+    inline void save_fibration_cache(const std::string& filename, const FibrationJob& job, const Vertex* base_points, size_t base_point_count, const Vertex* vertices, size_t vertex_count, const uint32_t* indices, size_t index_count, utils::ExportProgress* progress = nullptr)
+    {
+        if (!utils::is_little_endian())
+        {
+            throw std::runtime_error("Fibration cache files can only be written on little-endian machines");
+        }
+
+        struct Array
+        {
+            const void* data;
+            size_t count;
+            size_t element_size;
+            size_t offset;
+        };
+
+        std::string header = cache_file::get_job_header(job);
+
+        Array arrays[] = {
+            { base_points, base_point_count, sizeof(Vertex), 0 },
+            { vertices, vertex_count, sizeof(Vertex), 0 },
+            { indices, index_count, sizeof(uint32_t), 0 }
+        };
+
+        size_t offset = cache_file::align_to_page(header.size() + cache_file::trailer_size);
+        for (auto& array : arrays)
+        {
+            array.offset = offset;
+            offset = cache_file::align_to_page(offset + array.count * array.element_size);
+        }
+        const size_t file_size = offset;
+
+        for (const auto& array : arrays)
+        {
+            cache_file::append(header, static_cast<uint64_t>(array.count));
+        }
+        for (const auto& array : arrays)
+        {
+            cache_file::append(header, static_cast<uint64_t>(array.offset));
+        }
+        cache_file::append(header, static_cast<uint64_t>(file_size));
+
+        // The checksum covers the header (up to here) and the arrays, but not the padding between them
+        uint64_t checksum = get_cache_checksum(header.data(), header.size());
+        for (const auto& array : arrays)
+        {
+            checksum = get_cache_checksum(array.data, array.count * array.element_size, checksum);
+        }
+        cache_file::append(header, checksum);
+
+        utils::BufferedWriter file{ filename, progress };
+
+        if (progress != nullptr)
+        {
+            progress->items_total += base_point_count + vertex_count + index_count;
+        }
+
+        const std::vector<char> padding(cache_file::page_size, 0);
+        file.write(header);
+        for (const auto& array : arrays)
+        {
+            file.write(padding.data(), array.offset - file.get_bytes_written());
+
+            // Written in chunks, so that progress (and cancellation) isn't held up by a large array
+            const size_t chunk_size = 1 << 16;
+            for (size_t chunk = 0; chunk < array.count; chunk += chunk_size)
+            {
+                const size_t count = std::min(chunk_size, array.count - chunk);
+                file.write(static_cast<const char*>(array.data) + chunk * array.element_size, count * array.element_size);
+
+                if (progress != nullptr)
+                {
+                    progress->items_written += count;
+                }
+            }
+        }
+        file.write(padding.data(), file_size - file.get_bytes_written());
+
+        file.close();
+    }
+
+    inline void save_fibration_cache(const std::string& filename, const FibrationJob& job, const std::vector<Vertex>& base_points, const graphics::MeshData& fibration, utils::ExportProgress* progress = nullptr)
+    {
+        save_fibration_cache(filename, job, base_points.data(), base_points.size(), fibration.first.data(), fibration.first.size(), fibration.second.data(), fibration.second.size(), progress);
+    }
+
+    /**
+     * A `.hopfcache` file (see `save_fibration_cache()`), mapped read-only into memory. Nothing but the header
+     * is read up front: the arrays are paged in by the OS as they are used, straight from the file cache.
+     * Throws a `std::runtime_error` if the file can't be opened, isn't a cache file of this version, or (when
+     * `verify` is set, which reads the whole file once) doesn't match its checksum.
+     */
+    class FibrationCacheFile
+    {
+    public:
+
+        explicit FibrationCacheFile(const std::string& filename, bool verify = true)
+        {
+            if (!utils::is_little_endian())
+            {
+                throw std::runtime_error("Fibration cache files can only be read on little-endian machines");
+            }
+
+            map(filename);
+
+            try
+            {
+                read_header(verify);
+            }
+            catch (...)
+            {
+                unmap();
+                throw;
+            }
+        }
+
+        ~FibrationCacheFile()
+        {
+            unmap();
+        }
+
+        FibrationCacheFile(const FibrationCacheFile& other) = delete;
+
+        FibrationCacheFile& operator=(const FibrationCacheFile& other) = delete;
+
+        /**
+         * Returns the job that this file holds the result of (with the settings that don't affect the result,
+         * such as the number of threads, left at their defaults).
+         */
+        const FibrationJob& get_job() const
+        {
+            return job;
+        }
+
+        /**
+         * Returns `true` if `other` would generate exactly what this file holds (see `SceneCache::get_key()`).
+         */
+        bool matches(const FibrationJob& other) const
+        {
+            return SceneCache::get_key(job) == SceneCache::get_key(other);
+        }
+
+        const Vertex* get_base_points() const
+        {
+            return reinterpret_cast<const Vertex*>(data + base_points_offset);
+        }
+
+        size_t get_base_point_count() const
+        {
+            return base_point_count;
+        }
+
+        const Vertex* get_vertices() const
+        {
+            return reinterpret_cast<const Vertex*>(data + vertices_offset);
+        }
+
+        size_t get_vertex_count() const
+        {
+            return vertex_count;
+        }
+
+        const uint32_t* get_indices() const
+        {
+            return reinterpret_cast<const uint32_t*>(data + indices_offset);
+        }
+
+        size_t get_index_count() const
+        {
+            return index_count;
+        }
+
+        size_t get_file_size() const
+        {
+            return size;
+        }
+
+    private:
+
+        const char* data = nullptr;
+        size_t size = 0;
+
+#if defined(_WIN32)
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = nullptr;
+#endif
+
+        FibrationJob job;
+        size_t base_point_count = 0;
+        size_t vertex_count = 0;
+        size_t index_count = 0;
+        size_t base_points_offset = 0;
+        size_t vertices_offset = 0;
+        size_t indices_offset = 0;
+
+        void map(const std::string& filename)
+        {
+            const std::string error = "Could not map fibration cache file: " + filename;
+
+#if defined(_WIN32)
+            file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            LARGE_INTEGER file_size;
+            if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+            {
+                unmap();
+                throw std::runtime_error(error);
+            }
+            size = static_cast<size_t>(file_size.QuadPart);
+
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            data = mapping == nullptr ? nullptr : static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            if (data == nullptr)
+            {
+                unmap();
+                throw std::runtime_error(error);
+            }
+#else
+            const int descriptor = open(filename.c_str(), O_RDONLY);
+            struct stat status;
+            if (descriptor < 0 || fstat(descriptor, &status) != 0 || status.st_size == 0)
+            {
+                if (descriptor >= 0)
+                {
+                    close(descriptor);
+                }
+                throw std::runtime_error(error);
+            }
+            size = static_cast<size_t>(status.st_size);
+
+            // The mapping keeps the file open, so the descriptor isn't needed past this point
+            void* address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            close(descriptor);
+            if (address == MAP_FAILED)
+            {
+                throw std::runtime_error(error);
+            }
+            data = static_cast<const char*>(address);
+
+            // The arrays are read front to back (by the checksum, the upload or an exporter)
+            madvise(address, size, MADV_SEQUENTIAL);
+#endif
+        }
+
+        void unmap()
+        {
+#if defined(_WIN32)
+            if (data != nullptr)
+            {
+                UnmapViewOfFile(data);
+            }
+            if (mapping != nullptr)
+            {
+                CloseHandle(mapping);
+            }
+            if (file != INVALID_HANDLE_VALUE)
+            {
+                CloseHandle(file);
+            }
+            mapping = nullptr;
+            file = INVALID_HANDLE_VALUE;
+#else
+            if (data != nullptr)
+            {
+                munmap(const_cast<char*>(data), size);
+            }
+#endif
+            data = nullptr;
+        }
+
+        void read_header(bool verify)
+        {
+            cache_file::HeaderReader reader{ data, size };
+
+            char file_magic[sizeof(cache_file::magic)];
+            reader.read(file_magic, sizeof(file_magic));
+            if (std::memcmp(file_magic, cache_file::magic, sizeof(file_magic)) != 0)
+            {
+                throw std::runtime_error("Not a fibration cache file");
+            }
+            if (reader.read<uint32_t>() != cache_file::version || reader.read<uint32_t>() != cache_file::page_size || reader.read<uint32_t>() != sizeof(Vertex))
+            {
+                throw std::runtime_error("Fibration cache file was written by a different version");
+            }
+
+            visit_fibration_job(job, reader);
+
+            base_point_count = static_cast<size_t>(reader.read<uint64_t>());
+            vertex_count = static_cast<size_t>(reader.read<uint64_t>());
+            index_count = static_cast<size_t>(reader.read<uint64_t>());
+            base_points_offset = static_cast<size_t>(reader.read<uint64_t>());
+            vertices_offset = static_cast<size_t>(reader.read<uint64_t>());
+            indices_offset = static_cast<size_t>(reader.read<uint64_t>());
+            const size_t file_size = static_cast<size_t>(reader.read<uint64_t>());
+            const size_t checksummed = reader.get_offset();
+            const uint64_t checksum = reader.read<uint64_t>();
+
+            // Every array has to lie within the file (and be aligned, for the casts above)
+            const auto contains = [&](size_t array_offset, size_t count, size_t element_size)
+            {
+                return array_offset % cache_file::page_size == 0 && array_offset <= size && count <= (size - array_offset) / element_size;
+            };
+            if (file_size != size ||
+                !contains(base_points_offset, base_point_count, sizeof(Vertex)) ||
+                !contains(vertices_offset, vertex_count, sizeof(Vertex)) ||
+                !contains(indices_offset, index_count, sizeof(uint32_t)))
+            {
+                throw std::runtime_error("Fibration cache file is truncated");
+            }
+
+            if (verify)
+            {
+                uint64_t expected = get_cache_checksum(data, checksummed);
+                expected = get_cache_checksum(get_base_points(), base_point_count * sizeof(Vertex), expected);
+                expected = get_cache_checksum(get_vertices(), vertex_count * sizeof(Vertex), expected);
+                expected = get_cache_checksum(get_indices(), index_count * sizeof(uint32_t), expected);
+
+                if (expected != checksum)
+                {
+                    throw std::runtime_error("Fibration cache file is corrupt (checksum mismatch)");
+                }
+            }
+        }
+    };
+
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "glad/glad.h"
+
+#include "hopf.h"
+#include "mesh.h"
+#include "shader.h"
+
+namespace graphics
+{
+
+    /**
+     * Generates fibrations on the GPU with a compute shader (see `shaders/fibration.comp`). The
+     * output has exactly the same layout as `hopf::generate_fibration()` (or, optionally,
+     * `hopf::generate_fibration_s3()`), but never leaves the GPU unless `Mesh::read_back()` is called.
+     * Fibers are drawn with one indirect command each, so no index buffer is generated.
+     */
+    class FibrationCompute
+    {
+    public:
+
+        explicit FibrationCompute(const std::string& comp_path, ProgramCache* cache = nullptr) :
+            shader{ comp_path, cache },
+            location_number_of_fibers{ shader.get_uniform_location("u_number_of_fibers") },
+            location_iterations_per_fiber{ shader.get_uniform_location("u_iterations_per_fiber") },
+            location_s3_output{ shader.get_uniform_location("u_s3_output") }
+        {
+        }
+
+        ~FibrationCompute()
+        {
+            glDeleteBuffers(1, &phase_buffer);
+        }
+
+        FibrationCompute(const FibrationCompute& other) = delete;
+
+        FibrationCompute& operator=(const FibrationCompute& other) = delete;
+
+        /**
+         * Sweeps out one fiber (of `iterations_per_fiber` vertices) for each vertex of `base_points`,
+         * which is read directly from that mesh's vertex buffer.
+         */
+        Mesh generate(const Mesh& base_points, size_t iterations_per_fiber, bool s3_output = false)
+        {
+            const size_t number_of_fibers = base_points.get_vertex_count();
+            const size_t vertex_count = number_of_fibers * iterations_per_fiber;
+
+            if (vertex_count == 0)
+            {
+                return Mesh{ std::vector<Vertex>{}, std::vector<uint32_t>{} };
+            }
+
+            update_phase_buffer(iterations_per_fiber);
+
+            uint32_t vertex_buffer;
+            glCreateBuffers(1, &vertex_buffer);
+            glNamedBufferStorage(vertex_buffer, sizeof(Vertex) * vertex_count, nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, base_points.get_vertex_buffer());
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, phase_buffer);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, vertex_buffer);
+
+            shader.use();
+            shader.uniform_uint(location_number_of_fibers, static_cast<uint32_t>(number_of_fibers));
+            shader.uniform_uint(location_iterations_per_fiber, static_cast<uint32_t>(iterations_per_fiber));
+            shader.uniform_bool(location_s3_output, s3_output);
+
+            // Every implementation supports at least 65535 work groups along each axis, so spill
+            // over into a second dimension for very large fibrations
+            const size_t max_groups_x = 65535;
+            const size_t groups = (vertex_count + local_size - 1) / local_size;
+            const size_t groups_x = std::min(groups, max_groups_x);
+            const size_t groups_y = (groups + groups_x - 1) / groups_x;
+            glDispatchCompute(static_cast<uint32_t>(groups_x), static_cast<uint32_t>(groups_y), 1);
+
+            // Make the writes visible to vertex fetching and read-backs
+            glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+            Mesh mesh{ vertex_buffer, vertex_count };
+            mesh.set_draw_commands(Mesh::get_fiber_draw_commands(number_of_fibers, iterations_per_fiber));
+
+            return mesh;
+        }
+
+    private:
+
+        // Must match `local_size_x` in the compute shader
+        static const size_t local_size = 64;
+
+        Shader shader;
+        int32_t location_number_of_fibers;
+        int32_t location_iterations_per_fiber;
+        int32_t location_s3_output;
+
+        uint32_t phase_buffer = 0;
+        size_t phase_count = 0;
+
+        void update_phase_buffer(size_t iterations_per_fiber)
+        {
+            if (phase_buffer != 0 && phase_count == iterations_per_fiber)
+            {
+                return;
+            }
+
+            const auto table = hopf::get_phase_table(iterations_per_fiber);
+
+            std::vector<float> phases;
+            phases.reserve(iterations_per_fiber * 2);
+            for (size_t j = 0; j < iterations_per_fiber; ++j)
+            {
+                phases.push_back(table->cos_phi[j]);
+                phases.push_back(table->sin_phi[j]);
+            }
+
+            glDeleteBuffers(1, &phase_buffer);
+            glCreateBuffers(1, &phase_buffer);
+            glNamedBufferStorage(phase_buffer, sizeof(float) * phases.size(), phases.data(), 0);
+            phase_count = iterations_per_fiber;
+        }
+    };
+
+}
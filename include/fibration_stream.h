@@ -0,0 +1,198 @@
+#pragma once
+
+#include <algorithm>
+#include <exception>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.h"
+#include "hopf.h"
+#include "utils.h"
+
+namespace hopf
+{
+
+    /**
+     * How `stream_fibration()` splits up the work.
+     */
+    struct StreamSettings
+    {
+        // Fibers are generated in chunks of (about) this many vertices: a chunk always holds whole fibers
+        size_t vertices_per_chunk = 1 << 18;
+
+        // The number of generated chunks that may wait for the writer
+        size_t queue_capacity = 4;
+    };
+
+    /**
+     * Generates the fibers of `base_points` chunk by chunk on a background thread and writes each chunk to
+     * `filename` (an .obj or a .ply file, see `utils::save_polylines()`) as soon as it is ready, so that
+     * generating and writing overlap, and at most `queue_capacity + 2` chunks are ever held in memory, no
+     * matter how large the fibration is. Fiber `i` gets `sample_counts[i]` vertices (see
+     * `generate_adaptive_fibration()`) or, if `sample_counts` is empty, `iterations_per_fiber` vertices (see
+     * `generate_fibration()`). The file is byte-for-byte the same as saving the whole fibration at once.
+     * Throws a `std::runtime_error` for .glb files, whose header depends on every vertex.
+     */
+    inline void stream_fibration(const std::vector<Vertex>& base_points, size_t iterations_per_fiber, const std::vector<size_t>& sample_counts, const GeneratorSettings& settings, const std::string& filename, const StreamSettings& stream_settings = {}, utils::ExportProgress* progress = nullptr)
+    {
+        const std::string extension = utils::get_extension(filename);
+        if (extension == "glb")
+        {
+            throw std::runtime_error("GLB files can't be streamed: " + filename);
+        }
+        const bool ply = extension == "ply";
+
+        const size_t number_of_fibers = base_points.size();
+        const auto get_sample_count = [&](size_t fiber)
+        {
+            return sample_counts.empty() ? iterations_per_fiber : sample_counts[fiber];
+        };
+
+        // Split the fibers into chunks: chunk `i` holds fibers `[chunk_starts[i], chunk_starts[i + 1])`
+        std::vector<size_t> chunk_starts{ 0 };
+        size_t vertex_count = 0;
+        size_t edge_count = 0;
+        size_t chunk_vertices = 0;
+        for (size_t i = 0; i < number_of_fibers; ++i)
+        {
+            const size_t count = get_sample_count(i);
+            if (chunk_vertices != 0 && chunk_vertices + count > stream_settings.vertices_per_chunk)
+            {
+                chunk_starts.push_back(i);
+                chunk_vertices = 0;
+            }
+            chunk_vertices += count;
+
+            vertex_count += count;
+            edge_count += count > 0 ? count - 1 : 0;
+        }
+        chunk_starts.push_back(number_of_fibers);
+
+        const size_t index_count = vertex_count + number_of_fibers;
+        if (vertex_count > std::numeric_limits<uint32_t>::max())
+        {
+            throw std::runtime_error("Too many vertices to index with 32 bits");
+        }
+
+        utils::BufferedWriter file{ ply ? filename : utils::get_obj_filename(filename), progress };
+
+        if (progress != nullptr)
+        {
+            progress->items_total += vertex_count + (ply ? edge_count : index_count);
+        }
+
+        if (ply)
+        {
+            utils::write_ply_header(file, vertex_count, edge_count);
+        }
+
+        // The vertices of each chunk, in order
+        utils::BoundedQueue<std::vector<Vertex>> queue{ stream_settings.queue_capacity };
+        std::exception_ptr error;
+
+        std::thread producer{ [&]
+        {
+            try
+            {
+                for (size_t chunk = 0; chunk + 1 < chunk_starts.size(); ++chunk)
+                {
+                    const auto first = base_points.begin() + chunk_starts[chunk];
+                    const auto last = base_points.begin() + chunk_starts[chunk + 1];
+                    const std::vector<Vertex> chunk_points{ first, last };
+
+                    graphics::MeshData generated;
+                    if (sample_counts.empty())
+                    {
+                        generated = generate_fibration(chunk_points, iterations_per_fiber, settings);
+                    }
+                    else
+                    {
+                        const std::vector<size_t> chunk_counts{ sample_counts.begin() + chunk_starts[chunk], sample_counts.begin() + chunk_starts[chunk + 1] };
+                        generated = generate_adaptive_fibration(chunk_points, chunk_counts, settings);
+                    }
+
+                    if (!queue.push(std::move(generated.first)))
+                    {
+                        // The writer gave up
+                        break;
+                    }
+                }
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+
+            queue.close();
+        } };
+
+        try
+        {
+            std::vector<Vertex> vertices;
+            while (queue.pop(vertices))
+            {
+                if (ply)
+                {
+                    utils::write_ply_vertices(file, vertices.data(), vertices.size(), progress);
+                }
+                else
+                {
+                    utils::write_obj_vertices(file, vertices.data(), vertices.size(), progress);
+                }
+            }
+
+            producer.join();
+            if (error)
+            {
+                std::rethrow_exception(error);
+            }
+
+            // The indices only depend on the number of samples per fiber, so they are rebuilt chunk by chunk
+            // (in the layout of `generate_fibration()`) instead of being kept around until all vertices are written
+            std::vector<uint32_t> indices;
+            bool start = true;
+            uint32_t first_vertex = 0;
+            for (size_t chunk = 0; chunk + 1 < chunk_starts.size(); ++chunk)
+            {
+                indices.clear();
+                for (size_t i = chunk_starts[chunk]; i < chunk_starts[chunk + 1]; ++i)
+                {
+                    const size_t count = get_sample_count(i);
+                    for (size_t j = 0; j < count; ++j)
+                    {
+                        indices.push_back(first_vertex++);
+                    }
+
+                    // Primitive restart
+                    indices.push_back(std::numeric_limits<uint32_t>::max());
+                }
+
+                if (ply)
+                {
+                    utils::write_ply_edges(file, indices.data(), utils::get_polylines(indices.data(), indices.size()), progress);
+                }
+                else
+                {
+                    utils::write_obj_indices(file, indices.data(), indices.size(), start, progress);
+                }
+            }
+
+            file.close();
+        }
+        catch (...)
+        {
+            // Unblock the producer (if it is still running) before giving up
+            queue.close();
+            if (producer.joinable())
+            {
+                producer.join();
+            }
+
+            throw;
+        }
+    }
+
+}
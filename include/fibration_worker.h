@@ -0,0 +1,715 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "hopf.h"
+
+namespace hopf
+{
+
+    /**
+     * What a `FibrationJob` should sweep out, beyond the base points.
+     */
+    enum class FiberOutput
+    {
+        None,       // Only the base points (the fibers are swept out on the GPU)
+        Projected,  // `generate_fibration()`
+        S3          // `generate_fibration_s3()`
+    };
+
+    /**
+     * A snapshot of everything that a background regeneration depends on, so the UI is free to keep
+     * changing its own copy of the parameters while the job runs.
+     */
+    struct FibrationJob
+    {
+        Parameters parameters;
+        GeneratorSettings settings;
+        FiberOutput output = FiberOutput::Projected;
+
+        // When `false`, the base points are left unrotated (the rotation is applied on the GPU)
+        bool rotate_base_points = true;
+
+        // When set, the fibers are handed out at increasing levels of detail (see `get_refinement_levels()`)
+        // as they are generated, starting with one that is quick enough to show on the next frame
+        bool progressive = false;
+
+        // When non-zero, each fiber gets as many samples as it needs to look smooth (up to
+        // `parameters.iterations_per_fiber`), with at most this many vertices in total (see
+        // `get_adaptive_sample_counts()`). Adaptive fibrations are never refined progressively.
+        size_t vertex_budget = 0;
+    };
+
+    /**
+     * Hands every field of `job` that describes what it generates to `field`, in a fixed order. This is the
+     * one list of them that `SceneCache::get_key()` and the header of a `.hopfcache` file are both written
+     * from (and that the header is read back with), so a field added here is picked up by all of them.
+     */
+    template<typename Job, typename Visitor>
+    inline void visit_fibration_job(Job& job, Visitor& field)
+    {
+        field(job.output);
+        field(job.rotate_base_points);
+        field(job.settings.kernel);
+        field(job.settings.isa);
+        field(job.vertex_budget);
+
+        field(job.parameters.number_of_fibers);
+        field(job.parameters.iterations_per_fiber);
+        field(job.parameters.number_of_circles);
+        field(job.parameters.seed);
+        field(job.parameters.mean);
+        field(job.parameters.standard_deviation);
+        field(job.parameters.loxodrome_offset);
+        field(job.parameters.curl_alpha);
+        field(job.parameters.curl_beta);
+        field(job.parameters.rotation_x);
+        field(job.parameters.rotation_y);
+        field(job.parameters.rotation_z);
+
+        // The variable-length fields go last
+        field(job.parameters.mode);
+        field(job.parameters.offsets);
+        field(job.parameters.arc_angles);
+    }
+
+    /**
+     * How a scalar field of a job is stored: enums and flags as `uint32_t`s and sizes as `uint64_t`s, so that
+     * the layout doesn't depend on the platform, and everything else as it is.
+     */
+    template<typename T>
+    using StoredJobField = typename std::conditional<std::is_enum<T>::value || std::is_same<T, bool>::value, uint32_t,
+        typename std::conditional<std::is_same<T, size_t>::value, uint64_t, T>::type>::type;
+
+    /**
+     * Appends the fields of a job (see `visit_fibration_job()`) to a string: scalars as the bits of their
+     * `StoredJobField`, and variable-length fields prefixed with their length (as a `uint32_t`).
+     */
+    class FibrationJobWriter
+    {
+    public:
+
+        explicit FibrationJobWriter(std::string& output) :
+            output{ output }
+        {
+        }
+
+        template<typename T>
+        void operator()(const T& value)
+        {
+            append(static_cast<StoredJobField<T>>(value));
+        }
+
+        void operator()(const std::string& value)
+        {
+            append(static_cast<uint32_t>(value.size()));
+            output.append(value);
+        }
+
+        void operator()(const std::vector<float>& values)
+        {
+            append(static_cast<uint32_t>(values.size()));
+            output.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(float));
+        }
+
+    private:
+
+        std::string& output;
+
+        template<typename T>
+        void append(const T& value)
+        {
+            output.append(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+    };
+
+    /**
+     * A finished `FibrationJob`: the base points and (depending on `job.output`) the fibers above them.
+     */
+    struct FibrationResult
+    {
+        uint64_t id = 0;
+        FibrationJob job;
+        std::vector<Vertex> base_points;
+        graphics::MeshData fibration;
+
+        // The fibers and samples that `fibration` keeps from the full resolution (every fiber and every
+        // sample, once a job has finished)
+        RefinementLevel level;
+
+        // When set, only `changed_vertices` differ from the previous result that `poll()` returned (which
+        // had the same layout), so the rest doesn't have to be uploaded again
+        bool partial = false;
+        std::vector<graphics::VertexRange> changed_vertices;
+
+        // How long the worker spent on this result: getting the base points (only counted in the first result
+        // of a job), then generating the fibers since the previous result (or since the base points)
+        double base_points_seconds = 0.0;
+        double generation_seconds = 0.0;
+    };
+
+    /**
+     * How well a `SceneCache` has been doing, for display in the UI.
+     */
+    struct SceneCacheStatistics
+    {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t entries = 0;
+        size_t bytes = 0;
+        size_t budget = 0;
+    };
+
+    /**
+     * A least-recently-used cache of finished fibrations, keyed by everything about a `FibrationJob` that
+     * changes its result, so that going back to a configuration that was generated a moment ago (flipping
+     * between modes, or sweeping a slider back and forth) doesn't sweep any fibers at all. The least
+     * recently used entries are evicted once the cache holds more than its budget.
+     */
+    class SceneCache
+    {
+    public:
+
+        struct Entry
+        {
+            std::string key;
+            std::vector<Vertex> base_points;
+            graphics::MeshData fibration;
+            size_t bytes;
+        };
+
+        static constexpr size_t default_budget = 256 * 1024 * 1024;
+
+        explicit SceneCache(size_t budget = default_budget) :
+            budget{ budget }
+        {
+        }
+
+        /**
+         * Returns the cached result of `job` (marking it as the most recently used), or `nullptr` if there
+         * isn't one. The entry stays valid until the next call to `insert()`, `set_budget()` or `clear()`.
+         */
+        const Entry* find(const FibrationJob& job)
+        {
+            const auto it = lookup.find(get_key(job));
+            if (it == lookup.end())
+            {
+                ++statistics.misses;
+                return nullptr;
+            }
+            ++statistics.hits;
+
+            entries.splice(entries.begin(), entries, it->second);
+
+            return &entries.front();
+        }
+
+        /**
+         * Caches a copy of the result of `job`, unless it wouldn't fit in the budget on its own.
+         */
+        void insert(const FibrationJob& job, const std::vector<Vertex>& base_points, const graphics::MeshData& fibration)
+        {
+            std::string key = get_key(job);
+            const size_t bytes = key.size() + (base_points.size() + fibration.first.size()) * sizeof(Vertex) + fibration.second.size() * sizeof(uint32_t);
+            if (bytes > budget || lookup.count(key) != 0)
+            {
+                return;
+            }
+
+            entries.push_front(Entry{ std::move(key), base_points, fibration, bytes });
+            lookup.emplace(entries.front().key, entries.begin());
+            statistics.bytes += bytes;
+
+            evict();
+        }
+
+        void set_budget(size_t bytes)
+        {
+            budget = bytes;
+            evict();
+        }
+
+        void clear()
+        {
+            entries.clear();
+            lookup.clear();
+            statistics.bytes = 0;
+        }
+
+        SceneCacheStatistics get_statistics() const
+        {
+            SceneCacheStatistics result = statistics;
+            result.entries = entries.size();
+            result.budget = budget;
+
+            return result;
+        }
+
+        /**
+         * Packs everything that the result of `job` depends on into a string (hashed by the lookup table, and
+         * compared by `FibrationCacheFile::matches()`). Floats are compared by their bits, like in the
+         * `FiberCache`, so a hit is always exactly what would have been generated. Settings that don't change
+         * the result (the number of threads, whether to refine progressively, the kernel of an S3 sweep and
+         * the rotation when it is applied on the GPU, unless adaptive fibers on S3 are sized by it) are reset
+         * to their defaults first.
+         */
+        static std::string get_key(const FibrationJob& job)
+        {
+            FibrationJob relevant;
+            relevant.parameters = job.parameters;
+            relevant.output = job.output;
+            relevant.rotate_base_points = job.rotate_base_points;
+            if (job.output == FiberOutput::Projected)
+            {
+                relevant.settings.kernel = job.settings.kernel;
+                relevant.settings.isa = job.settings.isa;
+            }
+            if (job.output != FiberOutput::None)
+            {
+                relevant.vertex_budget = job.vertex_budget;
+            }
+            if (!job.rotate_base_points && !(job.output == FiberOutput::S3 && job.vertex_budget != 0))
+            {
+                relevant.parameters.rotation_x = relevant.parameters.rotation_y = relevant.parameters.rotation_z = 0.0f;
+            }
+
+            std::string key;
+            FibrationJobWriter writer{ key };
+            visit_fibration_job(relevant, writer);
+
+            return key;
+        }
+
+    private:
+
+        // Most recently used first
+        std::list<Entry> entries;
+        std::unordered_map<std::string, std::list<Entry>::iterator> lookup;
+
+        size_t budget;
+        SceneCacheStatistics statistics;
+
+        void evict()
+        {
+            while (statistics.bytes > budget)
+            {
+                statistics.bytes -= entries.back().bytes;
+                lookup.erase(entries.back().key);
+                entries.pop_back();
+            }
+        }
+    };
+
+    /**
+     * Regenerates fibrations on a background thread, so that the render loop never waits on the CPU
+     * generators. Submitting a job cancels the one that is running (mid-sweep, see
+     * `GeneratorSettings::cancel`), and only the most recently finished result is ever handed out.
+     *
+     * Results are double-buffered: the worker always writes into its own buffers and swaps them with
+     * the caller's in `poll()`, so the vectors are re-used from one job to the next. A progressive job
+     * is handed out once per level of detail, so `poll()` may return several results for the same job.
+     * Finished results are kept in a `SceneCache`, and handed out again (in full) when a job asks for one.
+     */
+    class FibrationWorker
+    {
+    public:
+
+        FibrationWorker() :
+            thread{ [this] { worker_loop(); } }
+        {
+        }
+
+        ~FibrationWorker()
+        {
+            {
+                std::lock_guard<std::mutex> lock{ mutex };
+                stopping = true;
+                cancel = true;
+            }
+            job_available.notify_all();
+
+            thread.join();
+        }
+
+        FibrationWorker(const FibrationWorker& other) = delete;
+
+        FibrationWorker& operator=(const FibrationWorker& other) = delete;
+
+        /**
+         * Queues `job` (replacing any job that hasn't started yet, and cancelling the one that has) and
+         * returns its id.
+         */
+        uint64_t submit(const FibrationJob& job)
+        {
+            uint64_t id;
+            {
+                std::lock_guard<std::mutex> lock{ mutex };
+                pending_job = job;
+                id = ++submitted_id;
+
+                if (running_id != 0)
+                {
+                    cancel = true;
+                }
+            }
+            job_available.notify_all();
+
+            return id;
+        }
+
+        /**
+         * If a job has finished (or, for a progressive job, reached a new level of detail) since the last
+         * call, swaps its result into `result` and returns `true`. When `wait` is set, blocks until the most
+         * recently submitted job has finished first.
+         */
+        bool poll(FibrationResult& result, bool wait = false)
+        {
+            std::unique_lock<std::mutex> lock{ mutex };
+            if (wait)
+            {
+                job_done.wait(lock, [this] { return finished_id == submitted_id; });
+            }
+
+            if (!result_available)
+            {
+                return false;
+            }
+            result_available = false;
+
+            std::swap(result, ready);
+
+            return true;
+        }
+
+        /**
+         * Returns `true` while the most recently submitted job has yet to finish.
+         */
+        bool is_busy() const
+        {
+            std::lock_guard<std::mutex> lock{ mutex };
+            return finished_id != submitted_id;
+        }
+
+        /**
+         * Sets the most memory (in bytes) that finished fibrations may take up in the scene cache (see
+         * `SceneCache`), from the next job on.
+         */
+        void set_scene_cache_budget(size_t bytes)
+        {
+            std::lock_guard<std::mutex> lock{ mutex };
+            scene_cache_budget = bytes;
+        }
+
+        /**
+         * Returns the statistics of the scene cache, as of the last job that the worker ran.
+         */
+        SceneCacheStatistics get_scene_cache_statistics() const
+        {
+            std::lock_guard<std::mutex> lock{ mutex };
+            return scene_cache_statistics;
+        }
+
+    private:
+
+        mutable std::mutex mutex;
+        std::condition_variable job_available;
+        std::condition_variable job_done;
+
+        // Set to cancel the running job (only ever written while holding `mutex`)
+        std::atomic<bool> cancel{ false };
+
+        // Guarded by `mutex`
+        FibrationJob pending_job;
+        uint64_t submitted_id = 0;
+        uint64_t running_id = 0;
+        uint64_t finished_id = 0;
+        FibrationResult ready;
+        bool result_available = false;
+        bool stopping = false;
+        size_t scene_cache_budget = SceneCache::default_budget;
+        SceneCacheStatistics scene_cache_statistics;
+
+        // Only touched by the worker thread
+        FibrationResult back;
+        std::vector<Vertex> base_points;
+        std::vector<Vertex> refinement;
+        FiberCache fiber_cache;
+        SceneCache scene_cache;
+
+        // Whether the last result that was handed out came from `fiber_cache`, and which vertices the cache
+        // has changed since then
+        bool published_from_cache = false;
+        std::vector<graphics::VertexRange> unpublished_changes;
+
+        // For the timings of each result (see `FibrationResult`)
+        std::chrono::steady_clock::time_point generation_start;
+        double base_points_seconds = 0.0;
+
+        // Declared last, so that everything above exists before the thread starts
+        std::thread thread;
+
+        void worker_loop()
+        {
+            while (true)
+            {
+                uint64_t id;
+                FibrationJob job;
+                size_t budget;
+                {
+                    std::unique_lock<std::mutex> lock{ mutex };
+                    job_available.wait(lock, [this] { return stopping || submitted_id != finished_id; });
+
+                    if (stopping)
+                    {
+                        return;
+                    }
+
+                    id = running_id = submitted_id;
+                    job = pending_job;
+                    budget = scene_cache_budget;
+                    cancel = false;
+                }
+                scene_cache.set_budget(budget);
+
+                bool completed = false;
+                try
+                {
+                    completed = run(id, job);
+                }
+                catch (const std::exception& e)
+                {
+                    // Treat the job as finished (with nothing to show), so that `poll()` never waits forever
+                    std::cerr << "Error: " << e.what() << "\n";
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock{ mutex };
+                    running_id = 0;
+                    scene_cache_statistics = scene_cache.get_statistics();
+
+                    // A cancelled job is simply dropped: the job that cancelled it is already pending
+                    if (completed || !cancel)
+                    {
+                        finished_id = id;
+                    }
+                }
+                job_done.notify_all();
+            }
+        }
+
+        /**
+         * Runs `job`, publishing each level of detail that it passes through (see `publish()`). Returns
+         * `false` if the job was cancelled before it finished.
+         */
+        bool run(uint64_t id, const FibrationJob& job)
+        {
+            // Going back to a configuration that was generated recently doesn't sweep anything
+            const SceneCache::Entry* cached = scene_cache.find(job);
+            const auto start = std::chrono::steady_clock::now();
+
+            if (cached)
+            {
+                base_points = cached->base_points;
+            }
+            else if (job.rotate_base_points)
+            {
+                base_points = get_base_points(job.parameters);
+            }
+            else
+            {
+                Parameters unrotated = job.parameters;
+                unrotated.rotation_x = unrotated.rotation_y = unrotated.rotation_z = 0.0f;
+
+                base_points = get_base_points(unrotated);
+            }
+
+            generation_start = std::chrono::steady_clock::now();
+            base_points_seconds = std::chrono::duration<double>(generation_start - start).count();
+
+            const size_t number_of_fibers = base_points.size();
+            const size_t iterations_per_fiber = job.parameters.iterations_per_fiber;
+            const bool s3_output = job.output == FiberOutput::S3;
+
+            GeneratorSettings settings = job.settings;
+            settings.cancel = &cancel;
+
+            if (job.output == FiberOutput::None)
+            {
+                back.fibration.first.clear();
+                back.fibration.second.clear();
+
+                if (!cached)
+                {
+                    scene_cache.insert(job, base_points, back.fibration);
+                }
+
+                return publish(id, job, RefinementLevel{});
+            }
+
+            // Fibers of different lengths don't fit the fixed layout that the fiber cache (and the levels of
+            // progressive refinement) work in, so adaptive fibrations are always generated in one go
+            if (job.vertex_budget != 0)
+            {
+                if (cached)
+                {
+                    back.fibration = cached->fibration;
+                }
+                else
+                {
+                    // Fibers are sized by how they end up on screen, which (on the GPU path) is after the rotation
+                    const auto sample_counts = get_adaptive_sample_counts(s3_output ? get_base_points(job.parameters) : base_points, iterations_per_fiber, job.vertex_budget);
+
+                    back.fibration = generate_adaptive_fibration(base_points, sample_counts, settings, s3_output);
+                    if (cancel)
+                    {
+                        return false;
+                    }
+                    scene_cache.insert(job, base_points, back.fibration);
+                }
+
+                // From here on, the fiber cache no longer matches what was handed out
+                published_from_cache = false;
+
+                return publish(id, job, RefinementLevel{});
+            }
+
+            // Unless the fiber cache already holds them, the cached fibers replace whatever it holds (so that
+            // edits from here on are still incremental)
+            if (cached && fiber_cache.count_misses(base_points, iterations_per_fiber, settings, s3_output) != 0)
+            {
+                fiber_cache.assign(base_points, iterations_per_fiber, settings, s3_output, cached->fibration);
+                published_from_cache = false;
+            }
+
+            // Unless most of the fibers have to be swept anyway (in which case a coarse preview is worth it),
+            // only sweep the fibers whose base points have changed since the last job
+            if (cached || !job.progressive || fiber_cache.count_misses(base_points, iterations_per_fiber, settings, s3_output) * 2 <= number_of_fibers)
+            {
+                // Even if this is cancelled, the cache has moved on from what was last handed out
+                const auto changed = fiber_cache.update(base_points, iterations_per_fiber, settings, s3_output);
+                unpublished_changes.insert(unpublished_changes.end(), changed.begin(), changed.end());
+                if (cancel)
+                {
+                    return false;
+                }
+
+                back.fibration = fiber_cache.get_fibration();
+                if (!cached)
+                {
+                    scene_cache.insert(job, base_points, back.fibration);
+                }
+
+                return publish(id, job, RefinementLevel{}, true);
+            }
+
+            // Each level only sweeps the vertices that the coarser levels didn't, into a full-resolution
+            // buffer that every level is gathered from
+            const auto levels = get_refinement_levels(number_of_fibers, iterations_per_fiber);
+            refinement.resize(number_of_fibers * iterations_per_fiber);
+
+            for (size_t k = 0; k < levels.size(); ++k)
+            {
+                refine_fibration(base_points, iterations_per_fiber, k > 0 ? &levels[k - 1] : nullptr, levels[k], settings, s3_output, refinement.data());
+                if (cancel)
+                {
+                    return false;
+                }
+
+                if (k + 1 < levels.size())
+                {
+                    gather_refinement_level(refinement, number_of_fibers, iterations_per_fiber, levels[k], back.fibration);
+                    if (!publish(id, job, levels[k]))
+                    {
+                        return false;
+                    }
+                }
+                else
+                {
+                    // The last level is the full resolution, so the buffer can be handed over as it is
+                    std::swap(back.fibration.first, refinement);
+                    back.fibration.second.resize(number_of_fibers * (iterations_per_fiber + 1));
+                    get_fibration_indices(number_of_fibers, iterations_per_fiber, back.fibration.second.data());
+
+                    // Everything has changed, but from here on the cache matches what was handed out
+                    fiber_cache.assign(base_points, iterations_per_fiber, settings, s3_output, back.fibration);
+                    published_from_cache = false;
+                    scene_cache.insert(job, base_points, back.fibration);
+
+                    if (!publish(id, job, levels[k], true))
+                    {
+                        return false;
+                    }
+                }
+            }
+
+            return true;
+        }
+
+        /**
+         * Hands the fibration in `back` (at level of detail `level`) over to `poll()`, unless the job has
+         * been cancelled. Returns `false` if it has. `from_cache` is set when `back` is what `fiber_cache`
+         * holds, in which case it only differs from the last result in `unpublished_changes` (if that also
+         * came from the cache).
+         */
+        bool publish(uint64_t id, const FibrationJob& job, const RefinementLevel& level, bool from_cache = false)
+        {
+            if (cancel)
+            {
+                return false;
+            }
+
+            back.id = id;
+            back.job = job;
+            back.level = level;
+            back.base_points = base_points;
+
+            const auto now = std::chrono::steady_clock::now();
+            back.base_points_seconds = base_points_seconds;
+            back.generation_seconds = std::chrono::duration<double>(now - generation_start).count();
+            base_points_seconds = 0.0;
+            generation_start = now;
+
+            back.partial = from_cache && published_from_cache;
+            back.changed_vertices.clear();
+            if (back.partial)
+            {
+                std::swap(back.changed_vertices, unpublished_changes);
+            }
+            unpublished_changes.clear();
+            published_from_cache = from_cache;
+
+            std::lock_guard<std::mutex> lock{ mutex };
+            if (result_available && back.partial)
+            {
+                // The caller never saw the previous result, so it needs those changes as well
+                if (ready.partial)
+                {
+                    back.changed_vertices.insert(back.changed_vertices.end(), ready.changed_vertices.begin(), ready.changed_vertices.end());
+                }
+                else
+                {
+                    back.partial = false;
+                }
+            }
+
+            std::swap(back, ready);
+            result_available = true;
+
+            return true;
+        }
+    };
+
+}
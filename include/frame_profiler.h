@@ -0,0 +1,375 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "glad/glad.h"
+
+namespace graphics
+{
+
+    /**
+     * The last `capacity` samples of one timing (in milliseconds), for graphs and percentiles.
+     */
+    class TimingHistory
+    {
+    public:
+
+        explicit TimingHistory(size_t capacity = 240) :
+            capacity{ std::max<size_t>(capacity, 1) }
+        {
+        }
+
+        void add(float milliseconds)
+        {
+            if (samples.size() < capacity)
+            {
+                samples.push_back(milliseconds);
+            }
+            else
+            {
+                samples[next] = milliseconds;
+            }
+            next = (next + 1) % capacity;
+        }
+
+        /**
+         * Returns the samples from oldest to newest.
+         */
+        std::vector<float> get_samples() const
+        {
+            if (samples.size() < capacity)
+            {
+                return samples;
+            }
+
+            std::vector<float> ordered{ samples.begin() + next, samples.end() };
+            ordered.insert(ordered.end(), samples.begin(), samples.begin() + next);
+
+            return ordered;
+        }
+
+        /**
+         * Returns the `percentile`th percentile (between 0 and 100) of the samples, by nearest rank, or 0
+         * if there aren't any.
+         */
+        float get_percentile(float percentile) const
+        {
+            if (samples.empty())
+            {
+                return 0.0f;
+            }
+
+            std::vector<float> sorted = samples;
+            const size_t rank = static_cast<size_t>(std::ceil(percentile / 100.0f * sorted.size()));
+            const auto nth = sorted.begin() + (std::min(std::max<size_t>(rank, 1), sorted.size()) - 1);
+            std::nth_element(sorted.begin(), nth, sorted.end());
+
+            return *nth;
+        }
+
+        size_t size() const
+        {
+            return samples.size();
+        }
+
+    private:
+
+        size_t capacity;
+        std::vector<float> samples;
+        size_t next = 0;
+    };
+
+    /**
+     * Collects per-frame timings of the CPU (measured by the caller) and of the GPU (measured with
+     * `GL_TIME_ELAPSED` queries around each pass), keeps a history of each for display, and can write a
+     * record of every frame to a CSV file.
+     *
+     * GPU timings only become available a few frames later, so each GPU series owns a small ring of
+     * queries: a query is only read back once the driver reports its result as available, and a pass is
+     * simply not timed if every query in its ring is still in flight, so that timing never stalls the
+     * pipeline. A frame's CSV record is written once all of its queries have been read back.
+     */
+    class FrameProfiler
+    {
+    public:
+
+        enum class Clock
+        {
+            Cpu,
+            Gpu
+        };
+
+        // Queries in flight per GPU series (frames that the GPU may lag behind before a pass goes untimed)
+        static const size_t query_ring_size = 4;
+
+        // Records that wait for their GPU timings any longer than this are written out without them
+        static const size_t max_pending_records = 64;
+
+        FrameProfiler() = default;
+
+        ~FrameProfiler()
+        {
+            for (auto& series : all_series)
+            {
+                if (series.clock == Clock::Gpu)
+                {
+                    glDeleteQueries(query_ring_size, series.queries);
+                }
+            }
+        }
+
+        FrameProfiler(const FrameProfiler& other) = delete;
+
+        FrameProfiler& operator=(const FrameProfiler& other) = delete;
+
+        /**
+         * Adds a timing called `name` and returns its index, which the other functions take. All series
+         * should be added before the first frame, since they make up the columns of the CSV file.
+         */
+        size_t add_series(const std::string& name, Clock clock)
+        {
+            Series series;
+            series.name = name;
+            series.clock = clock;
+            if (clock == Clock::Gpu)
+            {
+                glCreateQueries(GL_TIME_ELAPSED, query_ring_size, series.queries);
+            }
+            all_series.push_back(series);
+
+            return all_series.size() - 1;
+        }
+
+        /**
+         * Starts a new frame: reads back whichever GPU timings have become available since the last one, and
+         * writes out the records that are complete.
+         */
+        void begin_frame()
+        {
+            ++frame;
+
+            for (size_t i = 0; i < all_series.size(); ++i)
+            {
+                for (size_t slot = 0; slot < query_ring_size; ++slot)
+                {
+                    collect(i, slot);
+                }
+            }
+
+            records.push_back(Record{ frame, std::vector<double>(all_series.size(), std::numeric_limits<double>::quiet_NaN()), 0 });
+            flush();
+        }
+
+        /**
+         * Starts timing the GPU work of `series` (which must be a GPU series). Only one GPU series can be
+         * timed at a time, and each one at most once per frame.
+         */
+        void begin_gpu(size_t series)
+        {
+            Series& gpu = all_series[series];
+            timing = false;
+
+            // The oldest query in the ring is the next one to reuse, once its result has been read back
+            collect(series, gpu.next);
+            if (gpu.frames[gpu.next] != 0 || records.empty())
+            {
+                return;
+            }
+
+            glBeginQuery(GL_TIME_ELAPSED, gpu.queries[gpu.next]);
+            gpu.frames[gpu.next] = frame;
+            ++records.back().outstanding;
+            timing = true;
+        }
+
+        void end_gpu(size_t series)
+        {
+            if (!timing)
+            {
+                return;
+            }
+
+            glEndQuery(GL_TIME_ELAPSED);
+            Series& gpu = all_series[series];
+            gpu.next = (gpu.next + 1) % query_ring_size;
+            timing = false;
+        }
+
+        /**
+         * Records that the CPU work of `series` took `seconds` on this frame.
+         */
+        void add_cpu(size_t series, double seconds)
+        {
+            add(series, frame, seconds * 1000.0);
+        }
+
+        size_t get_series_count() const
+        {
+            return all_series.size();
+        }
+
+        const std::string& get_name(size_t series) const
+        {
+            return all_series[series].name;
+        }
+
+        const TimingHistory& get_history(size_t series) const
+        {
+            return all_series[series].history;
+        }
+
+        /**
+         * Writes a record of every frame from here on to the CSV file `filename` (one column per series, in
+         * milliseconds, empty when a series wasn't measured on that frame). Throws a `std::runtime_error` if
+         * the file can't be opened.
+         */
+        void start_recording(const std::string& filename)
+        {
+            csv.close();
+            csv.clear();
+            csv.open(filename, std::ios::trunc);
+            if (!csv)
+            {
+                throw std::runtime_error("Failed to open " + filename);
+            }
+
+            csv << "frame";
+            for (const auto& series : all_series)
+            {
+                csv << ',' << series.name;
+            }
+            csv << '\n';
+
+            first_recorded_frame = frame + 1;
+        }
+
+        void stop_recording()
+        {
+            csv.close();
+        }
+
+        bool is_recording() const
+        {
+            return csv.is_open();
+        }
+
+    private:
+
+        struct Series
+        {
+            std::string name;
+            Clock clock;
+            TimingHistory history;
+
+            // The ring of queries (GPU series only), along with the frame that each one was issued on
+            // (0 when it isn't in flight)
+            uint32_t queries[query_ring_size] = {};
+            uint64_t frames[query_ring_size] = {};
+            size_t next = 0;
+        };
+
+        struct Record
+        {
+            uint64_t frame;
+            std::vector<double> milliseconds;
+
+            // GPU timings of this frame that haven't been read back yet
+            size_t outstanding;
+        };
+
+        std::vector<Series> all_series;
+
+        // The frames that haven't been written out yet, oldest first (only the last one is still current)
+        std::deque<Record> records;
+
+        uint64_t frame = 0;
+        bool timing = false;
+
+        std::ofstream csv;
+        uint64_t first_recorded_frame = 0;
+
+        void add(size_t series, uint64_t record_frame, double milliseconds)
+        {
+            all_series[series].history.add(static_cast<float>(milliseconds));
+
+            for (auto& record : records)
+            {
+                if (record.frame == record_frame)
+                {
+                    record.milliseconds[series] = milliseconds;
+                    break;
+                }
+            }
+        }
+
+        /**
+         * Reads back query `slot` of `series`, if it is in flight and its result is available.
+         */
+        void collect(size_t series, size_t slot)
+        {
+            Series& gpu = all_series[series];
+            if (gpu.clock != Clock::Gpu || gpu.frames[slot] == 0)
+            {
+                return;
+            }
+
+            GLint available = GL_FALSE;
+            glGetQueryObjectiv(gpu.queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+            {
+                return;
+            }
+
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(gpu.queries[slot], GL_QUERY_RESULT, &nanoseconds);
+
+            const uint64_t query_frame = gpu.frames[slot];
+            gpu.frames[slot] = 0;
+            add(series, query_frame, nanoseconds / 1.0e6);
+
+            for (auto& record : records)
+            {
+                if (record.frame == query_frame)
+                {
+                    --record.outstanding;
+                    break;
+                }
+            }
+        }
+
+        /**
+         * Writes out (if recording) and drops the records of past frames whose timings are all in.
+         */
+        void flush()
+        {
+            while (records.size() > 1 && (records.front().outstanding == 0 || records.size() > max_pending_records))
+            {
+                const Record& record = records.front();
+                if (csv.is_open() && record.frame >= first_recorded_frame)
+                {
+                    csv << record.frame;
+                    for (const double milliseconds : record.milliseconds)
+                    {
+                        csv << ',';
+                        if (!std::isnan(milliseconds))
+                        {
+                            csv << milliseconds;
+                        }
+                    }
+                    csv << '\n';
+                }
+
+                records.pop_front();
+            }
+        }
+    };
+
+}
@@ -0,0 +1,332 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "glm.hpp"
+
+#include "sweep.h"
+#include "vertex.h"
+
+namespace hopf
+{
+
+    /**
+     * All of the settings that determine a fibration: the mapping mode, the per-mode settings,
+     * and the rotation that is applied to the base points on S2. Nothing in here depends on
+     * a window or an OpenGL context, so it can be filled in by the UI or by a headless tool.
+     */
+    struct Parameters
+    {
+        // Global settings
+        size_t number_of_fibers = 200;
+        size_t iterations_per_fiber = 300;
+        std::string mode = "Curl";
+
+        // Per-mode settings
+        uint32_t number_of_circles = 1;                             // For mode: "Great Circle"
+        std::vector<float> offsets = { 0.0f };                      // For mode: "Great Circle"
+        std::vector<float> arc_angles = { glm::two_pi<float>() };   // For mode: "Great Circle"
+        uint32_t seed = 0;                                          // For mode: "Random"
+        float mean = 0.0f;                                          // For mode: "Random"
+        float standard_deviation = 1.0f;                            // For mode: "Random"
+        float loxodrome_offset = 2.0f;                              // For mode: "Loxodrome"
+        float curl_alpha = 4.0f;                                    // For mode: "Curl"
+        float curl_beta = 0.5f;                                     // For mode: "Curl"
+
+        // Euler angles applied to the base points in every mode
+        float rotation_x = 0.0f;
+        float rotation_y = 0.0f;
+        float rotation_z = 0.0f;
+    };
+
+    /**
+     * The different implementations of the inner loop of `generate_fibration()`.
+     */
+    enum class SweepKernel
+    {
+        Reference,  // Scalar `atan2f`, `sinf`, `cosf` and `acosf` for every vertex
+        Vectorized, // Polynomial approximations, several vertices per instruction (see `sweep_kernel.h`)
+        PhaseTable  // Like `Vectorized`, but reads the cosine and sine of phi from a shared table (see `get_phase_table()`)
+    };
+
+    /**
+     * Settings that change how a fibration is generated, but not (beyond floating-point error) the result.
+     */
+    struct GeneratorSettings
+    {
+        // The number of threads that fibers are split across (0 means one per hardware thread)
+        size_t thread_count = 1;
+
+        SweepKernel kernel = SweepKernel::Reference;
+
+        // Only used by `SweepKernel::Vectorized` and `SweepKernel::PhaseTable`
+        SweepIsa isa = SweepIsa::Automatic;
+
+        // When set, the generators stop sweeping (leaving the output incomplete) as soon as this becomes
+        // `true`, so that a background job that has been superseded doesn't have to run to the end
+        const std::atomic<bool>* cancel = nullptr;
+    };
+
+    /**
+     * The maps from S3 into 3-space that fibers can be drawn with.
+     */
+    enum class Projection
+    {
+        Modified,       // Onto the unit ball, with distances along great circles through the pole preserved (the default)
+        Stereographic   // The classic stereographic projection from <0, 0, 0, 1> (unbounded)
+    };
+
+    /**
+     * A fibration in structure-of-arrays form: fiber `i` owns entries `[i * M, (i + 1) * M)` of
+     * `x`, `y` and `z` (where `M` is `iterations_per_fiber`) and entry `i` of `colors`.
+     */
+    struct FibrationSoA
+    {
+        size_t iterations_per_fiber = 0;
+        std::vector<float> x;
+        std::vector<float> y;
+        std::vector<float> z;
+        std::vector<glm::vec3> colors;
+    };
+
+    /**
+     * The cosine and sine of every angle that a fiber is sampled at. Every fiber is sampled at the
+     * same `iterations_per_fiber` angles, so this only has to be computed once per resolution.
+     */
+    struct PhaseTable
+    {
+        std::vector<float> cos_phi;
+        std::vector<float> sin_phi;
+    };
+
+    /**
+     * One level of a progressively refined fibration (see `refine_fibration()`): every `fiber_stride`-th
+     * fiber, sampled at every `sample_stride`-th angle of the full resolution. Every vertex of a coarse
+     * level is also a vertex of the finer levels, so refining only ever adds vertices.
+     */
+    struct RefinementLevel
+    {
+        size_t fiber_stride = 1;
+        size_t sample_stride = 1;
+    };
+
+    /**
+     * Returns the names of all of the supported mapping modes.
+     */
+    const std::vector<std::string>& get_modes();
+
+    /**
+     * Builds the rotation matrix (from the Euler angles in `parameters`) that is applied to
+     * the base points on S2.
+     */
+    glm::mat4 get_rotation_matrix(const Parameters& parameters);
+
+    /**
+     * Returns the unit quaternion (vector part in `xyz`, scalar part in `w`) that moves every fiber by
+     * the same rotation that `get_rotation_matrix()` applies to the base points: that is, if `q` lies
+     * on the fiber above `p`, then `r * q` lies on the fiber above `get_rotation_matrix(parameters) * p`.
+     */
+    glm::vec4 get_rotation_quaternion(const Parameters& parameters);
+
+    /**
+     * Projects the point `q` on S3 (with the coordinate that the projections treat as the pole in `w`)
+     * into 3-space. This is the same map that `hopf.vert` applies to S3 vertices.
+     */
+    glm::vec3 project_point(const glm::vec4& q, Projection projection = Projection::Modified);
+
+    const char* to_string(Projection projection);
+
+    std::vector<Vertex> calculate_base_points_great_circle(const Parameters& parameters, const glm::mat4& transform = glm::mat4{ 1.0f });
+
+    std::vector<Vertex> calculate_base_points_random(const Parameters& parameters, const glm::mat4& transform = glm::mat4{ 1.0f });
+
+    std::vector<Vertex> calculate_base_points_loxodrome(const Parameters& parameters, const glm::mat4& transform = glm::mat4{ 1.0f });
+
+    std::vector<Vertex> calculate_base_points_curl(const Parameters& parameters, const glm::mat4& transform = glm::mat4{ 1.0f });
+
+    /**
+     * Calculates the base points on S2 for the mode named by `parameters.mode`, rotated by
+     * the Euler angles in `parameters`. Throws a `std::runtime_error` if the mode is unknown.
+     */
+    std::vector<Vertex> get_base_points(const Parameters& parameters);
+
+    /**
+     * Returns the phase table for fibers with `iterations_per_fiber` vertices. The most recently
+     * requested table is cached (and can be shared between threads), so this is only expensive
+     * when the resolution changes.
+     */
+    std::shared_ptr<const PhaseTable> get_phase_table(size_t iterations_per_fiber);
+
+    /**
+     * Sweeps out one fiber (a great circle on S3, projected into 3-space) for each base point.
+     * Each fiber is `iterations_per_fiber` vertices long and is terminated by a primitive restart
+     * index in the returned index buffer.
+     *
+     * Fiber `i` always owns vertices `[i * M, (i + 1) * M)` and indices `[i * (M + 1), (i + 1) * (M + 1))`,
+     * where `M` is `iterations_per_fiber`, so the output is identical for any thread count.
+     */
+    graphics::MeshData generate_fibration(const std::vector<Vertex>& base_points, size_t iterations_per_fiber = 300, const GeneratorSettings& settings = {});
+
+    /**
+     * Like `generate_fibration()`, but writes into caller-provided storage (for example, a persistently
+     * mapped buffer), which must have room for `N * M` vertices and `N * (M + 1)` indices.
+     */
+    void generate_fibration(const std::vector<Vertex>& base_points, size_t iterations_per_fiber, const GeneratorSettings& settings, Vertex* vertices, uint32_t* indices);
+
+    /**
+     * Returns one vertex per sample of a fiber, with the cosine and sine of phi (from `get_phase_table()`)
+     * in `texture_coordinate`. Drawn once per base point (see `graphics::Mesh::draw_instanced()`), this
+     * lets the vertex shader sweep out every fiber from nothing but the base points.
+     */
+    std::vector<Vertex> get_fiber_template(size_t iterations_per_fiber);
+
+    /**
+     * Like `generate_fibration()`, but leaves every vertex on S3: the `x`, `y` and `z` coordinates of
+     * each point are stored in `position` and its `w` coordinate in `texture_coordinate.x`. Rotating
+     * and projecting is left to `project_fibration()` or the vertex shader, so these vertices never
+     * have to be regenerated when only the rotation or the projection changes.
+     */
+    graphics::MeshData generate_fibration_s3(const std::vector<Vertex>& base_points, size_t iterations_per_fiber = 300, const GeneratorSettings& settings = {});
+
+    /**
+     * Like `generate_fibration_s3()`, but writes into caller-provided storage (see `generate_fibration()`).
+     */
+    void generate_fibration_s3(const std::vector<Vertex>& base_points, size_t iterations_per_fiber, const GeneratorSettings& settings, Vertex* vertices, uint32_t* indices);
+
+    /**
+     * Picks a number of samples (between `min_samples` and `max_samples`) for each fiber of `base_points`,
+     * so that every fiber looks equally smooth after the modified stereographic projection: large, sharply
+     * curved fibers get more samples than small loops. The counts add up to at most `vertex_budget` (unless
+     * even `min_samples` per fiber doesn't fit).
+     */
+    std::vector<size_t> get_adaptive_sample_counts(const std::vector<Vertex>& base_points, size_t max_samples, size_t vertex_budget, size_t min_samples = 8);
+
+    /**
+     * Like `generate_fibration()` (or `generate_fibration_s3()`, if `s3_output` is set), but fiber `i` has
+     * `sample_counts[i]` vertices (see `get_adaptive_sample_counts()`). The fibers are still laid out one
+     * after another, each followed by a primitive restart index, so the output can be drawn and exported
+     * like any other fibration. A fiber with `M` samples is identical to its counterpart in a fibration
+     * with `M` iterations per fiber.
+     */
+    graphics::MeshData generate_adaptive_fibration(const std::vector<Vertex>& base_points, const std::vector<size_t>& sample_counts, const GeneratorSettings& settings = {}, bool s3_output = false);
+
+    /**
+     * Returns the levels that a fibration of `number_of_fibers` fibers (each `iterations_per_fiber` vertices
+     * long) is refined through, from coarse to full resolution: the coarsest keeps at least `coarse_fibers`
+     * fibers and `coarse_samples` samples per fiber, and each level after it halves both strides (until
+     * they reach 1). Small fibrations only have one level.
+     */
+    std::vector<RefinementLevel> get_refinement_levels(size_t number_of_fibers, size_t iterations_per_fiber, size_t coarse_fibers = 128, size_t coarse_samples = 32);
+
+    /**
+     * Sweeps the vertices of `level` that are not already part of `previous` (the level before it, from
+     * `get_refinement_levels()`, or `nullptr` for the first level) into `vertices`, which uses the
+     * full-resolution layout of `generate_fibration()` (or `generate_fibration_s3()`, if `s3_output` is set).
+     * After the last level, `vertices` is identical to the output of those functions.
+     */
+    void refine_fibration(const std::vector<Vertex>& base_points, size_t iterations_per_fiber, const RefinementLevel* previous, const RefinementLevel& level, const GeneratorSettings& settings, bool s3_output, Vertex* vertices);
+
+    /**
+     * Copies the vertices of `level` out of a full-resolution fibration (see `refine_fibration()`) into
+     * `output`, in the usual layout: fiber by fiber, with a primitive restart index after each fiber.
+     */
+    void gather_refinement_level(const std::vector<Vertex>& vertices, size_t number_of_fibers, size_t iterations_per_fiber, const RefinementLevel& level, graphics::MeshData& output);
+
+    /**
+     * Writes the indices that every fibration of `number_of_fibers` fibers (each `iterations_per_fiber`
+     * vertices long) shares: each fiber's vertices in order, followed by a primitive restart index.
+     */
+    void get_fibration_indices(size_t number_of_fibers, size_t iterations_per_fiber, uint32_t* indices);
+
+    /**
+     * Holds on to the most recently generated fibration, along with the base point that each of its fibers
+     * was swept from, so that regenerating it after only some of the base points have moved (for example,
+     * after editing a single great circle, or adding random points) only sweeps the fibers that changed.
+     */
+    class FiberCache
+    {
+    public:
+
+        /**
+         * Returns the number of fibers that `update()` would have to sweep (rather than re-use) for these arguments.
+         */
+        size_t count_misses(const std::vector<Vertex>& base_points, size_t iterations_per_fiber, const GeneratorSettings& settings, bool s3_output) const;
+
+        /**
+         * Brings the cached fibration up to date with `base_points`, exactly as `generate_fibration()` (or
+         * `generate_fibration_s3()`, if `s3_output` is set) would generate it, re-using every fiber whose base
+         * point and sample count match a cached fiber. Returns the ranges of vertices that differ from the
+         * previous contents. Fibers whose sweep is cancelled are dropped from the cache.
+         */
+        std::vector<graphics::VertexRange> update(const std::vector<Vertex>& base_points, size_t iterations_per_fiber, const GeneratorSettings& settings, bool s3_output);
+
+        /**
+         * Replaces the cached fibration with one that was generated elsewhere (for example, by `refine_fibration()`).
+         */
+        void assign(const std::vector<Vertex>& base_points, size_t iterations_per_fiber, const GeneratorSettings& settings, bool s3_output, const graphics::MeshData& generated);
+
+        void clear();
+
+        const graphics::MeshData& get_fibration() const
+        {
+            return fibration;
+        }
+
+    private:
+
+        // Cached fibers by base point, built on demand
+        struct Lookup
+        {
+            bool built = false;
+            std::unordered_map<glm::vec3, size_t> fibers;
+        };
+
+        size_t cached_iterations_per_fiber = 0;
+        bool cached_s3_output = false;
+        SweepKernel cached_kernel = SweepKernel::Reference;
+        SweepIsa cached_isa = SweepIsa::Automatic;
+
+        std::vector<glm::vec3> keys;    // The base point of each cached fiber
+        std::vector<bool> valid;        // Whether each cached fiber has been swept completely
+        graphics::MeshData fibration;
+
+        bool is_compatible(size_t iterations_per_fiber, const GeneratorSettings& settings, bool s3_output) const;
+
+        void reset(size_t iterations_per_fiber, const GeneratorSettings& settings, bool s3_output);
+
+        static constexpr size_t not_cached = static_cast<size_t>(-1);
+
+        /**
+         * Returns the index of the cached fiber above `point` (preferring `index`), or `not_cached` if there
+         * isn't one.
+         */
+        size_t find(const glm::vec3& point, size_t index, Lookup& lookup) const;
+    };
+
+    /**
+     * Rotates the S3 vertices produced by `generate_fibration_s3()` by the unit quaternion `rotation`
+     * (see `get_rotation_quaternion()`), projects them into 3-space and colors them by their
+     * (rotated) base point, exactly as the vertex shader does.
+     */
+    std::vector<Vertex> project_fibration(const std::vector<Vertex>& s3_vertices, const glm::vec4& rotation, Projection projection = Projection::Modified, const GeneratorSettings& settings = {});
+
+    /**
+     * Returns the fiber above each of `base_points` (rotated by the unit quaternion `rotation`, see
+     * `get_rotation_quaternion()`) as an exact circle: every fiber is a great circle on S3, and the
+     * stereographic projection maps those onto circles (or, for a fiber through the pole, a line through
+     * the origin). Only `Projection::Stereographic` has this property, so fibers that are drawn with the
+     * modified projection still have to be sampled.
+     */
+    std::vector<Circle> get_fiber_circles(const std::vector<Vertex>& base_points, const glm::vec4& rotation = glm::vec4{ 0.0f, 0.0f, 0.0f, 1.0f });
+
+    /**
+     * Like `generate_fibration()`, but writes positions to separate x, y and z arrays (the layout
+     * that the vectorized kernels work in) and stores one color per fiber.
+     */
+    FibrationSoA generate_fibration_soa(const std::vector<Vertex>& base_points, size_t iterations_per_fiber = 300, const GeneratorSettings& settings = {});
+
+}
@@ -1,5 +1,10 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
 #include <vector>
 
 #include "glad/glad.h"
@@ -10,23 +15,53 @@
 namespace graphics
 {
 
+    /**
+     * One (non-indexed) draw of an indirect multi-draw, in the layout that `glMultiDrawArraysIndirect()`
+     * reads from the draw indirect buffer (see `Mesh::set_draw_commands()`).
+     */
     struct DrawCommand
     {
-        uint32_t mode;              // Probably GL_TRIANGLES
-        uint32_t count;             // Number of elements to be rendered
-        uint32_t type;              // Probably GL_UNSIGNED_BYTE
-        uint32_t indices;           // A pointer to the location where the indices are stored
-        uint32_t base_vertex;       // A constant that should be added to each element of `indices` when choosing elements from the enabled vertex arrays
+        uint32_t count;             // Number of vertices to be rendered
+        uint32_t instance_count;    // Number of instances to be rendered (1 for a plain draw)
+        uint32_t first;             // The first vertex to be rendered
         uint32_t base_instance;     // The base instance for use in fetching instanced vertex attributes
     };
 
-    using MeshData = std::pair<std::vector<Vertex>, std::vector<uint32_t>>;
+    /**
+     * Writable pointers into the region of a streaming mesh that is being updated (see `Mesh::begin_update()`).
+     * Only one of `vertices` and `compact_vertices` is set, depending on the mesh's `VertexFormat`.
+     */
+    struct StreamRegion
+    {
+        Vertex* vertices;
+        uint32_t* indices;
+        CompactVertex* compact_vertices;
+    };
 
     class Mesh
     {
 
     public:
 
+        /**
+         * Creates an (initially empty) streaming mesh, whose vertices and indices live in persistently
+         * mapped buffers that are split into `frames` regions. Each update is written directly into the
+         * next region (see `begin_update()`) while the GPU may still be drawing from the previous ones,
+         * so frequent updates never re-allocate GPU storage or make extra CPU-side copies.
+         *
+         * With a compact `format`, vertices are quantized to 8 bytes as they are written (see `update()`),
+         * which cuts the memory and bandwidth that every pass over them takes by a factor of 4.
+         */
+        static Mesh streaming(size_t frames = 3, VertexFormat format = VertexFormat::Standard)
+        {
+            Mesh mesh;
+            mesh.format = format;
+            mesh.stream.fences.resize(std::max<size_t>(frames, 1), nullptr);
+            mesh.stream.versions.resize(mesh.stream.fences.size(), 0);
+
+            return mesh;
+        }
+
         static MeshData from_sphere(float radius, const glm::vec3& center, size_t u_divisions, size_t v_divisions)
         {
             std::vector<Vertex> vertices;
@@ -195,12 +230,37 @@ namespace graphics
             setup();
         }
 
+        /**
+         * Wraps buffers that were filled on the GPU (for example, by a compute shader), taking ownership
+         * of them. The vertex buffer must hold `vertex_count` tightly packed `Vertex`s. No CPU-side copy
+         * of the data is kept until `read_back()` is called.
+         */
+        Mesh(uint32_t external_vbo, size_t vertex_count, uint32_t external_ibo = 0, size_t index_count = 0) :
+            vbo{ external_vbo },
+            ibo{ external_ibo },
+            vertex_count{ vertex_count },
+            index_count{ index_count }
+        {
+            setup_vertex_array();
+        }
+
+        Mesh(Mesh&& other) noexcept
+        {
+            *this = std::move(other);
+        }
+
         ~Mesh()
         {
-            // RAII: clean-up OpenGL objects
+            // RAII: clean-up OpenGL objects (deleting a buffer also unmaps it)
+            for (GLsync fence : stream.fences)
+            {
+                glDeleteSync(fence);
+            }
             glDeleteVertexArrays(1, &vao);
             glDeleteBuffers(1, &vbo);
             glDeleteBuffers(1, &ibo);
+            glDeleteBuffers(1, &color_buffer);
+            glDeleteBuffers(1, &command_buffer);
         }
 
         Mesh& operator=(Mesh&& other) noexcept
@@ -209,9 +269,20 @@ namespace graphics
             std::swap(vao, other.vao);
             std::swap(vbo, other.vbo);
             std::swap(ibo, other.ibo);
+            std::swap(vertex_count, other.vertex_count);
+            std::swap(index_count, other.index_count);
+            std::swap(stream, other.stream);
+            std::swap(format, other.format);
+            std::swap(color_buffer, other.color_buffer);
+            std::swap(color_capacity, other.color_capacity);
+            std::swap(command_buffer, other.command_buffer);
+            std::swap(command_capacity, other.command_capacity);
 
             vertices = std::move(other.vertices);
             indices = std::move(other.indices);
+            fibers = std::move(other.fibers);
+            fiber_colors = std::move(other.fiber_colors);
+            commands = std::move(other.commands);
 
             return *this;
         }
@@ -220,25 +291,310 @@ namespace graphics
 
         void draw(uint32_t mode = GL_TRIANGLES) const
         {
+            if (vertex_count == 0)
+            {
+                return;
+            }
+
             glBindVertexArray(vao);
 
-            if (!indices.empty())
+            if (format == VertexFormat::Compact)
+            {
+                // The vertex shader looks up the color of each vertex by its fiber
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, color_buffer);
+            }
+
+            if (!commands.empty())
             {
-                glDrawElements(mode, indices.size(), GL_UNSIGNED_INT, 0);
+                // One draw per command, all in a single call
+                glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer);
+                glMultiDrawArraysIndirect(mode, nullptr, static_cast<GLsizei>(commands.size()), 0);
+                glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            }
+            else if (index_count != 0)
+            {
+                // Streaming meshes draw from the current region of the index buffer
+                const size_t index_offset = sizeof(uint32_t) * stream.index_capacity * stream.current;
+                glDrawElements(mode, index_count, GL_UNSIGNED_INT, reinterpret_cast<const void*>(index_offset));
             }
             else
             {
-                glDrawArrays(mode, 0, vertices.size());
+                glDrawArrays(mode, 0, vertex_count);
             }
 
             glBindVertexArray(0);
         }
 
+        /**
+         * Draws this mesh once for each vertex of `instances`: the position and color attributes are
+         * sourced (per-instance) from `instances`, while the texture coordinates are sourced (per-vertex)
+         * from this mesh. Indices are ignored. Note that this re-binds the position and color attributes
+         * of this mesh's VAO, so a mesh that is used as a template should only be drawn this way.
+         */
+        void draw_instanced(const Mesh& instances, uint32_t mode = GL_TRIANGLES) const
+        {
+            if (instances.vertex_count == 0)
+            {
+                return;
+            }
+
+            // The instance buffer may have been re-allocated (by `set_vertices()`) since the last draw
+            glVertexArrayVertexBuffer(vao, 1, instances.vbo, 0, sizeof(Vertex));
+            glVertexArrayBindingDivisor(vao, 1, 1);
+            glVertexArrayAttribBinding(vao, 0, 1);
+            glVertexArrayAttribBinding(vao, 1, 1);
+
+            glBindVertexArray(vao);
+            glDrawArraysInstanced(mode, 0, vertex_count, instances.vertex_count);
+            glBindVertexArray(0);
+        }
+
+        /**
+         * Returns the next region of a streaming mesh, with room for `new_vertex_count` vertices and
+         * `new_index_count` indices (growing the buffers if needed), once the GPU has finished drawing
+         * from it. The mesh keeps drawing its previous contents until `end_update()` is called.
+         */
+        StreamRegion begin_update(size_t new_vertex_count, size_t new_index_count)
+        {
+            if (new_vertex_count > stream.vertex_capacity || new_index_count > stream.index_capacity)
+            {
+                // Grow geometrically, so that a slider drag only re-allocates a handful of times
+                allocate_stream(std::max(new_vertex_count, stream.vertex_capacity * 3 / 2), std::max(new_index_count, stream.index_capacity * 3 / 2));
+            }
+
+            stream.writing = (stream.current + 1) % stream.fences.size();
+            stream.pending_vertex_count = new_vertex_count;
+            stream.pending_index_count = new_index_count;
+
+            // Wait for the GPU to finish with every draw that was issued while this region was current
+            GLsync& fence = stream.fences[stream.writing];
+            if (fence)
+            {
+                while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+                {
+                }
+                glDeleteSync(fence);
+                fence = nullptr;
+            }
+
+            const size_t vertex_offset = stream.vertex_capacity * stream.writing;
+            const bool compact = format != VertexFormat::Standard;
+
+            return StreamRegion{
+                compact ? nullptr : static_cast<Vertex*>(stream.vertices) + vertex_offset,
+                stream.indices + stream.index_capacity * stream.writing,
+                compact ? static_cast<CompactVertex*>(stream.vertices) + vertex_offset : nullptr
+            };
+        }
+
+        /**
+         * Makes the region that was returned by the last call to `begin_update()` the one that is drawn (with
+         * the indices that were written to it).
+         */
+        void end_update()
+        {
+            finish_update(StreamUpdate{ 0, true, {} });
+            commands.clear();
+        }
+
+        /**
+         * Replaces the contents of a streaming mesh with `new_vertices` and `new_indices`, in whichever
+         * format the mesh stores its vertices. For compact formats, positions must lie in the unit ball
+         * (or, on S3, the unit sphere), and the primitive restarts of `new_indices` separate the fibers:
+         * each fiber takes the color of its first vertex.
+         *
+         * If every primitive of `new_indices` is a consecutive run of vertices (as it is for every fibration),
+         * no indices are uploaded at all: the mesh is drawn with one indirect command per primitive instead
+         * (see `set_draw_commands()`).
+         */
+        void update(const std::vector<Vertex>& new_vertices, const std::vector<uint32_t>& new_indices)
+        {
+            if (format == VertexFormat::Compact)
+            {
+                assign_fibers(new_vertices, new_indices);
+            }
+
+            std::vector<DrawCommand> new_commands;
+            const bool index_free = get_draw_commands(new_indices, new_commands);
+
+            const auto region = begin_update(new_vertices.size(), index_free ? 0 : new_indices.size());
+            write_vertices(new_vertices, VertexRange{ 0, new_vertices.size() }, region);
+            if (!index_free)
+            {
+                std::copy(new_indices.begin(), new_indices.end(), region.indices);
+            }
+            end_update();
+
+            set_draw_commands(new_commands);
+        }
+
+        /**
+         * Draws this mesh with `glMultiDrawArraysIndirect()`, as one primitive per command (in place of its
+         * indices, if it has any), or as usual if `new_commands` is empty. Culling or re-ordering primitives
+         * is then just a matter of editing their commands.
+         */
+        void set_draw_commands(const std::vector<DrawCommand>& new_commands)
+        {
+            commands = new_commands;
+            if (commands.empty())
+            {
+                return;
+            }
+
+            if (commands.size() > command_capacity)
+            {
+                glDeleteBuffers(1, &command_buffer);
+
+                command_capacity = std::max(commands.size(), command_capacity * 3 / 2);
+                glCreateBuffers(1, &command_buffer);
+                glNamedBufferStorage(command_buffer, sizeof(DrawCommand) * command_capacity, nullptr, GL_DYNAMIC_STORAGE_BIT);
+            }
+            glNamedBufferSubData(command_buffer, 0, sizeof(DrawCommand) * commands.size(), commands.data());
+        }
+
+        /**
+         * Converts `indices` (primitives separated by primitive restarts) into one draw command per primitive,
+         * whose base instance is the primitive's number. Returns `false` if a primitive isn't a consecutive run
+         * of vertices, which a non-indexed draw can't express.
+         */
+        static bool get_draw_commands(const std::vector<uint32_t>& indices, std::vector<DrawCommand>& commands)
+        {
+            commands.clear();
+
+            for (size_t i = 0; i < indices.size(); ++i)
+            {
+                if (indices[i] == std::numeric_limits<uint32_t>::max())
+                {
+                    continue;
+                }
+
+                if (commands.empty() || indices[i - 1] == std::numeric_limits<uint32_t>::max())
+                {
+                    commands.push_back(DrawCommand{ 0, 1, indices[i], static_cast<uint32_t>(commands.size()) });
+                }
+                else if (indices[i] != indices[i - 1] + 1)
+                {
+                    commands.clear();
+                    return false;
+                }
+                ++commands.back().count;
+            }
+
+            return !commands.empty();
+        }
+
+        /**
+         * Returns the draw commands of `number_of_fibers` fibers of `vertices_per_fiber` vertices each, laid
+         * out one after the other (see `hopf::generate_fibration()`).
+         */
+        static std::vector<DrawCommand> get_fiber_draw_commands(size_t number_of_fibers, size_t vertices_per_fiber)
+        {
+            std::vector<DrawCommand> commands(number_of_fibers);
+            for (size_t i = 0; i < number_of_fibers; ++i)
+            {
+                commands[i] = DrawCommand{ static_cast<uint32_t>(vertices_per_fiber), 1, static_cast<uint32_t>(i * vertices_per_fiber), static_cast<uint32_t>(i) };
+            }
+
+            return commands;
+        }
+
+        /**
+         * Re-uploads only the vertices in `ranges`, given the complete (updated) vertex data, which must have
+         * as many vertices as the mesh already has: the indices and all other vertices stay as they are.
+         * Returns `false` (and does nothing) if the number of vertices differs, in which case the mesh has
+         * to be updated in full.
+         *
+         * On a streaming mesh, the region that is written was last current a few updates ago, so it also
+         * receives the ranges of every update that it missed in the meantime (or everything, if one of
+         * those was a full update).
+         */
+        bool update_vertices(const std::vector<Vertex>& updated_vertices, const std::vector<VertexRange>& ranges)
+        {
+            if (updated_vertices.size() != vertex_count || vertex_count == 0)
+            {
+                return false;
+            }
+
+            if (format == VertexFormat::Compact)
+            {
+                // Fibers that moved may have changed color
+                for (const auto& range : ranges)
+                {
+                    for (size_t i = range.first; i < range.first + range.count; ++i)
+                    {
+                        fiber_colors[fibers[i]] = glm::vec4{ updated_vertices[i].color, 1.0f };
+                    }
+                }
+                upload_fiber_colors();
+            }
+
+            if (!is_streaming())
+            {
+                const bool keep_copy = vertices.size() == vertex_count;
+
+                for (const auto& range : ranges)
+                {
+                    glNamedBufferSubData(vbo, sizeof(Vertex) * range.first, sizeof(Vertex) * range.count, &updated_vertices[range.first]);
+
+                    if (keep_copy)
+                    {
+                        std::copy_n(updated_vertices.begin() + range.first, range.count, vertices.begin() + range.first);
+                    }
+                }
+                return true;
+            }
+
+            const size_t previous = stream.current;
+            const auto region = begin_update(vertex_count, index_count);
+            const uint64_t region_version = stream.versions[stream.writing];
+
+            // The region needs every update since the one it holds: those are all in the history, unless
+            // it is so old that it predates them
+            bool full = stream.history.empty() || stream.history.front().version > region_version + 1;
+            std::vector<VertexRange> missed = ranges;
+            for (const auto& update : stream.history)
+            {
+                if (update.version > region_version)
+                {
+                    full |= update.full;
+                    missed.insert(missed.end(), update.ranges.begin(), update.ranges.end());
+                }
+            }
+
+            if (full)
+            {
+                write_vertices(updated_vertices, VertexRange{ 0, vertex_count }, region);
+
+                // The indices only depend on the layout, which hasn't changed since the current region was written
+                // (copied on the GPU, since reading from mapped memory can be slow)
+                if (previous != stream.writing && index_count != 0)
+                {
+                    glCopyNamedBufferSubData(ibo, ibo, sizeof(uint32_t) * stream.index_capacity * previous, sizeof(uint32_t) * stream.index_capacity * stream.writing, sizeof(uint32_t) * index_count);
+                }
+            }
+            else
+            {
+                for (const auto& range : missed)
+                {
+                    write_vertices(updated_vertices, range, region);
+                }
+            }
+
+            finish_update(StreamUpdate{ 0, false, ranges });
+
+            return true;
+        }
+
+        bool is_streaming() const
+        {
+            return !stream.fences.empty();
+        }
+
         void set_vertices(const std::vector<Vertex>& updated_vertices)
         {
             // Re-allocate the buffer if more space is needed: otherwise, we can simply copy in the new data because
             // we already have enough storage
-            if (vertices.size() < updated_vertices.size())
+            if (vertex_count < updated_vertices.size())
             {
                 // In DSA, if you need to re-allocate buffer memory, you basically have to reinitialize the 
                 // entire buffer, per: https://www.reddit.com/r/opengl/comments/aifvjl/glnamedbufferstorage_vs_glbufferdata/
@@ -252,12 +608,13 @@ namespace graphics
             {
                 glNamedBufferSubData(vbo, 0, sizeof(Vertex) * updated_vertices.size(), updated_vertices.data());
                 vertices = updated_vertices;
+                vertex_count = vertices.size();
             }
         }
 
         void set_indices(const std::vector<uint32_t>& updated_indices)
         {
-            if (indices.size() < updated_indices.size())
+            if (index_count < updated_indices.size())
             {
                 indices = updated_indices;
                 glDeleteVertexArrays(1, &vao);
@@ -267,19 +624,82 @@ namespace graphics
             }
             else
             {
-                glNamedBufferSubData(vbo, 0, sizeof(Vertex) * updated_indices.size(), updated_indices.data());
+                glNamedBufferSubData(ibo, 0, sizeof(uint32_t) * updated_indices.size(), updated_indices.data());
                 indices = updated_indices;
+                index_count = indices.size();
             }
         }
 
         size_t get_vertex_count() const
         {
-            return vertices.size();
+            return vertex_count;
         }
 
         size_t get_index_count() const
         {
-            return indices.size();
+            return index_count;
+        }
+
+        uint32_t get_vertex_buffer() const
+        {
+            return vbo;
+        }
+
+        VertexFormat get_format() const
+        {
+            return format;
+        }
+
+        /**
+         * Copies the contents of the GPU buffers back into the CPU-side vertices and indices (only
+         * needed for streaming meshes and meshes that wrap external buffers).
+         */
+        void read_back()
+        {
+            vertices.resize(vertex_count);
+            indices.resize(index_count);
+
+            // Meshes that are drawn with commands have no indices on the GPU, but the commands describe them
+            if (!commands.empty())
+            {
+                indices.clear();
+                for (const auto& command : commands)
+                {
+                    for (uint32_t i = 0; i < command.count; ++i)
+                    {
+                        indices.push_back(command.first + i);
+                    }
+                    indices.push_back(std::numeric_limits<uint32_t>::max());
+                }
+            }
+
+            if (is_streaming())
+            {
+                // Coherent mappings can be read directly (this is only slow, not unsafe)
+                if (format == VertexFormat::Standard)
+                {
+                    std::memcpy(vertices.data(), static_cast<const Vertex*>(stream.vertices) + stream.vertex_capacity * stream.current, sizeof(Vertex) * vertex_count);
+                }
+                else
+                {
+                    const CompactVertex* compact = static_cast<const CompactVertex*>(stream.vertices) + stream.vertex_capacity * stream.current;
+                    for (size_t i = 0; i < vertex_count; ++i)
+                    {
+                        vertices[i] = decompress(compact[i]);
+                    }
+                }
+                std::memcpy(indices.data(), stream.indices + stream.index_capacity * stream.current, sizeof(uint32_t) * index_count);
+                return;
+            }
+
+            if (vertex_count != 0)
+            {
+                glGetNamedBufferSubData(vbo, 0, sizeof(Vertex) * vertex_count, vertices.data());
+            }
+            if (index_count != 0 && commands.empty())
+            {
+                glGetNamedBufferSubData(ibo, 0, sizeof(uint32_t) * index_count, indices.data());
+            }
         }
 
         const std::vector<Vertex>& get_vertices() const
@@ -294,9 +714,221 @@ namespace graphics
 
     private:
 
-        uint32_t vao;
-        uint32_t vbo;
-        uint32_t ibo;
+        uint32_t vao = 0;
+        uint32_t vbo = 0;
+        uint32_t ibo = 0;
+        size_t vertex_count = 0;
+        size_t index_count = 0;
+        VertexFormat format = VertexFormat::Standard;
+
+        // For the compact format: the fiber that each vertex belongs to, and the color of each fiber (which
+        // is mirrored in `color_buffer`, a shader storage buffer with room for `color_capacity` colors)
+        std::vector<uint16_t> fibers;
+        std::vector<glm::vec4> fiber_colors;
+        uint32_t color_buffer = 0;
+        size_t color_capacity = 0;
+
+        // Set to draw with `glMultiDrawArraysIndirect()` (see `set_draw_commands()`): mirrored in `command_buffer`,
+        // which has room for `command_capacity` commands
+        std::vector<DrawCommand> commands;
+        uint32_t command_buffer = 0;
+        size_t command_capacity = 0;
+
+        // One update of a streaming mesh: either everything, or only some ranges of vertices
+        struct StreamUpdate
+        {
+            uint64_t version;
+            bool full;
+            std::vector<VertexRange> ranges;
+        };
+
+        // State of a streaming mesh (see `streaming()`), where the buffers are split into one region per fence
+        struct StreamState
+        {
+            size_t vertex_capacity = 0;     // Per region
+            size_t index_capacity = 0;      // Per region
+            size_t current = 0;             // The region that is drawn
+            size_t writing = 0;             // The region returned by `begin_update()`
+            size_t pending_vertex_count = 0;
+            size_t pending_index_count = 0;
+            void* vertices = nullptr;       // `Vertex`s or `CompactVertex`s, depending on the format
+            uint32_t* indices = nullptr;
+            std::vector<GLsync> fences;
+
+            // Every update gets the next version number, and each region remembers the version it holds
+            // (see `update_vertices()`), along with the most recent updates
+            uint64_t version = 0;
+            std::vector<uint64_t> versions;
+            std::vector<StreamUpdate> history;
+        };
+        StreamState stream;
+
+        /**
+         * Fences the outgoing region, makes the region being written the current one, and records `update`.
+         */
+        void finish_update(StreamUpdate update)
+        {
+            // Every draw that reads the outgoing region has been issued by now
+            stream.fences[stream.current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+            stream.current = stream.writing;
+            vertex_count = stream.pending_vertex_count;
+            index_count = stream.pending_index_count;
+
+            update.version = ++stream.version;
+            stream.versions[stream.current] = update.version;
+
+            // No region can be more than one trip around the ring behind
+            stream.history.push_back(std::move(update));
+            if (stream.history.size() > stream.fences.size())
+            {
+                stream.history.erase(stream.history.begin());
+            }
+
+            glVertexArrayVertexBuffer(vao, 0, vbo, get_vertex_size() * stream.vertex_capacity * stream.current, get_vertex_size());
+        }
+
+        size_t get_vertex_size() const
+        {
+            return format == VertexFormat::Standard ? sizeof(Vertex) : sizeof(CompactVertex);
+        }
+
+        static int16_t to_snorm16(float value)
+        {
+            return static_cast<int16_t>(std::lround(glm::clamp(value, -1.0f, 1.0f) * 32767.0f));
+        }
+
+        static float from_snorm16(int16_t value)
+        {
+            return std::max(value / 32767.0f, -1.0f);
+        }
+
+        /**
+         * Quantizes vertex `index` (see `CompactVertex`).
+         */
+        CompactVertex compress(const Vertex& vertex, size_t index) const
+        {
+            CompactVertex compact;
+            compact.position[0] = to_snorm16(vertex.position.x);
+            compact.position[1] = to_snorm16(vertex.position.y);
+            compact.position[2] = to_snorm16(vertex.position.z);
+            compact.fiber = format == VertexFormat::CompactS3 ? static_cast<uint16_t>(to_snorm16(vertex.texture_coordinate.x)) : fibers[index];
+
+            return compact;
+        }
+
+        Vertex decompress(const CompactVertex& compact) const
+        {
+            Vertex vertex;
+            vertex.position = glm::vec3{ from_snorm16(compact.position[0]), from_snorm16(compact.position[1]), from_snorm16(compact.position[2]) };
+            vertex.color = format == VertexFormat::Compact ? glm::vec3{ fiber_colors[compact.fiber] } : glm::vec3{ 0.0f };
+            vertex.texture_coordinate = glm::vec2{ format == VertexFormat::CompactS3 ? from_snorm16(static_cast<int16_t>(compact.fiber)) : 0.0f, 0.0f };
+
+            return vertex;
+        }
+
+        /**
+         * Writes the vertices in `range` of `source` into the same range of `region`, in this mesh's format.
+         */
+        void write_vertices(const std::vector<Vertex>& source, const VertexRange& range, const StreamRegion& region) const
+        {
+            if (format == VertexFormat::Standard)
+            {
+                std::copy_n(source.begin() + range.first, range.count, region.vertices + range.first);
+                return;
+            }
+
+            for (size_t i = range.first; i < range.first + range.count; ++i)
+            {
+                region.compact_vertices[i] = compress(source[i], i);
+            }
+        }
+
+        /**
+         * Numbers the fibers of a (compact) mesh in the order that `new_indices` visits them, and uploads
+         * their colors.
+         */
+        void assign_fibers(const std::vector<Vertex>& new_vertices, const std::vector<uint32_t>& new_indices)
+        {
+            fibers.assign(new_vertices.size(), 0);
+            fiber_colors.clear();
+
+            bool first_vertex = true;
+            for (const uint32_t index : new_indices)
+            {
+                if (index == std::numeric_limits<uint32_t>::max())
+                {
+                    first_vertex = true;
+                    continue;
+                }
+
+                if (first_vertex)
+                {
+                    if (fiber_colors.size() > std::numeric_limits<uint16_t>::max())
+                    {
+                        throw std::runtime_error("Too many fibers for a compact mesh");
+                    }
+                    fiber_colors.push_back(glm::vec4{ new_vertices[index].color, 1.0f });
+                    first_vertex = false;
+                }
+                fibers[index] = static_cast<uint16_t>(fiber_colors.size() - 1);
+            }
+
+            upload_fiber_colors();
+        }
+
+        void upload_fiber_colors()
+        {
+            if (fiber_colors.empty())
+            {
+                return;
+            }
+
+            if (fiber_colors.size() > color_capacity)
+            {
+                glDeleteBuffers(1, &color_buffer);
+
+                color_capacity = std::max(fiber_colors.size(), color_capacity * 3 / 2);
+                glCreateBuffers(1, &color_buffer);
+                glNamedBufferStorage(color_buffer, sizeof(glm::vec4) * color_capacity, nullptr, GL_DYNAMIC_STORAGE_BIT);
+            }
+            glNamedBufferSubData(color_buffer, 0, sizeof(glm::vec4) * fiber_colors.size(), fiber_colors.data());
+        }
+
+        void allocate_stream(size_t vertex_capacity, size_t index_capacity)
+        {
+            const size_t frames = stream.fences.size();
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+            // The old buffers can be deleted right away: the driver keeps them alive until the GPU is done with them
+            for (GLsync& fence : stream.fences)
+            {
+                glDeleteSync(fence);
+                fence = nullptr;
+            }
+            glDeleteVertexArrays(1, &vao);
+            glDeleteBuffers(1, &vbo);
+            glDeleteBuffers(1, &ibo);
+
+            // Zero-sized storage is an error
+            stream.vertex_capacity = std::max<size_t>(vertex_capacity, 1);
+            stream.index_capacity = std::max<size_t>(index_capacity, 1);
+            stream.current = 0;
+            std::fill(stream.versions.begin(), stream.versions.end(), 0);
+            stream.history.clear();
+            vertex_count = 0;
+            index_count = 0;
+
+            glCreateBuffers(1, &vbo);
+            glNamedBufferStorage(vbo, get_vertex_size() * stream.vertex_capacity * frames, nullptr, flags);
+            stream.vertices = glMapNamedBufferRange(vbo, 0, get_vertex_size() * stream.vertex_capacity * frames, flags);
+
+            glCreateBuffers(1, &ibo);
+            glNamedBufferStorage(ibo, sizeof(uint32_t) * stream.index_capacity * frames, nullptr, flags);
+            stream.indices = static_cast<uint32_t*>(glMapNamedBufferRange(ibo, 0, sizeof(uint32_t) * stream.index_capacity * frames, flags));
+
+            setup_vertex_array();
+        }
 
         // We shouldn't need to hold onto these CPU-side, but for convenience, we keep them here for now
         std::vector<Vertex> vertices;
@@ -327,10 +959,42 @@ namespace graphics
                 glNamedBufferStorage(ibo, sizeof(uint32_t) * indices.size(), &indices[0], GL_DYNAMIC_STORAGE_BIT);
             }
 
+            vertex_count = vertices.size();
+            index_count = indices.size();
+
+            setup_vertex_array();
+        }
+
+        void setup_vertex_array()
+        {
             // Set up the VAO and attributes
             glCreateVertexArrays(1, &vao);
 
-            if (vbo)
+            if (vbo && format != VertexFormat::Standard)
+            {
+                glVertexArrayVertexBuffer(vao, 0, vbo, 0, sizeof(CompactVertex));
+
+                // Attributes that aren't enabled read as 0 (the color is set per fiber, or on S3 computed in the
+                // vertex shader)
+                glEnableVertexArrayAttrib(vao, 0);
+                glVertexArrayAttribFormat(vao, 0, 3, GL_SHORT, GL_TRUE, offsetof(CompactVertex, position));
+                glVertexArrayAttribBinding(vao, 0, 0);
+
+                if (format == VertexFormat::CompactS3)
+                {
+                    // `w` goes where `generate_fibration_s3()` puts it: in the first texture coordinate
+                    glEnableVertexArrayAttrib(vao, 2);
+                    glVertexArrayAttribFormat(vao, 2, 1, GL_SHORT, GL_TRUE, offsetof(CompactVertex, fiber));
+                    glVertexArrayAttribBinding(vao, 2, 0);
+                }
+                else
+                {
+                    glEnableVertexArrayAttrib(vao, 3);
+                    glVertexArrayAttribIFormat(vao, 3, 1, GL_UNSIGNED_SHORT, offsetof(CompactVertex, fiber));
+                    glVertexArrayAttribBinding(vao, 3, 0);
+                }
+            }
+            else if (vbo)
             {
                 // All vertex attributes will be sourced from a single buffer
                 glVertexArrayVertexBuffer(vao, 0, vbo, 0, sizeof(Vertex));
@@ -351,9 +1015,6 @@ namespace graphics
             {
                 glVertexArrayElementBuffer(vao, ibo);
             }
-
-            // TODO: build draw command
-            // ...
         }
     };
 
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "glad/glad.h"
+
+namespace graphics
+{
+
+    /**
+     * The stages of a program, as pairs of a stage (`GL_VERTEX_SHADER`, say) and its GLSL source.
+     */
+    using ProgramSources = std::vector<std::pair<uint32_t, std::string>>;
+
+    /**
+     * Keeps linked programs on disk (see `glGetProgramBinary()`), one file per program in `directory`,
+     * so that later runs can skip compiling and linking. A program is looked up by a hash of its sources
+     * along with `GL_RENDERER` and `GL_VERSION`, since a binary is only ever valid for the driver that
+     * produced it. The driver may still reject a binary (after an update that didn't change the version
+     * string, for example), in which case `load()` fails and the program is compiled as usual, then saved
+     * over the stale file.
+     */
+    class ProgramCache
+    {
+    public:
+
+        struct Statistics
+        {
+            // Programs that were loaded from, compiled for (and saved to), or rejected by the driver from the cache
+            size_t loaded = 0;
+            size_t compiled = 0;
+            size_t rejected = 0;
+
+            // How long the loaded programs originally took to compile and link, minus how long loading them took
+            double seconds_saved = 0.0;
+        };
+
+        explicit ProgramCache(const std::string& directory) :
+            directory{ directory }
+        {
+#if defined(_WIN32)
+            _mkdir(directory.c_str());
+#else
+            mkdir(directory.c_str(), 0755);
+#endif
+
+            // Without any binary formats there is nothing to cache (the program is always compiled)
+            GLint format_count = 0;
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+            enabled = format_count > 0;
+
+            const char* renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+            const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+            driver = std::string{ renderer != nullptr ? renderer : "" } + '\n' + (version != nullptr ? version : "");
+        }
+
+        ProgramCache(const ProgramCache& other) = delete;
+
+        ProgramCache& operator=(const ProgramCache& other) = delete;
+
+        /**
+         * Tries to load the binary of the program built from `sources` into `program`. Returns `true` if it
+         * was found and the driver accepted it (leaving `program` linked).
+         */
+        bool load(uint32_t program, const ProgramSources& sources)
+        {
+            if (!enabled)
+            {
+                return false;
+            }
+
+            const auto start = std::chrono::steady_clock::now();
+            const uint64_t key = get_key(sources);
+
+            std::ifstream file{ get_filename(key), std::ios::binary };
+            if (!file)
+            {
+                return false;
+            }
+
+            Header header;
+            if (!file.read(reinterpret_cast<char*>(&header), sizeof(Header)) ||
+                std::memcmp(header.magic, magic, sizeof(header.magic)) != 0 ||
+                header.version != version ||
+                header.key != key)
+            {
+                return false;
+            }
+
+            // A truncated (or corrupt) file can't hold as many bytes as its header claims
+            const std::streamoff binary_offset = file.tellg();
+            file.seekg(0, std::ios::end);
+            const std::streamoff file_size = file.tellg();
+            file.seekg(binary_offset);
+            if (binary_offset < 0 || file_size < binary_offset || header.binary_size > static_cast<uint64_t>(file_size - binary_offset))
+            {
+                return false;
+            }
+
+            std::vector<char> binary(static_cast<size_t>(header.binary_size));
+            if (!file.read(binary.data(), binary.size()))
+            {
+                return false;
+            }
+
+            glProgramBinary(program, header.binary_format, binary.data(), static_cast<GLsizei>(binary.size()));
+
+            GLint success = GL_FALSE;
+            glGetProgramiv(program, GL_LINK_STATUS, &success);
+            if (!success)
+            {
+                ++statistics.rejected;
+                return false;
+            }
+
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            ++statistics.loaded;
+            statistics.seconds_saved += header.compile_seconds - elapsed.count();
+
+            return true;
+        }
+
+        /**
+         * Saves the binary of `program` (which was linked from `sources` in `compile_seconds`, with
+         * `GL_PROGRAM_BINARY_RETRIEVABLE_HINT` set). Failing to write the file only means that the program
+         * will be compiled again next time.
+         */
+        void save(uint32_t program, const ProgramSources& sources, double compile_seconds)
+        {
+            ++statistics.compiled;
+
+            if (!enabled)
+            {
+                return;
+            }
+
+            GLint binary_size = 0;
+            glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binary_size);
+            if (binary_size <= 0)
+            {
+                return;
+            }
+
+            Header header;
+            std::memcpy(header.magic, magic, sizeof(header.magic));
+            header.version = version;
+            header.key = get_key(sources);
+            header.compile_seconds = compile_seconds;
+
+            std::vector<char> binary(binary_size);
+            GLsizei length = 0;
+            GLenum binary_format = GL_NONE;
+            glGetProgramBinary(program, binary_size, &length, &binary_format, binary.data());
+            header.binary_format = binary_format;
+            header.binary_size = static_cast<uint64_t>(length);
+
+            // Write to a temporary file first, so that a process that starts at the same time never reads
+            // half a binary
+            const std::string filename = get_filename(header.key);
+            const std::string temporary = filename + ".tmp";
+            {
+                std::ofstream file{ temporary, std::ios::binary | std::ios::trunc };
+                file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+                file.write(binary.data(), length);
+                if (!file)
+                {
+                    return;
+                }
+            }
+
+            std::remove(filename.c_str());
+            std::rename(temporary.c_str(), filename.c_str());
+        }
+
+        const Statistics& get_statistics() const
+        {
+            return statistics;
+        }
+
+    private:
+
+        struct Header
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t binary_format;
+            uint64_t key;
+            double compile_seconds;
+            uint64_t binary_size;
+        };
+
+        static constexpr const char* magic = "HOPFPROG";
+        static const uint32_t version = 1;
+
+        std::string directory;
+        std::string driver;
+        bool enabled = false;
+        Statistics statistics;
+
+        uint64_t get_key(const ProgramSources& sources) const
+        {
+            // 64-bit FNV-1a over the driver, then each stage and its source
+            uint64_t hash = 14695981039346656037ull;
+            const auto append = [&](const void* data, size_t size)
+            {
+                const auto bytes = static_cast<const unsigned char*>(data);
+                for (size_t i = 0; i < size; ++i)
+                {
+                    hash = (hash ^ bytes[i]) * 1099511628211ull;
+                }
+            };
+
+            append(driver.data(), driver.size());
+            for (const auto& stage : sources)
+            {
+                const uint64_t size = stage.second.size();
+                append(&stage.first, sizeof(stage.first));
+                append(&size, sizeof(size));
+                append(stage.second.data(), stage.second.size());
+            }
+
+            return hash;
+        }
+
+        std::string get_filename(uint64_t key) const
+        {
+            char name[32];
+            std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+
+            return directory + "/" + name;
+        }
+    };
+
+}
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace graphics
+{
+
+    /**
+     * Everything that the output of a render pass depends on (matrices, settings, versions of meshes or of
+     * other passes), packed into a string of bytes. Values are compared by their bits, so a pass is only
+     * skipped when its inputs are exactly the same as the last time it was rendered.
+     */
+    class PassInputs
+    {
+    public:
+
+        template<typename T>
+        PassInputs& add(const T& value)
+        {
+            bytes.append(reinterpret_cast<const char*>(&value), sizeof(T));
+            return *this;
+        }
+
+        bool operator==(const PassInputs& other) const
+        {
+            return bytes == other.bytes;
+        }
+
+        bool operator!=(const PassInputs& other) const
+        {
+            return !(*this == other);
+        }
+
+    private:
+
+        std::string bytes;
+    };
+
+    /**
+     * Decides which render passes have to run on each frame. Every pass declares its inputs (see `PassInputs`)
+     * when it is about to run, and is skipped if they haven't changed since it last ran: a pass that renders
+     * into an offscreen target simply keeps its output until then. A pass that samples the output of another
+     * one lists that pass's version (see `get_version()`) among its inputs.
+     *
+     * The window can't keep its contents the same way, so the pass that renders to it is also forced to run
+     * while frames are requested (for example, to let the UI react to input events). Once a frame goes by in
+     * which no pass ran and no more frames are requested, the renderer is idle: the application can stop
+     * presenting frames and wait for the next event.
+     */
+    class Renderer
+    {
+    public:
+
+        /**
+         * How often a pass has run or been skipped, for display in the UI.
+         */
+        struct PassStatistics
+        {
+            std::string name;
+            size_t rendered = 0;
+            size_t skipped = 0;
+        };
+
+        // The UI takes a few frames to settle after an input event (hover highlights, widgets that react to a
+        // button release, and so on)
+        static const size_t frames_per_event = 3;
+
+        /**
+         * Starts a new frame, using up one of the requested frames (if there are any).
+         */
+        void begin_frame()
+        {
+            frame_requested = frames_requested != 0;
+            if (frame_requested)
+            {
+                --frames_requested;
+            }
+
+            passes_rendered = 0;
+        }
+
+        /**
+         * Returns `true` if the pass `name` has to run this frame: when `inputs` differ from the last time that
+         * it ran, after `invalidate()`, or when `force` is set. Otherwise, the pass is counted as skipped.
+         */
+        bool begin_pass(const std::string& name, const PassInputs& inputs, bool force = false)
+        {
+            Pass& pass = find(name);
+
+            if (!force && pass.valid && pass.inputs == inputs)
+            {
+                ++pass.statistics.skipped;
+                return false;
+            }
+
+            pass.inputs = inputs;
+            pass.valid = true;
+            ++pass.version;
+            ++pass.statistics.rendered;
+            ++passes_rendered;
+
+            return true;
+        }
+
+        /**
+         * Returns a number that changes every time the pass `name` runs (0 if it has never run).
+         */
+        uint64_t get_version(const std::string& name)
+        {
+            return find(name).version;
+        }
+
+        /**
+         * Makes every pass run on the next frame, whether its inputs changed or not.
+         */
+        void invalidate()
+        {
+            for (auto& pass : passes)
+            {
+                pass.valid = false;
+            }
+        }
+
+        /**
+         * Keeps frames coming for at least the next `count` frames (see `is_frame_requested()`).
+         */
+        void request_frames(size_t count = frames_per_event)
+        {
+            frames_requested = std::max(frames_requested, count);
+        }
+
+        /**
+         * Returns `true` if the current frame was requested, in which case the pass that renders to the window
+         * should be forced to run.
+         */
+        bool is_frame_requested() const
+        {
+            return frame_requested;
+        }
+
+        /**
+         * Returns `true` if nothing was rendered on the last frame and no more frames are requested, so that
+         * the next frame would look the same as the one on screen (unless some input changes first).
+         */
+        bool is_idle() const
+        {
+            return frames_requested == 0 && passes_rendered == 0;
+        }
+
+        std::vector<PassStatistics> get_statistics() const
+        {
+            std::vector<PassStatistics> statistics;
+            for (const auto& pass : passes)
+            {
+                statistics.push_back(pass.statistics);
+            }
+
+            return statistics;
+        }
+
+    private:
+
+        struct Pass
+        {
+            PassInputs inputs;
+            bool valid = false;
+            uint64_t version = 0;
+            PassStatistics statistics;
+        };
+
+        // In the order that they first ran in (there are only ever a handful)
+        std::vector<Pass> passes;
+
+        size_t frames_requested = frames_per_event;
+        bool frame_requested = false;
+        size_t passes_rendered = 0;
+
+        Pass& find(const std::string& name)
+        {
+            const auto it = std::find_if(passes.begin(), passes.end(), [&](const Pass& pass) { return pass.statistics.name == name; });
+            if (it != passes.end())
+            {
+                return *it;
+            }
+
+            passes.push_back(Pass{});
+            passes.back().statistics.name = name;
+
+            return passes.back();
+        }
+    };
+
+}
@@ -1,20 +1,24 @@
 #pragma once
 
+#include <chrono>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <string>
 #include <unordered_map>
 #include <memory>
+#include <vector>
 
 #include "glad/glad.h"
 
+#include "program_cache.h"
+
 namespace graphics
 {
 
     struct UniformEntry
     {
-        uint32_t location;
+        int32_t location;
         uint32_t count;
     };
 
@@ -22,21 +26,18 @@ namespace graphics
     {
     public:
 
-        Shader(const std::string& vert_path, const std::string& frag_path)
+        /**
+         * Compiles and links a program from a vertex and a fragment shader, or loads it from `cache` (if
+         * there is one) when it was linked from the same sources before.
+         */
+        Shader(const std::string& vert_path, const std::string& frag_path, ProgramCache* cache = nullptr)
         {
-            // Load the shader modules
-            uint32_t vert = compile_shader_module(vert_path, GL_VERTEX_SHADER);
-            uint32_t frag = compile_shader_module(frag_path, GL_FRAGMENT_SHADER);
-
-            // Create the shader program
-            program_id = glCreateProgram();
-            glAttachShader(program_id, vert);
-            glAttachShader(program_id, frag);
-            glLinkProgram(program_id);
-            check_compilation_errors(program_id, "program");
+            create_program({ { GL_VERTEX_SHADER, read_shader_file(vert_path) }, { GL_FRAGMENT_SHADER, read_shader_file(frag_path) } }, cache);
+        }
 
-            glDeleteShader(vert);
-            glDeleteShader(frag);
+        explicit Shader(const std::string& comp_path, ProgramCache* cache = nullptr)
+        {
+            create_program({ { GL_COMPUTE_SHADER, read_shader_file(comp_path) } }, cache);
         }
 
         ~Shader()
@@ -59,61 +60,109 @@ namespace graphics
             glBindTextureUnit(unit, texture_handle);
         }
 
+        /**
+         * Returns the location of the uniform `name` (or -1 if the program has no such active uniform, in
+         * which case setting it does nothing), as found when the program was linked. Programs that set a
+         * uniform on every frame should look it up once and use the setters that take a location.
+         */
+        int32_t get_uniform_location(const std::string& name) const
+        {
+            const auto it = uniforms.find(name);
+            return it != uniforms.end() ? it->second.location : -1;
+        }
+
         void uniform_bool(const std::string& name, bool value) const
         {
-            glUniform1i(glGetUniformLocation(program_id, name.c_str()), (int)value);
+            uniform_bool(get_uniform_location(name), value);
+        }
+        void uniform_bool(int32_t location, bool value) const
+        {
+            glProgramUniform1i(program_id, location, (int)value);
         }
 
         void uniform_int(const std::string& name, int value) const
         {
-            glUniform1i(glGetUniformLocation(program_id, name.c_str()), value);
+            uniform_int(get_uniform_location(name), value);
+        }
+        void uniform_int(int32_t location, int value) const
+        {
+            glProgramUniform1i(program_id, location, value);
+        }
+
+        void uniform_uint(const std::string& name, uint32_t value) const
+        {
+            uniform_uint(get_uniform_location(name), value);
+        }
+        void uniform_uint(int32_t location, uint32_t value) const
+        {
+            glProgramUniform1ui(program_id, location, value);
         }
 
         void uniform_float(const std::string& name, float value) const
         {
-            glUniform1f(glGetUniformLocation(program_id, name.c_str()), value);
+            uniform_float(get_uniform_location(name), value);
+        }
+        void uniform_float(int32_t location, float value) const
+        {
+            glProgramUniform1f(program_id, location, value);
         }
 
         void uniform_vec2(const std::string& name, const glm::vec2& value) const
         {
-            glUniform2fv(glGetUniformLocation(program_id, name.c_str()), 1, &value[0]);
+            uniform_vec2(get_uniform_location(name), value);
+        }
+        void uniform_vec2(int32_t location, const glm::vec2& value) const
+        {
+            glProgramUniform2fv(program_id, location, 1, &value[0]);
         }
         void uniform_vec2(const std::string& name, float x, float y) const
         {
-            glUniform2f(glGetUniformLocation(program_id, name.c_str()), x, y);
+            glProgramUniform2f(program_id, get_uniform_location(name), x, y);
         }
 
         void uniform_vec3(const std::string& name, const glm::vec3& value) const
         {
-            glUniform3fv(glGetUniformLocation(program_id, name.c_str()), 1, &value[0]);
+            uniform_vec3(get_uniform_location(name), value);
+        }
+        void uniform_vec3(int32_t location, const glm::vec3& value) const
+        {
+            glProgramUniform3fv(program_id, location, 1, &value[0]);
         }
         void uniform_vec3(const std::string& name, float x, float y, float z) const
         {
-            glUniform3f(glGetUniformLocation(program_id, name.c_str()), x, y, z);
+            glProgramUniform3f(program_id, get_uniform_location(name), x, y, z);
         }
 
         void uniform_vec4(const std::string& name, const glm::vec4& value) const
         {
-            glUniform4fv(glGetUniformLocation(program_id, name.c_str()), 1, &value[0]);
+            uniform_vec4(get_uniform_location(name), value);
+        }
+        void uniform_vec4(int32_t location, const glm::vec4& value) const
+        {
+            glProgramUniform4fv(program_id, location, 1, &value[0]);
         }
         void uniform_vec4(const std::string& name, float x, float y, float z, float w)
         {
-            glUniform4f(glGetUniformLocation(program_id, name.c_str()), x, y, z, w);
+            glProgramUniform4f(program_id, get_uniform_location(name), x, y, z, w);
         }
 
         void uniform_mat2(const std::string& name, const glm::mat2& mat) const
         {
-            glUniformMatrix2fv(glGetUniformLocation(program_id, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+            glProgramUniformMatrix2fv(program_id, get_uniform_location(name), 1, GL_FALSE, &mat[0][0]);
         }
 
         void uniform_mat3(const std::string& name, const glm::mat3& mat) const
         {
-            glUniformMatrix3fv(glGetUniformLocation(program_id, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+            glProgramUniformMatrix3fv(program_id, get_uniform_location(name), 1, GL_FALSE, &mat[0][0]);
         }
 
         void uniform_mat4(const std::string& name, const glm::mat4& mat) const
         {
-            glUniformMatrix4fv(glGetUniformLocation(program_id, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+            uniform_mat4(get_uniform_location(name), mat);
+        }
+        void uniform_mat4(int32_t location, const glm::mat4& mat) const
+        {
+            glProgramUniformMatrix4fv(program_id, location, 1, GL_FALSE, &mat[0][0]);
         }
 
     private:
@@ -121,7 +170,57 @@ namespace graphics
         uint32_t program_id;
         std::unordered_map<std::string, UniformEntry> uniforms;
 
-        uint32_t compile_shader_module(const std::string& path, uint32_t type)
+        void create_program(const ProgramSources& sources, ProgramCache* cache)
+        {
+            const auto start = std::chrono::steady_clock::now();
+
+            program_id = glCreateProgram();
+            if (cache != nullptr)
+            {
+                if (cache->load(program_id, sources))
+                {
+                    perform_reflection();
+                    return;
+                }
+
+                // Start over with a fresh program, in case the driver rejected the cached binary
+                glDeleteProgram(program_id);
+                program_id = glCreateProgram();
+                glProgramParameteri(program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+            }
+
+            // Load the shader modules
+            std::vector<uint32_t> modules;
+            for (const auto& stage : sources)
+            {
+                modules.push_back(compile_shader_module(stage.second, stage.first));
+                glAttachShader(program_id, modules.back());
+            }
+
+            // Create the shader program
+            glLinkProgram(program_id);
+            check_compilation_errors(program_id, "program");
+            perform_reflection();
+
+            for (const auto module : modules)
+            {
+                glDeleteShader(module);
+            }
+
+            if (cache != nullptr)
+            {
+                const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                cache->save(program_id, sources, elapsed.count());
+            }
+        }
+
+        /**
+         * Reads the shader at `path`, with every `#include "name"` line replaced by the file `name` (next to
+         * `path`), so that shaders can share uniforms and functions without copying them. `#line` directives
+         * keep the line numbers in compilation errors pointing into the right file (source string 0 for the
+         * shader itself, 1 for what it includes).
+         */
+        std::string read_shader_file(const std::string& path)
         {
             std::string code;
             std::ifstream file;
@@ -146,12 +245,40 @@ namespace graphics
                 std::cerr << "Shader file not successfully read\n";
             }
 
+            const std::string directive = "#include \"";
+            const size_t separator = path.find_last_of("/\\");
+            const std::string directory = separator == std::string::npos ? "" : path.substr(0, separator + 1);
+
+            std::istringstream lines{ code };
+            std::string expanded;
+            std::string line;
+            size_t line_number = 0;
+            while (std::getline(lines, line))
+            {
+                ++line_number;
+
+                if (line.compare(0, directive.size(), directive) == 0)
+                {
+                    const std::string name = line.substr(directive.size(), line.find('"', directive.size()) - directive.size());
+                    expanded += "#line 1 1\n" + read_shader_file(directory + name) + "\n#line " + std::to_string(line_number + 1) + " 0\n";
+                }
+                else
+                {
+                    expanded += line + "\n";
+                }
+            }
+
+            return expanded;
+        }
+
+        uint32_t compile_shader_module(const std::string& code, uint32_t type)
+        {
             const char* shader_code = code.c_str();
 
             uint32_t shader_module = glCreateShader(type);
             glShaderSource(shader_module, 1, &shader_code, NULL);
             glCompileShader(shader_module);
-            check_compilation_errors(shader_module, type == GL_VERTEX_SHADER ? "vertex" : "fragment");
+            check_compilation_errors(shader_module, type == GL_VERTEX_SHADER ? "vertex" : type == GL_COMPUTE_SHADER ? "compute" : "fragment");
 
             return shader_module;
         }
@@ -183,6 +310,11 @@ namespace graphics
             }
         }
 
+        /**
+         * Fills `uniforms` with every active uniform of the (linked) program. Members of uniform blocks
+         * have no location, so they are left out: they are set through a buffer instead (see
+         * `UniformBuffer`). Arrays are found both by their own name and by the name of their first element.
+         */
         void perform_reflection()
         {
             GLint uniform_count = 0;
@@ -196,11 +328,9 @@ namespace graphics
                 GLenum type = GL_NONE;
                 glGetProgramiv(program_id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_name_len);
 
-                auto uniform_name = std::make_unique<char[]>(max_name_len);
-
-                std::unordered_map<std::string, UniformEntry> uniforms;
+                std::unique_ptr<char[]> uniform_name{ new char[max_name_len] };
 
-                for (size_t i = 0; i < uniform_count; ++i)
+                for (GLint i = 0; i < uniform_count; ++i)
                 {
                     glGetActiveUniform(program_id, i, max_name_len, &length, &count, &type, uniform_name.get());
 
@@ -208,7 +338,19 @@ namespace graphics
                     uniform_info.location = glGetUniformLocation(program_id, uniform_name.get());
                     uniform_info.count = count;
 
-                    uniforms.emplace(std::make_pair(std::string(uniform_name.get(), length), uniform_info));
+                    if (uniform_info.location == -1)
+                    {
+                        continue;
+                    }
+
+                    std::string name{ uniform_name.get(), static_cast<size_t>(length) };
+                    uniforms.emplace(name, uniform_info);
+
+                    const std::string array_suffix = "[0]";
+                    if (name.size() > array_suffix.size() && name.compare(name.size() - array_suffix.size(), array_suffix.size(), array_suffix) == 0)
+                    {
+                        uniforms.emplace(name.substr(0, name.size() - array_suffix.size()), uniform_info);
+                    }
                 }
             }
         }
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "glad/glad.h"
+
+#include "shader.h"
+
+namespace graphics
+{
+
+    /**
+     * How shadows are filtered (must match `u_shadow_technique` in `shaders/hopf.frag`).
+     */
+    enum class ShadowTechnique
+    {
+        // 7x7 depth comparisons per fragment, done by hand
+        Pcf,
+
+        // 3x3 comparisons per fragment, each of which the texture unit does on (and blends between) 4 texels
+        HardwarePcf,
+
+        // A single lookup into a blurred map of the first two moments of depth (rendered at half resolution)
+        Variance
+    };
+
+    inline const char* to_string(ShadowTechnique technique)
+    {
+        switch (technique)
+        {
+        case ShadowTechnique::Pcf: return "PCF (7x7)";
+        case ShadowTechnique::HardwarePcf: return "Hardware PCF (3x3)";
+        case ShadowTechnique::Variance: return "Variance";
+        }
+
+        return "";
+    }
+
+    /**
+     * The offscreen targets that the scene is rendered into from the point of view of the light. The
+     * PCF techniques render into a depth texture, which `bind()` exposes both as a plain texture and,
+     * through a separate sampler object, as a depth texture with comparisons enabled. Variance shadow
+     * mapping instead renders the moments of depth into a color texture at half the resolution (see
+     * `shaders/depth.frag`), which `end()` then blurs with a separable compute shader (see
+     * `shaders/blur.comp`).
+     */
+    class ShadowMap
+    {
+    public:
+
+        ShadowMap(uint32_t width, uint32_t height, const std::string& blur_path, ProgramCache* cache = nullptr) :
+            width{ width },
+            height{ height },
+            moment_width{ std::max(width / 2, 1u) },
+            moment_height{ std::max(height / 2, 1u) },
+            blur{ blur_path, cache },
+            location_vertical{ blur.get_uniform_location("u_vertical") }
+        {
+            const float border[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+            // The depth map (for both PCF techniques)
+            glCreateTextures(GL_TEXTURE_2D, 1, &depth_texture);
+            glTextureStorage2D(depth_texture, 1, GL_DEPTH_COMPONENT32F, width, height);
+            glTextureParameteri(depth_texture, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTextureParameteri(depth_texture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTextureParameteri(depth_texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+            glTextureParameteri(depth_texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+            glTextureParameterfv(depth_texture, GL_TEXTURE_BORDER_COLOR, border);
+
+            glCreateFramebuffers(1, &depth_framebuffer);
+            glNamedFramebufferTexture(depth_framebuffer, GL_DEPTH_ATTACHMENT, depth_texture, 0);
+            glNamedFramebufferDrawBuffer(depth_framebuffer, GL_NONE);
+            glNamedFramebufferReadBuffer(depth_framebuffer, GL_NONE);
+            check_framebuffer(depth_framebuffer);
+
+            // Sampling the depth map through this sampler returns the (bilinearly filtered) result of comparing
+            // the 4 nearest texels against a reference depth
+            glCreateSamplers(1, &comparison_sampler);
+            glSamplerParameteri(comparison_sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glSamplerParameteri(comparison_sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glSamplerParameteri(comparison_sampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+            glSamplerParameteri(comparison_sampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+            glSamplerParameterfv(comparison_sampler, GL_TEXTURE_BORDER_COLOR, border);
+            glSamplerParameteri(comparison_sampler, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+            glSamplerParameteri(comparison_sampler, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+            // The moment map (for variance shadow mapping), along with a second texture to blur through
+            for (auto texture : { &moment_texture, &blur_texture })
+            {
+                glCreateTextures(GL_TEXTURE_2D, 1, texture);
+                glTextureStorage2D(*texture, 1, GL_RG32F, moment_width, moment_height);
+                glTextureParameteri(*texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTextureParameteri(*texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                glTextureParameteri(*texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+                glTextureParameteri(*texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+                glTextureParameterfv(*texture, GL_TEXTURE_BORDER_COLOR, border);
+            }
+
+            glCreateRenderbuffers(1, &moment_renderbuffer);
+            glNamedRenderbufferStorage(moment_renderbuffer, GL_DEPTH_COMPONENT32F, moment_width, moment_height);
+
+            glCreateFramebuffers(1, &moment_framebuffer);
+            glNamedFramebufferTexture(moment_framebuffer, GL_COLOR_ATTACHMENT0, moment_texture, 0);
+            glNamedFramebufferRenderbuffer(moment_framebuffer, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, moment_renderbuffer);
+            check_framebuffer(moment_framebuffer);
+        }
+
+        ~ShadowMap()
+        {
+            glDeleteFramebuffers(1, &depth_framebuffer);
+            glDeleteFramebuffers(1, &moment_framebuffer);
+            glDeleteRenderbuffers(1, &moment_renderbuffer);
+            glDeleteSamplers(1, &comparison_sampler);
+            glDeleteTextures(1, &depth_texture);
+            glDeleteTextures(1, &moment_texture);
+            glDeleteTextures(1, &blur_texture);
+        }
+
+        ShadowMap(const ShadowMap& other) = delete;
+
+        ShadowMap& operator=(const ShadowMap& other) = delete;
+
+        /**
+         * Binds and clears the target that `technique` renders into (and sets the viewport to its size).
+         * Everything drawn until `end()` casts shadows.
+         */
+        void begin(ShadowTechnique technique)
+        {
+            if (technique == ShadowTechnique::Variance)
+            {
+                glViewport(0, 0, moment_width, moment_height);
+                glBindFramebuffer(GL_FRAMEBUFFER, moment_framebuffer);
+
+                // Nothing is in shadow where nothing was drawn
+                const float clear_moments[] = { 1.0f, 1.0f, 0.0f, 0.0f };
+                glClearNamedFramebufferfv(moment_framebuffer, GL_COLOR, 0, clear_moments);
+            }
+            else
+            {
+                glViewport(0, 0, width, height);
+                glBindFramebuffer(GL_FRAMEBUFFER, depth_framebuffer);
+            }
+
+            const float clear_depth_value = 1.0f;
+            glClearNamedFramebufferfv(technique == ShadowTechnique::Variance ? moment_framebuffer : depth_framebuffer, GL_DEPTH, 0, &clear_depth_value);
+        }
+
+        /**
+         * Unbinds the target again, after blurring the moment map (for variance shadow mapping).
+         */
+        void end(ShadowTechnique technique)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+            if (technique == ShadowTechnique::Variance)
+            {
+                // Horizontally into the second texture, then vertically back into the moment map
+                blur_moments(moment_texture, blur_texture, false);
+                blur_moments(blur_texture, moment_texture, true);
+
+                glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+            }
+        }
+
+        /**
+         * Binds the depth map to texture unit 0 (as is) and 1 (with comparisons enabled), and the moment
+         * map to texture unit 2 (see `shaders/hopf.frag`).
+         */
+        void bind() const
+        {
+            glBindTextureUnit(0, depth_texture);
+            glBindSampler(0, 0);
+
+            glBindTextureUnit(1, depth_texture);
+            glBindSampler(1, comparison_sampler);
+
+            glBindTextureUnit(2, moment_texture);
+            glBindSampler(2, 0);
+        }
+
+    private:
+
+        // Must match `local_size_x` and `local_size_y` in the compute shader
+        static const uint32_t local_size = 16;
+
+        uint32_t width;
+        uint32_t height;
+        uint32_t moment_width;
+        uint32_t moment_height;
+
+        uint32_t depth_framebuffer = 0;
+        uint32_t depth_texture = 0;
+        uint32_t comparison_sampler = 0;
+
+        uint32_t moment_framebuffer = 0;
+        uint32_t moment_renderbuffer = 0;
+        uint32_t moment_texture = 0;
+        uint32_t blur_texture = 0;
+
+        Shader blur;
+        int32_t location_vertical;
+
+        static void check_framebuffer(uint32_t framebuffer)
+        {
+            if (glCheckNamedFramebufferStatus(framebuffer, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            {
+                throw std::runtime_error("Shadow map framebuffer is not complete");
+            }
+        }
+
+        void blur_moments(uint32_t source, uint32_t destination, bool vertical)
+        {
+            // Make the previous writes (whether by rendering or by the last blur) visible to image loads
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+
+            glBindImageTexture(0, source, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RG32F);
+            glBindImageTexture(1, destination, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG32F);
+
+            blur.use();
+            blur.uniform_bool(location_vertical, vertical);
+            glDispatchCompute((moment_width + local_size - 1) / local_size, (moment_height + local_size - 1) / local_size, 1);
+        }
+    };
+
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+
+namespace hopf
+{
+
+    /**
+     * Instruction sets that the vectorized fiber sweep has been compiled for.
+     */
+    enum class SweepIsa
+    {
+        Automatic,  // Pick the widest instruction set supported by the CPU at runtime
+        Scalar,     // Portable fallback: one phi sample at a time
+        Sse41,      // 4 phi samples per instruction
+        Avx2,       // 8 phi samples per instruction (uses FMA)
+        Avx512      // 16 phi samples per instruction (uses FMA)
+    };
+
+    /**
+     * Sweeps out `count` points of the fiber above the base point `<a, b, c>` on S2, one for
+     * each angle in `phis`, and writes the projected positions to the structure-of-arrays
+     * buffers `xs`, `ys` and `zs` (each of which must hold `count` floats).
+     */
+    using SweepFunction = void (*)(float a, float b, float c, const float* phis, size_t count, float* xs, float* ys, float* zs);
+
+    /**
+     * Like `SweepFunction`, but takes the cosine and sine of each angle (from a table that can be
+     * shared by every fiber) instead of the angles themselves, and does no trigonometry per sample.
+     */
+    using TableSweepFunction = void (*)(float a, float b, float c, const float* cos_phis, const float* sin_phis, size_t count, float* xs, float* ys, float* zs);
+
+    /**
+     * Returns the widest instruction set that both the CPU and this build support.
+     */
+    SweepIsa detect_sweep_isa();
+
+    /**
+     * Returns the vectorized sweep for `isa` (or for `detect_sweep_isa()`, if `isa` is `Automatic`).
+     * Throws a `std::runtime_error` if the requested instruction set is not available.
+     */
+    SweepFunction get_sweep_function(SweepIsa isa = SweepIsa::Automatic);
+
+    /**
+     * Returns the table-driven sweep for `isa` (see `get_sweep_function()`).
+     */
+    TableSweepFunction get_table_sweep_function(SweepIsa isa = SweepIsa::Automatic);
+
+    const char* to_string(SweepIsa isa);
+
+    // Per-instruction set entry points (see `sweep_kernel.h`)
+    void sweep_fiber_scalar(float a, float b, float c, const float* phis, size_t count, float* xs, float* ys, float* zs);
+    void sweep_fiber_sse41(float a, float b, float c, const float* phis, size_t count, float* xs, float* ys, float* zs);
+    void sweep_fiber_avx2(float a, float b, float c, const float* phis, size_t count, float* xs, float* ys, float* zs);
+    void sweep_fiber_avx512(float a, float b, float c, const float* phis, size_t count, float* xs, float* ys, float* zs);
+
+    void sweep_fiber_table_scalar(float a, float b, float c, const float* cos_phis, const float* sin_phis, size_t count, float* xs, float* ys, float* zs);
+    void sweep_fiber_table_sse41(float a, float b, float c, const float* cos_phis, const float* sin_phis, size_t count, float* xs, float* ys, float* zs);
+    void sweep_fiber_table_avx2(float a, float b, float c, const float* cos_phis, const float* sin_phis, size_t count, float* xs, float* ys, float* zs);
+    void sweep_fiber_table_avx512(float a, float b, float c, const float* cos_phis, const float* sin_phis, size_t count, float* xs, float* ys, float* zs);
+
+}
@@ -0,0 +1,277 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+/**
+ * The vectorized fiber sweep, written once against a small set of SIMD operations (`Ops`) and
+ * instantiated once per instruction set (see `sweep_*.cpp`). Each `Ops` provides:
+ *
+ *     type, mask, width
+ *     set1, load, store, add, sub, mul, div, fmadd (a * b + c), sqrt, abs, neg, round, floor
+ *     gt (a > b, as a mask), select (mask ? a : b)
+ *
+ * All transcendental functions are evaluated with polynomials so that every lane does the
+ * same, branch-free work. Measured maximum errors against double precision (for single-precision
+ * inputs):
+ *
+ *     sincos:                  x in [-3 * pi, 3 * pi]    9.3e-8 (absolute)
+ *     modified_projection:     w in [-0.999, 1]          3.0e-7 (relative; `acosf` / `sqrtf` give 2.6e-7)
+ *
+ * The projected fiber points match the reference (`acosf`, `sinf`, ...) path to within the same
+ * error, which is dominated by points with w close to -1, where the projection itself is badly
+ * conditioned: run `hopf-gen --accuracy-report` to compare both paths for a given scene.
+ */
+namespace hopf
+{
+
+    namespace kernel
+    {
+
+        /**
+         * Computes the sine and cosine of `x` (accurate for |x| up to a few thousand radians).
+         */
+        template<typename Ops>
+        inline void sincos(typename Ops::type x, typename Ops::type& sin_x, typename Ops::type& cos_x)
+        {
+            using V = typename Ops::type;
+
+            // Range reduction: x = q * pi / 2 + r, with |r| <= pi / 4 (pi / 2 is split into three
+            // parts so that `q * part` is exact for any reasonable `q`)
+            const V q = Ops::round(Ops::mul(x, Ops::set1(0.636619772367581343f)));
+            V r = Ops::fmadd(q, Ops::set1(-1.5703125f), x);
+            r = Ops::fmadd(q, Ops::set1(-4.837512969970703125e-4f), r);
+            r = Ops::fmadd(q, Ops::set1(-7.549789948768648e-8f), r);
+
+            // Minimax polynomials on [-pi / 4, pi / 4] (coefficients from Cephes)
+            const V z = Ops::mul(r, r);
+
+            V sin_r = Ops::fmadd(z, Ops::set1(-1.9515295891e-4f), Ops::set1(8.3321608736e-3f));
+            sin_r = Ops::fmadd(sin_r, z, Ops::set1(-1.6666654611e-1f));
+            sin_r = Ops::fmadd(Ops::mul(sin_r, z), r, r);
+
+            V cos_r = Ops::fmadd(z, Ops::set1(2.443315711809948e-5f), Ops::set1(-1.388731625493765e-3f));
+            cos_r = Ops::fmadd(cos_r, z, Ops::set1(4.166664568298827e-2f));
+            cos_r = Ops::fmadd(Ops::mul(cos_r, z), z, Ops::fmadd(z, Ops::set1(-0.5f), Ops::set1(1.0f)));
+
+            // Quadrant `k = q mod 4` decides which polynomial to use and the signs of the results
+            const V k = Ops::sub(q, Ops::mul(Ops::set1(4.0f), Ops::floor(Ops::mul(q, Ops::set1(0.25f)))));
+            const V k_parity = Ops::sub(k, Ops::mul(Ops::set1(2.0f), Ops::floor(Ops::mul(k, Ops::set1(0.5f)))));
+            const V k_next = Ops::add(k, Ops::set1(1.0f));
+
+            const auto swap = Ops::gt(k_parity, Ops::set1(0.5f));
+            const auto sin_negative = Ops::gt(k, Ops::set1(1.5f));
+            const auto cos_negative = Ops::gt(Ops::select(Ops::gt(k_next, Ops::set1(3.5f)), Ops::set1(0.0f), k_next), Ops::set1(1.5f));
+
+            const V s = Ops::select(swap, cos_r, sin_r);
+            const V c = Ops::select(swap, sin_r, cos_r);
+
+            sin_x = Ops::select(sin_negative, Ops::neg(s), s);
+            cos_x = Ops::select(cos_negative, Ops::neg(c), c);
+        }
+
+        /**
+         * Computes `acos(w) / (pi * sqrt(1 - w^2))`, the scale factor of the modified stereographic
+         * projection. The quotient is rewritten per range so that it never divides zero by zero
+         * (the result approaches `1 / pi` as `w` approaches 1).
+         */
+        template<typename Ops>
+        inline typename Ops::type modified_projection(typename Ops::type w)
+        {
+            using V = typename Ops::type;
+
+            const V one = Ops::set1(1.0f);
+            const V pi = Ops::set1(3.14159265358979323846f);
+
+            // asin(t) = t * (1 + z * P(z)) with z = t^2 and t in [0, 0.5] (coefficients from Cephes),
+            // where t = |w| in the middle range and t = sqrt((1 - |w|) / 2) otherwise
+            const V u = Ops::abs(w);
+            const auto outer = Ops::gt(u, Ops::set1(0.5f));
+            const V z = Ops::select(outer, Ops::mul(Ops::set1(0.5f), Ops::sub(one, u)), Ops::mul(w, w));
+
+            V p = Ops::fmadd(z, Ops::set1(4.2163199048e-2f), Ops::set1(2.4181311049e-2f));
+            p = Ops::fmadd(p, z, Ops::set1(4.5470025998e-2f));
+            p = Ops::fmadd(p, z, Ops::set1(7.4953002686e-2f));
+            p = Ops::fmadd(p, z, Ops::set1(1.6666752422e-1f));
+            const V asin_over_t = Ops::fmadd(Ops::mul(p, z), one, one);
+
+            // w in [-0.5, 0.5]: acos(w) = pi / 2 - asin(w)
+            const V numerator_middle = Ops::sub(Ops::set1(1.57079632679489661923f), Ops::mul(w, asin_over_t));
+            const V radicand_middle = Ops::sub(one, Ops::mul(w, w));
+
+            // w > 0.5: acos(w) = 2 * asin(t) and sqrt(1 - w^2) = sqrt(2) * t * sqrt(1 + w), so t cancels
+            const V numerator_positive = Ops::mul(Ops::set1(1.41421356237309504880f), asin_over_t);
+            const V radicand_positive = Ops::add(one, w);
+
+            // w < -0.5: acos(w) = pi - 2 * asin(t) and sqrt(1 - w^2) = sqrt(2 * t^2 * (1 - w))
+            const V t = Ops::sqrt(z);
+            const V numerator_negative = Ops::sub(pi, Ops::mul(Ops::set1(2.0f), Ops::mul(t, asin_over_t)));
+            const V radicand_negative = Ops::mul(Ops::mul(Ops::set1(2.0f), z), Ops::sub(one, w));
+
+            const auto positive = Ops::gt(w, Ops::set1(0.5f));
+            const auto negative = Ops::gt(Ops::set1(-0.5f), w);
+
+            const V numerator = Ops::select(positive, numerator_positive, Ops::select(negative, numerator_negative, numerator_middle));
+            const V radicand = Ops::select(positive, radicand_positive, Ops::select(negative, radicand_negative, radicand_middle));
+
+            return Ops::div(numerator, Ops::mul(pi, Ops::sqrt(radicand)));
+        }
+
+        /**
+         * Sweeps `Ops::width` points of a single fiber: see `generate_fibration()` for the math.
+         */
+        template<typename Ops>
+        inline void sweep_lanes(typename Ops::type theta_0, typename Ops::type alpha, typename Ops::type beta, typename Ops::type phi,
+                                typename Ops::type& out_x, typename Ops::type& out_y, typename Ops::type& out_z)
+        {
+            using V = typename Ops::type;
+
+            V sin_phi, cos_phi;
+            sincos<Ops>(phi, sin_phi, cos_phi);
+
+            V sin_theta, cos_theta;
+            sincos<Ops>(Ops::sub(theta_0, phi), sin_theta, cos_theta);
+
+            // Point on S3
+            const V w = Ops::mul(alpha, cos_theta);
+            const V x = Ops::mul(alpha, sin_theta);
+            const V y = Ops::mul(beta, cos_phi);
+            const V z = Ops::mul(beta, sin_phi);
+
+            const V projection = modified_projection<Ops>(w);
+
+            out_x = Ops::mul(projection, x);
+            out_y = Ops::mul(projection, y);
+            out_z = Ops::mul(projection, z);
+        }
+
+        /**
+         * Runs `lanes(inputs, x, y, z)` over `count` samples, `Ops::width` at a time, where `inputs`
+         * holds the current block of each of the `Inputs` input arrays. The last, partial block is
+         * padded by repeating the final sample of each input.
+         */
+        template<typename Ops, size_t Inputs, typename Lanes>
+        inline void sweep_blocks(const float* const (&inputs)[Inputs], size_t count, float* xs, float* ys, float* zs, Lanes lanes)
+        {
+            using V = typename Ops::type;
+            constexpr size_t width = Ops::width;
+
+            V block[Inputs];
+
+            size_t j = 0;
+            for (; j + width <= count; j += width)
+            {
+                for (size_t k = 0; k < Inputs; ++k)
+                {
+                    block[k] = Ops::load(inputs[k] + j);
+                }
+
+                V x, y, z;
+                lanes(block, x, y, z);
+
+                Ops::store(xs + j, x);
+                Ops::store(ys + j, y);
+                Ops::store(zs + j, z);
+            }
+
+            if (j < count)
+            {
+                const size_t remaining = count - j;
+
+                alignas(64) float input_tail[width];
+                alignas(64) float x_tail[width];
+                alignas(64) float y_tail[width];
+                alignas(64) float z_tail[width];
+
+                for (size_t k = 0; k < Inputs; ++k)
+                {
+                    for (size_t i = 0; i < width; ++i)
+                    {
+                        input_tail[i] = inputs[k][j + std::min(i, remaining - 1)];
+                    }
+                    block[k] = Ops::load(input_tail);
+                }
+
+                V x, y, z;
+                lanes(block, x, y, z);
+
+                Ops::store(x_tail, x);
+                Ops::store(y_tail, y);
+                Ops::store(z_tail, z);
+
+                std::copy(x_tail, x_tail + remaining, xs + j);
+                std::copy(y_tail, y_tail + remaining, ys + j);
+                std::copy(z_tail, z_tail + remaining, zs + j);
+            }
+        }
+
+        /**
+         * The body of every `SweepFunction` (see `sweep.h`).
+         */
+        template<typename Ops>
+        inline void sweep_fiber(float a, float b, float c, const float* phis, size_t count, float* xs, float* ys, float* zs)
+        {
+            using V = typename Ops::type;
+
+            // Per-fiber constants (computed exactly as in the reference path)
+            const V theta_0 = Ops::set1(atan2f(-a, b));
+            const V alpha = Ops::set1(sqrtf((1.0f + c) / 2.0f));
+            const V beta = Ops::set1(sqrtf((1.0f - c) / 2.0f));
+
+            const float* const inputs[] = { phis };
+            sweep_blocks<Ops>(inputs, count, xs, ys, zs, [&](const V* block, V& x, V& y, V& z)
+            {
+                sweep_lanes<Ops>(theta_0, alpha, beta, block[0], x, y, z);
+            });
+        }
+
+        /**
+         * The body of every `TableSweepFunction` (see `sweep.h`): the same fiber as `sweep_fiber()`,
+         * but without any per-sample trigonometry. With `theta = theta_0 - phi`, the angle-difference
+         * identities give
+         *
+         *     cos(theta) = cos(theta_0) * cos(phi) + sin(theta_0) * sin(phi)
+         *     sin(theta) = sin(theta_0) * cos(phi) - cos(theta_0) * sin(phi)
+         *
+         * where cos(phi) and sin(phi) come from a table that is shared by every fiber, and
+         * theta_0 = atan2(-a, b), so cos(theta_0) and sin(theta_0) are just `b` and `-a` normalized.
+         */
+        template<typename Ops>
+        inline void sweep_fiber_table(float a, float b, float c, const float* cos_phis, const float* sin_phis, size_t count, float* xs, float* ys, float* zs)
+        {
+            using V = typename Ops::type;
+
+            // `atan2f(0, 0)` is 0, so fall back to theta_0 = 0 at the poles
+            const float length = sqrtf(a * a + b * b);
+            const V cos_theta_0 = Ops::set1(length > 0.0f ? b / length : 1.0f);
+            const V sin_theta_0 = Ops::set1(length > 0.0f ? -a / length : 0.0f);
+            const V alpha = Ops::set1(sqrtf((1.0f + c) / 2.0f));
+            const V beta = Ops::set1(sqrtf((1.0f - c) / 2.0f));
+
+            const float* const inputs[] = { cos_phis, sin_phis };
+            sweep_blocks<Ops>(inputs, count, xs, ys, zs, [&](const V* block, V& out_x, V& out_y, V& out_z)
+            {
+                const V cos_phi = block[0];
+                const V sin_phi = block[1];
+
+                const V cos_theta = Ops::fmadd(cos_theta_0, cos_phi, Ops::mul(sin_theta_0, sin_phi));
+                const V sin_theta = Ops::sub(Ops::mul(sin_theta_0, cos_phi), Ops::mul(cos_theta_0, sin_phi));
+
+                // Point on S3
+                const V w = Ops::mul(alpha, cos_theta);
+                const V x = Ops::mul(alpha, sin_theta);
+                const V y = Ops::mul(beta, cos_phi);
+                const V z = Ops::mul(beta, sin_phi);
+
+                const V projection = modified_projection<Ops>(w);
+
+                out_x = Ops::mul(projection, x);
+                out_y = Ops::mul(projection, y);
+                out_z = Ops::mul(projection, z);
+            });
+        }
+
+    }
+
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstring>
+#include <vector>
+
+#include "glad/glad.h"
+#include "glm.hpp"
+
+namespace graphics
+{
+
+    /**
+     * The uniforms that every draw of a pass shares, whichever program it uses (must match the std140
+     * `FrameUniforms` block in `shaders/hopf.vert`, `shaders/depth.vert` and `shaders/ui.vert`).
+     */
+    struct FrameUniforms
+    {
+        glm::mat4 projection;
+        glm::mat4 view;
+        glm::mat4 light_space_matrix;
+        float time;
+
+        // std140 rounds the size of a block up to a multiple of 16 bytes
+        float padding[3];
+    };
+
+    static_assert(sizeof(FrameUniforms) == 208, "FrameUniforms must match the std140 layout of the uniform block");
+
+    // The uniform buffer binding point of the `FrameUniforms` block (uniform and storage buffers are bound
+    // separately, so this doesn't clash with any of the storage buffers)
+    const uint32_t frame_uniforms_binding = 0;
+
+    /**
+     * A uniform buffer that holds `slot_count` values of the uniform block `T`, one for each pass that
+     * sees the scene differently (a different camera, say). `update()` only uploads a slot if its value
+     * changed, and `bind()` points a binding point at a slot, so that every program that declares the
+     * block reads it from there without setting any uniforms of its own.
+     */
+    template<typename T>
+    class UniformBuffer
+    {
+    public:
+
+        explicit UniformBuffer(size_t slot_count) :
+            slots(slot_count),
+            uploaded(slot_count, false)
+        {
+            // Each slot has to start at a multiple of the offset alignment to be bound on its own
+            GLint alignment = 0;
+            glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+            stride = (sizeof(T) + alignment - 1) / alignment * alignment;
+
+            glCreateBuffers(1, &buffer);
+            glNamedBufferStorage(buffer, stride * slot_count, nullptr, GL_DYNAMIC_STORAGE_BIT);
+        }
+
+        ~UniformBuffer()
+        {
+            glDeleteBuffers(1, &buffer);
+        }
+
+        UniformBuffer(const UniformBuffer& other) = delete;
+
+        UniformBuffer& operator=(const UniformBuffer& other) = delete;
+
+        void update(size_t slot, const T& value)
+        {
+            if (uploaded[slot] && std::memcmp(&slots[slot], &value, sizeof(T)) == 0)
+            {
+                return;
+            }
+
+            slots[slot] = value;
+            uploaded[slot] = true;
+            glNamedBufferSubData(buffer, stride * slot, sizeof(T), &value);
+        }
+
+        void bind(uint32_t binding, size_t slot) const
+        {
+            glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, stride * slot, sizeof(T));
+        }
+
+    private:
+
+        uint32_t buffer = 0;
+        size_t stride = 0;
+
+        // What each slot last uploaded
+        std::vector<T> slots;
+        std::vector<bool> uploaded;
+    };
+
+}
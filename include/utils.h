@@ -1,11 +1,21 @@
 #pragma once
 
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
+#include "buffered_writer.h"
+#include "vertex.h"
+
 namespace utils
 {
 
-	std::vector<float> linear_spacing(float lower, float upper, size_t steps)
+	inline std::vector<float> linear_spacing(float lower, float upper, size_t steps)
 	{
 		std::vector<float> data;
 		for (size_t i = 0; i < steps; ++i)
@@ -16,49 +26,749 @@ namespace utils
 		return data;
 	}
 
-	void save_polyline_obj(const graphics::Mesh& mesh, std::string filename = "model.obj")
+	/**
+	 * Appends the `.obj` extension to `filename`, unless it already has it.
+	 */
+	inline std::string get_obj_filename(std::string filename)
 	{
-		// See: http://paulbourke.net/dataformats/obj/
-
-		// If the user didn't add the file extension, add it here
 		if (filename.substr(filename.find_last_of(".") + 1) != "obj")
 		{
 			filename += ".obj";
 		}
 
-		// Open the newly created file
-		std::ofstream file;
-		file.open(filename);
+		return filename;
+	}
+
+	/**
+	 * Writes the `v` lines of `count` vertices to an .obj file (see `save_polyline_obj()`), advancing `progress`.
+	 */
+	inline void write_obj_vertices(BufferedWriter& file, const Vertex* vertices, size_t count, ExportProgress* progress = nullptr)
+	{
+		// Progress is only published once per chunk, to keep the atomics out of the inner loops
+		const size_t chunk_size = 1 << 16;
+
+		for (size_t chunk = 0; chunk < count; chunk += chunk_size)
+		{
+			for (size_t i = chunk; i < std::min(chunk + chunk_size, count); ++i)
+			{
+				const auto& position = vertices[i].position;
+
+				char* output = file.reserve(128);
+				*output++ = 'v';
+				*output++ = ' ';
+				output = write_float(position.x, output);
+				*output++ = ' ';
+				output = write_float(position.y, output);
+				*output++ = ' ';
+				output = write_float(position.z, output);
+				*output++ = '\n';
+				file.commit(output);
+			}
+
+			if (progress != nullptr)
+			{
+				progress->items_written += std::min(chunk_size, count - chunk);
+			}
+		}
+	}
+
+	/**
+	 * Writes the `l` lines of `count` indices to an .obj file (see `save_polyline_obj()`), advancing `progress`.
+	 * `start` carries whether the next index begins a new polyline from one call to the next, so a long index
+	 * buffer can be written in pieces.
+	 */
+	inline void write_obj_indices(BufferedWriter& file, const uint32_t* indices, size_t count, bool& start, ExportProgress* progress = nullptr)
+	{
+		const size_t chunk_size = 1 << 16;
+
+		for (size_t chunk = 0; chunk < count; chunk += chunk_size)
+		{
+			for (size_t i = chunk; i < std::min(chunk + chunk_size, count); ++i)
+			{
+				char* output = file.reserve(32);
+				if (start)
+				{
+					*output++ = 'l';
+					*output++ = ' ';
+					start = false;
+				}
+
+				// Primitive restart (i.e. the start of a new polyline)
+				if (indices[i] == std::numeric_limits<uint32_t>::max())
+				{
+					*output++ = '\n';
+					start = true;
+				}
+				else
+				{
+					// .obj files use 1-based indexing
+					output = write_uint(indices[i] + uint64_t{ 1 }, output);
+					*output++ = ' ';
+				}
+				file.commit(output);
+			}
+
+			if (progress != nullptr)
+			{
+				progress->items_written += std::min(chunk_size, count - chunk);
+			}
+		}
+	}
 
-		// Write vertices
-		for (size_t i = 0; i < mesh.get_vertices().size(); ++i)
+	/**
+	 * Writes `vertex_count` vertices (positions only) and `index_count` indices (one polyline per run of indices
+	 * between primitive restarts) to an .obj file. If `progress` is given, it is advanced as the file is written
+	 * (so this can be called from a background thread, see `utils::ExportWorker`).
+	 */
+	inline void save_polyline_obj(const Vertex* vertices, size_t vertex_count, const uint32_t* indices, size_t index_count, std::string filename = "model.obj", ExportProgress* progress = nullptr)
+	{
+		// See: http://paulbourke.net/dataformats/obj/
+		BufferedWriter file{ get_obj_filename(filename), progress };
+
+		if (progress != nullptr)
 		{
-			const auto vertex = mesh.get_vertices()[i];
-			file << "v " << vertex.position.x << " " << vertex.position.y << " " << vertex.position.z << "\n";
+			progress->items_total += vertex_count + index_count;
 		}
 
-		// Write indices
 		bool start = true;
-		for (size_t i = 0; i < mesh.get_indices().size(); ++i)
+		write_obj_vertices(file, vertices, vertex_count, progress);
+		write_obj_indices(file, indices, index_count, start, progress);
+
+		file.close();
+	}
+
+	inline void save_polyline_obj(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, std::string filename = "model.obj", ExportProgress* progress = nullptr)
+	{
+		save_polyline_obj(vertices.data(), vertices.size(), indices.data(), indices.size(), filename, progress);
+	}
+
+	/**
+	 * Returns the extension of `filename` (everything after the last `.`, in lower case), or an empty string if
+	 * it doesn't have one.
+	 */
+	inline std::string get_extension(const std::string& filename)
+	{
+		const auto separator = filename.find_last_of("./\\");
+		if (separator == std::string::npos || filename[separator] != '.')
+		{
+			return "";
+		}
+
+		std::string extension = filename.substr(separator + 1);
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return static_cast<char>(std::tolower(c)); });
+
+		return extension;
+	}
+
+	/**
+	 * A run of `count` indices, starting at index `first`, that forms one polyline (see `get_polylines()`).
+	 */
+	struct Polyline
+	{
+		size_t first;
+		size_t count;
+	};
+
+	/**
+	 * Splits `indices` into polylines at every primitive restart index, leaving out polylines with fewer than
+	 * two vertices (which have no edges).
+	 */
+	inline std::vector<Polyline> get_polylines(const uint32_t* indices, size_t index_count)
+	{
+		std::vector<Polyline> polylines;
+
+		size_t first = 0;
+		for (size_t i = 0; i <= index_count; ++i)
+		{
+			if (i == index_count || indices[i] == std::numeric_limits<uint32_t>::max())
+			{
+				if (i - first >= 2)
+				{
+					polylines.push_back({ first, i - first });
+				}
+				first = i + 1;
+			}
+		}
+
+		return polylines;
+	}
+
+	/**
+	 * Converts a color channel to an 8-bit unsigned normalized integer.
+	 */
+	inline uint8_t to_unorm8(float value)
+	{
+		return static_cast<uint8_t>(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+	}
+
+	/**
+	 * Writes the header of a binary .ply file (see `save_polyline_ply()`).
+	 */
+	inline void write_ply_header(BufferedWriter& file, size_t vertex_count, size_t edge_count)
+	{
+		file.write("ply\n"
+				   "format binary_little_endian 1.0\n"
+				   "element vertex " + std::to_string(vertex_count) + "\n"
+				   "property float x\n"
+				   "property float y\n"
+				   "property float z\n"
+				   "property uchar red\n"
+				   "property uchar green\n"
+				   "property uchar blue\n"
+				   "element edge " + std::to_string(edge_count) + "\n"
+				   "property int vertex1\n"
+				   "property int vertex2\n"
+				   "end_header\n");
+	}
+
+	/**
+	 * Returns the number of edges in `polylines` (see `get_polylines()`).
+	 */
+	inline size_t count_edges(const std::vector<Polyline>& polylines)
+	{
+		size_t edge_count = 0;
+		for (const auto& polyline : polylines)
+		{
+			edge_count += polyline.count - 1;
+		}
+
+		return edge_count;
+	}
+
+	/**
+	 * Writes the records of `count` vertices to a binary .ply file (see `save_polyline_ply()`), advancing `progress`.
+	 */
+	inline void write_ply_vertices(BufferedWriter& file, const Vertex* vertices, size_t count, ExportProgress* progress = nullptr)
+	{
+		const size_t chunk_size = 1 << 16;
+
+		for (size_t chunk = 0; chunk < count; chunk += chunk_size)
+		{
+			for (size_t i = chunk; i < std::min(chunk + chunk_size, count); ++i)
+			{
+				const Vertex& vertex = vertices[i];
+
+				char* output = file.reserve(15);
+				output = write_little_endian(vertex.position.x, output);
+				output = write_little_endian(vertex.position.y, output);
+				output = write_little_endian(vertex.position.z, output);
+				*output++ = static_cast<char>(to_unorm8(vertex.color.x));
+				*output++ = static_cast<char>(to_unorm8(vertex.color.y));
+				*output++ = static_cast<char>(to_unorm8(vertex.color.z));
+				file.commit(output);
+			}
+
+			if (progress != nullptr)
+			{
+				progress->items_written += std::min(chunk_size, count - chunk);
+			}
+		}
+	}
+
+	/**
+	 * Writes the edges of `polylines` (runs of `indices`, see `get_polylines()`) to a binary .ply file, advancing
+	 * `progress`.
+	 */
+	inline void write_ply_edges(BufferedWriter& file, const uint32_t* indices, const std::vector<Polyline>& polylines, ExportProgress* progress = nullptr)
+	{
+		const size_t chunk_size = 1 << 16;
+
+		size_t edges_written = 0;
+		for (const auto& polyline : polylines)
+		{
+			for (size_t i = polyline.first + 1; i < polyline.first + polyline.count; ++i)
+			{
+				char* output = file.reserve(8);
+				output = write_little_endian(static_cast<int32_t>(indices[i - 1]), output);
+				output = write_little_endian(static_cast<int32_t>(indices[i]), output);
+				file.commit(output);
+			}
+
+			edges_written += polyline.count - 1;
+			if (progress != nullptr && edges_written >= chunk_size)
+			{
+				progress->items_written += edges_written;
+				edges_written = 0;
+			}
+		}
+
+		if (progress != nullptr)
+		{
+			progress->items_written += edges_written;
+		}
+	}
+
+	/**
+	 * Writes `vertex_count` vertices (positions and colors) and the edges between consecutive indices of each
+	 * polyline in `indices` to a binary (little-endian) .ply file: every vertex is 3 floats followed by 3 bytes
+	 * of color, and every edge is 2 32-bit vertex indices, so both can be loaded without parsing any text.
+	 */
+	inline void save_polyline_ply(const Vertex* vertices, size_t vertex_count, const uint32_t* indices, size_t index_count, const std::string& filename = "model.ply", ExportProgress* progress = nullptr)
+	{
+		// See: http://paulbourke.net/dataformats/ply/
+		const auto polylines = get_polylines(indices, index_count);
+		const size_t edge_count = count_edges(polylines);
+
+		BufferedWriter file{ filename, progress };
+
+		if (progress != nullptr)
+		{
+			progress->items_total += vertex_count + edge_count;
+		}
+
+		write_ply_header(file, vertex_count, edge_count);
+		write_ply_vertices(file, vertices, vertex_count, progress);
+		write_ply_edges(file, indices, polylines, progress);
+
+		file.close();
+	}
+
+	/**
+	 * Appends `value` to a JSON document, as the shortest number that reads back as exactly `value`.
+	 */
+	inline void append_json_float(std::string& json, float value)
+	{
+		char text[32];
+		json.append(text, write_float(value, text));
+	}
+
+	/**
+	 * Writes `vertex_count` vertices (positions and colors) and the polylines in `indices` to a binary glTF 2.0
+	 * file (.glb): one mesh with one line strip primitive per polyline, all of which share a single position and
+	 * color accessor. If `quantize` is set, positions are stored as 16-bit normalized integers (relative to the
+	 * bounding box, which the node's translation and scale map them back to, see `KHR_mesh_quantization`) and
+	 * colors as 8-bit normalized integers, which roughly halves the size of the file.
+	 *
+	 * glTF requires finite positions, so vertices at infinity (which the stereographic projection can produce)
+	 * are moved to the center of the bounding box. glTF also requires a mesh to have at least one primitive, so
+	 * this throws a `std::runtime_error` if there are no polylines (or no vertices).
+	 */
+	inline void save_polyline_glb(const Vertex* vertices, size_t vertex_count, const uint32_t* indices, size_t index_count, const std::string& filename = "model.glb", bool quantize = false, ExportProgress* progress = nullptr)
+	{
+		// See: https://registry.khronos.org/glTF/specs/2.0/glTF-2.0.html
+		const auto polylines = get_polylines(indices, index_count);
+		if (polylines.empty() || vertex_count == 0)
+		{
+			throw std::runtime_error("Nothing to write to GLB file: " + filename);
+		}
+
+		size_t strip_index_count = 0;
+		for (const auto& polyline : polylines)
+		{
+			strip_index_count += polyline.count;
+		}
+
+		// The bounding box of all finite positions
+		glm::vec3 minimum{ std::numeric_limits<float>::max() };
+		glm::vec3 maximum{ -std::numeric_limits<float>::max() };
+		for (size_t i = 0; i < vertex_count; ++i)
+		{
+			const glm::vec3& position = vertices[i].position;
+			if (std::isfinite(position.x) && std::isfinite(position.y) && std::isfinite(position.z))
+			{
+				minimum = glm::min(minimum, position);
+				maximum = glm::max(maximum, position);
+			}
+		}
+		if (minimum.x > maximum.x)
+		{
+			minimum = maximum = glm::vec3{ 0.0f };
+		}
+
+		const glm::vec3 center = (minimum + maximum) * 0.5f;
+		glm::vec3 extent = (maximum - minimum) * 0.5f;
+		for (size_t i = 0; i < 3; ++i)
+		{
+			extent[i] = extent[i] > 0.0f ? extent[i] : 1.0f;
+		}
+
+		const auto quantize_position = [&](const glm::vec3& position, int16_t* output)
+		{
+			for (size_t i = 0; i < 3; ++i)
+			{
+				const float normalized = std::isfinite(position[i]) ? (position[i] - center[i]) / extent[i] : 0.0f;
+				output[i] = static_cast<int16_t>(std::lround(std::min(std::max(normalized, -1.0f), 1.0f) * 32767.0f));
+			}
+		};
+
+		// Layout of the binary chunk: positions, colors, then the indices of every line strip (each of the vertex
+		// attributes is padded to a multiple of 4 bytes, as glTF requires)
+		const size_t position_stride = quantize ? 8 : 12;
+		const size_t color_stride = quantize ? 4 : 12;
+		const size_t index_size = vertex_count < std::numeric_limits<uint16_t>::max() ? 2 : 4;
+
+		const size_t positions_offset = 0;
+		const size_t colors_offset = positions_offset + vertex_count * position_stride;
+		const size_t indices_offset = colors_offset + vertex_count * color_stride;
+		const size_t index_bytes = strip_index_count * index_size;
+		const size_t binary_length = (indices_offset + index_bytes + 3) / 4 * 4;
+
+		// JSON chunk
+		std::string json;
+		json.reserve(256 + polylines.size() * 160);
+		json += "{\"asset\":{\"version\":\"2.0\",\"generator\":\"hopf\"},";
+		if (quantize)
+		{
+			json += "\"extensionsUsed\":[\"KHR_mesh_quantization\"],\"extensionsRequired\":[\"KHR_mesh_quantization\"],";
+		}
+		json += "\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0";
+		if (quantize)
 		{
-			if (start)
+			json += ",\"translation\":[";
+			for (size_t i = 0; i < 3; ++i)
+			{
+				json += i == 0 ? "" : ",";
+				append_json_float(json, center[i]);
+			}
+			json += "],\"scale\":[";
+			for (size_t i = 0; i < 3; ++i)
 			{
-				file << "l ";
-				start = false;
+				json += i == 0 ? "" : ",";
+				append_json_float(json, extent[i]);
 			}
+			json += "]";
+		}
+		json += "}],";
+
+		// Accessor 0 is the positions, 1 the colors, and every accessor after that the indices of one polyline
+		json += "\"meshes\":[{\"primitives\":[";
+		for (size_t i = 0; i < polylines.size(); ++i)
+		{
+			json += i == 0 ? "" : ",";
+			json += "{\"attributes\":{\"POSITION\":0,\"COLOR_0\":1},\"indices\":" + std::to_string(i + 2) + ",\"mode\":3}";
+		}
+		json += "]}],";
+
+		json += "\"accessors\":[";
+		if (quantize)
+		{
+			int16_t quantized_minimum[3];
+			int16_t quantized_maximum[3];
+			quantize_position(minimum, quantized_minimum);
+			quantize_position(maximum, quantized_maximum);
 
-			// Primitive restart (i.e. the start of a new polyline)
-			if (mesh.get_indices()[i] == std::numeric_limits<uint32_t>::max())
+			// Bounds are given in the stored (integer) values, whether or not the accessor is normalized
+			json += "{\"bufferView\":0,\"componentType\":5122,\"normalized\":true,\"count\":" + std::to_string(vertex_count) + ",\"type\":\"VEC3\",\"min\":[" +
+					std::to_string(quantized_minimum[0]) + "," + std::to_string(quantized_minimum[1]) + "," + std::to_string(quantized_minimum[2]) + "],\"max\":[" +
+					std::to_string(quantized_maximum[0]) + "," + std::to_string(quantized_maximum[1]) + "," + std::to_string(quantized_maximum[2]) + "]},";
+			json += "{\"bufferView\":1,\"componentType\":5121,\"normalized\":true,\"count\":" + std::to_string(vertex_count) + ",\"type\":\"VEC3\"}";
+		}
+		else
+		{
+			json += "{\"bufferView\":0,\"componentType\":5126,\"count\":" + std::to_string(vertex_count) + ",\"type\":\"VEC3\",\"min\":[";
+			for (size_t i = 0; i < 3; ++i)
+			{
+				json += i == 0 ? "" : ",";
+				append_json_float(json, minimum[i]);
+			}
+			json += "],\"max\":[";
+			for (size_t i = 0; i < 3; ++i)
 			{
-				file << "\n";
-				start = true;
-				continue;
+				json += i == 0 ? "" : ",";
+				append_json_float(json, maximum[i]);
 			}
+			json += "]},";
+			json += "{\"bufferView\":1,\"componentType\":5126,\"count\":" + std::to_string(vertex_count) + ",\"type\":\"VEC3\"}";
+		}
+
+		size_t strip_offset = 0;
+		for (const auto& polyline : polylines)
+		{
+			json += ",{\"bufferView\":2,\"byteOffset\":" + std::to_string(strip_offset * index_size) +
+					",\"componentType\":" + (index_size == 2 ? "5123" : "5125") +
+					",\"count\":" + std::to_string(polyline.count) + ",\"type\":\"SCALAR\"}";
+			strip_offset += polyline.count;
+		}
+		json += "],";
+
+		json += "\"bufferViews\":["
+				"{\"buffer\":0,\"byteOffset\":" + std::to_string(positions_offset) + ",\"byteLength\":" + std::to_string(colors_offset - positions_offset) +
+				",\"byteStride\":" + std::to_string(position_stride) + ",\"target\":34962},"
+				"{\"buffer\":0,\"byteOffset\":" + std::to_string(colors_offset) + ",\"byteLength\":" + std::to_string(indices_offset - colors_offset) +
+				",\"byteStride\":" + std::to_string(color_stride) + ",\"target\":34962},"
+				"{\"buffer\":0,\"byteOffset\":" + std::to_string(indices_offset) + ",\"byteLength\":" + std::to_string(index_bytes) + ",\"target\":34963}],";
+		json += "\"buffers\":[{\"byteLength\":" + std::to_string(binary_length) + "}]}";
 
-			// .obj files use 1-based indexing
-			file << mesh.get_indices()[i] + 1 << " ";
+		// Chunks are padded to a multiple of 4 bytes (the JSON chunk with spaces)
+		json.resize((json.size() + 3) / 4 * 4, ' ');
+
+		BufferedWriter file{ filename, progress };
+
+		const size_t chunk_size = 1 << 16;
+		if (progress != nullptr)
+		{
+			progress->items_total += vertex_count + strip_index_count;
 		}
+
+		// Header and chunk headers
+		char* output = file.reserve(20);
+		output = write_little_endian(uint32_t{ 0x46546C67 }, output);  // "glTF"
+		output = write_little_endian(uint32_t{ 2 }, output);
+		output = write_little_endian(static_cast<uint32_t>(12 + 8 + json.size() + 8 + binary_length), output);
+		output = write_little_endian(static_cast<uint32_t>(json.size()), output);
+		output = write_little_endian(uint32_t{ 0x4E4F534A }, output);  // "JSON"
+		file.commit(output);
+		file.write(json);
+
+		output = file.reserve(8);
+		output = write_little_endian(static_cast<uint32_t>(binary_length), output);
+		output = write_little_endian(uint32_t{ 0x004E4942 }, output);  // "BIN"
+		file.commit(output);
+
+		// Write positions
+		for (size_t chunk = 0; chunk < vertex_count; chunk += chunk_size)
+		{
+			for (size_t i = chunk; i < std::min(chunk + chunk_size, vertex_count); ++i)
+			{
+				const glm::vec3& position = vertices[i].position;
+
+				output = file.reserve(12);
+				if (quantize)
+				{
+					int16_t quantized[3];
+					quantize_position(position, quantized);
+					for (size_t j = 0; j < 3; ++j)
+					{
+						output = write_little_endian(quantized[j], output);
+					}
+					output = write_little_endian(int16_t{ 0 }, output);
+				}
+				else
+				{
+					for (size_t j = 0; j < 3; ++j)
+					{
+						output = write_little_endian(std::isfinite(position[j]) ? position[j] : center[j], output);
+					}
+				}
+				file.commit(output);
+			}
+
+			if (progress != nullptr)
+			{
+				progress->items_written += std::min(chunk_size, vertex_count - chunk);
+			}
+		}
+
+		// Write colors
+		for (size_t i = 0; i < vertex_count; ++i)
+		{
+			const glm::vec3& color = vertices[i].color;
+
+			output = file.reserve(12);
+			if (quantize)
+			{
+				*output++ = static_cast<char>(to_unorm8(color.x));
+				*output++ = static_cast<char>(to_unorm8(color.y));
+				*output++ = static_cast<char>(to_unorm8(color.z));
+				*output++ = 0;
+			}
+			else
+			{
+				output = write_little_endian(color.x, output);
+				output = write_little_endian(color.y, output);
+				output = write_little_endian(color.z, output);
+			}
+			file.commit(output);
+		}
+
+		// Write the indices of each line strip
+		size_t indices_written = 0;
+		for (const auto& polyline : polylines)
+		{
+			for (size_t i = polyline.first; i < polyline.first + polyline.count; ++i)
+			{
+				output = file.reserve(4);
+				output = index_size == 2 ? write_little_endian(static_cast<uint16_t>(indices[i]), output)
+										 : write_little_endian(indices[i], output);
+				file.commit(output);
+			}
+
+			indices_written += polyline.count;
+			if (progress != nullptr && indices_written >= chunk_size)
+			{
+				progress->items_written += indices_written;
+				indices_written = 0;
+			}
+		}
+
+		// Pad the binary chunk
+		const size_t padding = binary_length - indices_offset - index_bytes;
+		file.write("\0\0\0", padding);
+
 		file.close();
+
+		if (progress != nullptr)
+		{
+			progress->items_written += indices_written;
+		}
+	}
+
+	/**
+	 * Writes a fibration (see `save_polyline_obj()`) in the format named by the extension of `filename`: binary
+	 * PLY for `.ply`, binary glTF for `.glb` (with `quantize`, see `save_polyline_glb()`), and OBJ otherwise.
+	 */
+	inline void save_polylines(const Vertex* vertices, size_t vertex_count, const uint32_t* indices, size_t index_count, const std::string& filename, bool quantize = false, ExportProgress* progress = nullptr)
+	{
+		const std::string extension = get_extension(filename);
+
+		if (extension == "ply")
+		{
+			save_polyline_ply(vertices, vertex_count, indices, index_count, filename, progress);
+		}
+		else if (extension == "glb")
+		{
+			save_polyline_glb(vertices, vertex_count, indices, index_count, filename, quantize, progress);
+		}
+		else
+		{
+			save_polyline_obj(vertices, vertex_count, indices, index_count, filename, progress);
+		}
+	}
+
+	inline void save_polylines(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const std::string& filename, bool quantize = false, ExportProgress* progress = nullptr)
+	{
+		save_polylines(vertices.data(), vertices.size(), indices.data(), indices.size(), filename, quantize, progress);
+	}
+
+	/**
+	 * Writes an .obj vertex (with an optional weight, for the control points of rational curves) to `file`.
+	 */
+	inline void write_obj_vertex(BufferedWriter& file, const glm::vec3& position, const float* weight = nullptr)
+	{
+		char* output = file.reserve(160);
+		*output++ = 'v';
+		for (size_t i = 0; i < 3; ++i)
+		{
+			*output++ = ' ';
+			output = write_float(position[i], output);
+		}
+		if (weight != nullptr)
+		{
+			*output++ = ' ';
+			output = write_float(*weight, output);
+		}
+		*output++ = '\n';
+		file.commit(output);
+	}
+
+	/**
+	 * Writes each of `circles` as an exact free-form curve: a rational quadratic B-spline with 9 control points
+	 * (the corners and edge midpoints of the square around the circle, with the corners weighted by sqrt(2) / 2).
+	 * Lines (circles with a radius of 0) are written as polylines from `-line_extent` to `line_extent` along them.
+	 */
+	inline void save_circle_obj(const Circle* circles, size_t count, std::string filename = "model.obj", float line_extent = 100.0f, ExportProgress* progress = nullptr)
+	{
+		// See: http://paulbourke.net/dataformats/obj/ (section "Free-form curve/surface attributes")
+		BufferedWriter file{ get_obj_filename(filename), progress };
+
+		file.write("cstype rat bspline\ndeg 2\n");
+
+		if (progress != nullptr)
+		{
+			progress->items_total += count;
+		}
+
+		const float corner_weight = sqrtf(0.5f);
+		const float edge_weight = 1.0f;
+		size_t vertex_count = 0;
+
+		for (size_t c = 0; c < count; ++c)
+		{
+			const Circle& circle = circles[c];
+
+			if (circle.radius == 0.0f)
+			{
+				write_obj_vertex(file, circle.center - circle.normal * line_extent);
+				write_obj_vertex(file, circle.center + circle.normal * line_extent);
+				file.write("l " + std::to_string(vertex_count + 1) + " " + std::to_string(vertex_count + 2) + "\n");
+				vertex_count += 2;
+			}
+			else
+			{
+				// Any two orthonormal vectors in the plane of the circle
+				const glm::vec3 helper = std::abs(circle.normal.x) < 0.9f ? glm::vec3{ 1.0f, 0.0f, 0.0f } : glm::vec3{ 0.0f, 1.0f, 0.0f };
+				const glm::vec3 u = glm::normalize(glm::cross(circle.normal, helper)) * circle.radius;
+				const glm::vec3 v = glm::cross(circle.normal, u);
+
+				// The control points (the last one is the first one again, which closes the curve)
+				const glm::vec3 offsets[8] = { u, u + v, v, v - u, -u, -u - v, -v, u - v };
+				for (size_t i = 0; i < 8; ++i)
+				{
+					write_obj_vertex(file, circle.center + offsets[i], i % 2 == 0 ? &edge_weight : &corner_weight);
+				}
+
+				// .obj files use 1-based indexing
+				char* output = file.reserve(256);
+				std::memcpy(output, "curv 0 4", 8);
+				output += 8;
+				for (size_t i = 0; i < 9; ++i)
+				{
+					*output++ = ' ';
+					output = write_uint(vertex_count + (i % 8) + 1, output);
+				}
+				file.commit(output);
+				file.write("\nparm u 0 0 0 1 1 2 2 3 3 4 4 4\nend\n");
+				vertex_count += 8;
+			}
+
+			if (progress != nullptr && c % 4096 == 4095)
+			{
+				progress->items_written += 4096;
+			}
+		}
+		file.close();
+
+		if (progress != nullptr)
+		{
+			progress->items_written += count % 4096;
+		}
+	}
+
+	inline void save_circle_obj(const std::vector<Circle>& circles, std::string filename = "model.obj", float line_extent = 100.0f, ExportProgress* progress = nullptr)
+	{
+		save_circle_obj(circles.data(), circles.size(), filename, line_extent, progress);
+	}
+
+	/**
+	 * Writes `circles` to a small binary table: the 8 characters `HOPFCIRC`, a version number (1) and the
+	 * number of circles (both as 32-bit unsigned integers), followed by the center, normal and radius of
+	 * each circle (7 32-bit floats). Everything is stored in the byte order of the machine that wrote it.
+	 */
+	inline void save_circle_table(const Circle* circles, size_t count, const std::string& filename = "model.circles", ExportProgress* progress = nullptr)
+	{
+		BufferedWriter file{ filename, progress };
+
+		if (progress != nullptr)
+		{
+			progress->items_total += count;
+		}
+
+		const uint32_t version = 1;
+		const uint32_t circle_count = static_cast<uint32_t>(count);
+		file.write("HOPFCIRC", 8);
+		file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+		file.write(reinterpret_cast<const char*>(&circle_count), sizeof(circle_count));
+
+		for (size_t c = 0; c < count; ++c)
+		{
+			float record[7];
+			std::memcpy(&record[0], &circles[c].center, sizeof(float) * 3);
+			std::memcpy(&record[3], &circles[c].normal, sizeof(float) * 3);
+			record[6] = circles[c].radius;
+
+			file.write(reinterpret_cast<const char*>(record), sizeof(record));
+		}
+		file.close();
+
+		if (progress != nullptr)
+		{
+			progress->items_written += count;
+		}
+	}
+
+	inline void save_circle_table(const std::vector<Circle>& circles, const std::string& filename = "model.circles", ExportProgress* progress = nullptr)
+	{
+		save_circle_table(circles.data(), circles.size(), filename, progress);
 	}
 
-}
\ No newline at end of file
+}
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <cstdint>
+#include <utility>
+#include <vector>
+
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #define GLM_ENABLE_EXPERIMENTAL
@@ -22,6 +26,29 @@ struct Vertex
     }
 };
 
+/**
+ * A quantized vertex of a fibration (see `graphics::VertexFormat`): the position as three 16-bit signed
+ * normalized integers, followed by the index of the fiber that the vertex belongs to (or, for points on
+ * S3, `w` as another signed normalized integer).
+ */
+struct CompactVertex
+{
+    int16_t position[3];
+    uint16_t fiber;
+};
+
+/**
+ * A circle in 3-space, given by its `center`, the unit `normal` of the plane that it lies in, and its
+ * `radius` (7 floats). A radius of 0 marks a line instead (a circle through infinity), which passes
+ * through `center` in the direction of `normal`.
+ */
+struct Circle
+{
+    glm::vec3 center;
+    glm::vec3 normal;
+    float radius;
+};
+
 namespace std
 {
     template<>
@@ -33,3 +60,29 @@ namespace std
         }
     };
 }
+
+namespace graphics
+{
+
+    using MeshData = std::pair<std::vector<Vertex>, std::vector<uint32_t>>;
+
+    /**
+     * How a mesh stores its vertices on the GPU.
+     */
+    enum class VertexFormat
+    {
+        Standard,   // `Vertex` (32 bytes)
+        Compact,    // `CompactVertex` (8 bytes) with a fiber index: colors are fetched per fiber (see `Mesh::draw()`)
+        CompactS3   // `CompactVertex` (8 bytes) with `w`: colors are left to the vertex shader (see `hopf::generate_fibration_s3()`)
+    };
+
+    /**
+     * A contiguous run of `count` vertices, starting at vertex `first`.
+     */
+    struct VertexRange
+    {
+        size_t first;
+        size_t count;
+    };
+
+}
\ No newline at end of file
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace utils
+{
+
+    /**
+     * A fixed set of worker threads that split a range `[0, count)` into contiguous chunks and
+     * process them in parallel. The calling thread also takes chunks, so a pool created with
+     * `n` threads keeps `n` cores busy while only spawning `n - 1` workers.
+     */
+    class WorkerPool
+    {
+
+    public:
+
+        explicit WorkerPool(size_t thread_count = std::thread::hardware_concurrency())
+        {
+            // The calling thread counts as one of the threads
+            for (size_t i = 1; i < std::max<size_t>(thread_count, 1); ++i)
+            {
+                workers.emplace_back([this] { worker_loop(); });
+            }
+        }
+
+        ~WorkerPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock{ mutex };
+                stopping = true;
+            }
+            work_available.notify_all();
+
+            for (auto& worker : workers)
+            {
+                worker.join();
+            }
+        }
+
+        WorkerPool(const WorkerPool& other) = delete;
+
+        WorkerPool& operator=(const WorkerPool& other) = delete;
+
+        /**
+         * Returns a process-wide pool with one thread per hardware thread.
+         */
+        static WorkerPool& get_shared()
+        {
+            static WorkerPool pool;
+            return pool;
+        }
+
+        size_t get_thread_count() const
+        {
+            return workers.size() + 1;
+        }
+
+        /**
+         * Calls `task(begin, end)` for contiguous sub-ranges that together cover `[0, count)`,
+         * using at most `max_threads` threads (0 means all of them), and blocks until every
+         * sub-range has been processed. If a task throws, the first exception is re-thrown here.
+         */
+        void parallel_for(size_t count, size_t max_threads, const std::function<void(size_t, size_t)>& task)
+        {
+            const size_t threads = (max_threads == 0) ? get_thread_count() : std::min(max_threads, get_thread_count());
+
+            if (threads <= 1 || count <= 1)
+            {
+                if (count > 0)
+                {
+                    task(0, count);
+                }
+                return;
+            }
+
+            // Only one range is processed at a time
+            std::lock_guard<std::mutex> submit_lock{ submit_mutex };
+            {
+                // Wait for any worker that woke up late for the previous range to leave it
+                std::unique_lock<std::mutex> lock{ mutex };
+                work_done.wait(lock, [this] { return active_workers == 0; });
+
+                // A few chunks per thread so that uneven chunks balance out
+                current_task = &task;
+                current_count = count;
+                current_chunks = std::min(count, threads * 4);
+                allowed_workers = threads - 1;
+                next_chunk = 0;
+                remaining_chunks = current_chunks;
+                error = nullptr;
+                ++generation;
+            }
+            work_available.notify_all();
+
+            run_chunks();
+
+            std::unique_lock<std::mutex> lock{ mutex };
+            work_done.wait(lock, [this] { return remaining_chunks == 0 && active_workers == 0; });
+            current_task = nullptr;
+
+            if (error)
+            {
+                std::rethrow_exception(error);
+            }
+        }
+
+    private:
+
+        std::vector<std::thread> workers;
+        std::mutex submit_mutex;
+        std::mutex mutex;
+        std::condition_variable work_available;
+        std::condition_variable work_done;
+
+        // State of the range that is currently being processed (guarded by `mutex`, except for
+        // the atomic counters)
+        const std::function<void(size_t, size_t)>* current_task = nullptr;
+        size_t current_count = 0;
+        size_t current_chunks = 0;
+        size_t allowed_workers = 0;
+        size_t active_workers = 0;
+        std::atomic<size_t> next_chunk{ 0 };
+        std::atomic<size_t> remaining_chunks{ 0 };
+        std::exception_ptr error;
+        uint64_t generation = 0;
+        bool stopping = false;
+
+        void worker_loop()
+        {
+            uint64_t seen_generation = 0;
+
+            while (true)
+            {
+                {
+                    std::unique_lock<std::mutex> lock{ mutex };
+                    work_available.wait(lock, [&] { return stopping || generation != seen_generation; });
+
+                    if (stopping)
+                    {
+                        return;
+                    }
+                    seen_generation = generation;
+
+                    // Respect the caller's thread limit
+                    if (active_workers >= allowed_workers)
+                    {
+                        continue;
+                    }
+                    ++active_workers;
+                }
+
+                run_chunks();
+
+                {
+                    std::lock_guard<std::mutex> lock{ mutex };
+                    --active_workers;
+                }
+                work_done.notify_all();
+            }
+        }
+
+        void run_chunks()
+        {
+            size_t chunk;
+            while ((chunk = next_chunk.fetch_add(1)) < current_chunks)
+            {
+                // Chunk `i` covers `[i * count / chunks, (i + 1) * count / chunks)`
+                const size_t begin = chunk * current_count / current_chunks;
+                const size_t end = (chunk + 1) * current_count / current_chunks;
+
+                try
+                {
+                    (*current_task)(begin, end);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock{ mutex };
+                    if (!error)
+                    {
+                        error = std::current_exception();
+                    }
+                }
+
+                if (remaining_chunks.fetch_sub(1) == 1)
+                {
+                    std::lock_guard<std::mutex> lock{ mutex };
+                    work_done.notify_all();
+                }
+            }
+        }
+    };
+
+}
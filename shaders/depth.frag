@@ -1,6 +1,17 @@
 #version 460
 
+// Only written when rendering into the moment map of variance shadow mapping (the depth-only framebuffer
+// has no color attachments, see `graphics::ShadowMap`)
+layout(location = 0) out vec2 o_moments;
+
 void main()
 {             
     // gl_FragDepth = gl_FragCoord.z;
-}
\ No newline at end of file
+
+    // The first two moments of depth, with the second one widened by the depth slope across the fragment to
+    // keep surfaces from shadowing themselves
+    float depth = gl_FragCoord.z;
+    float dx = dFdx(depth);
+    float dy = dFdy(depth);
+    o_moments = vec2(depth, depth * depth + 0.25 * (dx * dx + dy * dy));
+}
@@ -4,10 +4,27 @@ layout(location = 0) in vec3 i_position;
 layout(location = 1) in vec3 i_color;
 layout(location = 2) in vec2 i_texture_coordinates;
 
-uniform mat4 u_light_space_matrix;
+// Shared by every program that draws the scene (see `graphics::FrameUniforms`)
+layout(std140, binding = 0) uniform FrameUniforms
+{
+    mat4 u_projection;
+    mat4 u_view;
+    mat4 u_light_space_matrix;
+    float u_time;
+};
+
 uniform mat4 u_model;
 
+#include "fibration.glsl"
+
 void main()
 {
-    gl_Position = u_light_space_matrix * u_model * vec4(i_position, 1.0);
+    vec3 position = i_position;
+
+    if (u_s3_positions || u_instanced_fibers)
+    {
+        position = fiber_position(rotated_fiber_point(i_position, i_texture_coordinates), i_texture_coordinates, gl_InstanceID);
+    }
+
+    gl_Position = u_light_space_matrix * u_model * vec4(position, 1.0);
 }
\ No newline at end of file
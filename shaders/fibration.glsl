@@ -0,0 +1,102 @@
+// The uniforms and functions that sweep out, rotate and project fibers, shared by every shader that
+// pastes this file in with `#include "fibration.glsl"` (see `graphics::Shader::read_shader_file()`)
+
+// Set when the vertices are unprojected points on S3 (see `hopf::generate_fibration_s3()`), with
+// `w` stored in the first texture coordinate
+uniform bool u_s3_positions;
+
+// Set when drawing one fiber per instance (see `graphics::Mesh::draw_instanced()`): `i_position` is
+// then the fiber's (unrotated) base point on S2 and `i_texture_coordinates` holds cos(phi) and sin(phi)
+uniform bool u_instanced_fibers;
+
+// Unit quaternion (vector part in `xyz`, scalar part in `w`) that S3 vertices are rotated by
+uniform vec4 u_rotation;
+
+// 0: modified stereographic projection onto the unit ball, 1: stereographic projection
+uniform int u_projection_mode;
+
+// Set when drawing one analytic circle per instance (see `hopf::get_fiber_circles()`): the fiber is then
+// swept out around the circle in `fiber_circles` instead of being projected (only valid for the
+// stereographic projection)
+uniform bool u_circle_fibers;
+
+// Two entries per fiber: the center and radius, then the normal (see `Circle`)
+layout(std430, binding = 1) readonly buffer FiberCircles
+{
+    vec4 fiber_circles[];
+};
+
+const float PI = 3.14159265359;
+
+vec4 multiply_quaternions(vec4 a, vec4 b)
+{
+    return vec4(a.w * b.xyz + b.w * a.xyz + cross(a.xyz, b.xyz), a.w * b.w - dot(a.xyz, b.xyz));
+}
+
+// Matches `hopf::generate_fibration_s3()` (and `hopf::kernel::sweep_fiber_table()`)
+vec4 fiber_point(vec3 base_point, vec2 phase)
+{
+    float len = length(base_point.xy);
+    vec2 theta_0 = len > 0.0 ? vec2(base_point.y, -base_point.x) / len : vec2(1.0, 0.0);
+    float alpha = sqrt((1.0 + base_point.z) * 0.5);
+    float beta = sqrt((1.0 - base_point.z) * 0.5);
+
+    return vec4(alpha * (theta_0.y * phase.x - theta_0.x * phase.y),
+                beta * phase.x,
+                beta * phase.y,
+                alpha * (theta_0.x * phase.x + theta_0.y * phase.y));
+}
+
+// The modified stereographic projection onto the unit ball
+vec3 project_modified(vec4 q)
+{
+    float w = clamp(q.w, -1.0, 1.0);
+    float sine = sqrt(1.0 - w * w);
+    float scale = sine > 1e-6 ? acos(w) / PI / sine : 1.0 / PI;
+
+    return q.xyz * scale;
+}
+
+// Matches `hopf::project_point()`
+vec3 project(vec4 q)
+{
+    if (u_projection_mode == 1)
+    {
+        return q.xyz / (1.0 - q.w);
+    }
+
+    return project_modified(q);
+}
+
+// The point at cos(phi) and sin(phi) on the circle (or line, if the radius is 0) of fiber `fiber`
+vec3 circle_point(int fiber, vec2 phase)
+{
+    vec4 center_radius = fiber_circles[2 * fiber + 0];
+    vec3 normal = fiber_circles[2 * fiber + 1].xyz;
+
+    if (center_radius.w == 0.0)
+    {
+        // Like the projected fiber, this reaches infinity at phi = pi
+        return center_radius.xyz + normal * (phase.y / (1.0 + phase.x));
+    }
+
+    vec3 helper = abs(normal.x) < 0.9 ? vec3(1.0, 0.0, 0.0) : vec3(0.0, 1.0, 0.0);
+    vec3 u = normalize(cross(normal, helper));
+    vec3 v = cross(normal, u);
+
+    return center_radius.xyz + center_radius.w * (u * phase.x + v * phase.y);
+}
+
+// The rotated point on S3 of a vertex that `u_s3_positions` or `u_instanced_fibers` applies to
+vec4 rotated_fiber_point(vec3 position, vec2 texture_coordinates)
+{
+    vec4 s3_position = u_instanced_fibers ? fiber_point(position, texture_coordinates) : vec4(position, texture_coordinates.x);
+
+    return multiply_quaternions(u_rotation, s3_position);
+}
+
+// Where the rotated point `q` on S3 is drawn (on the circle of instance `fiber`, when `u_circle_fibers` is set)
+vec3 fiber_position(vec4 q, vec2 texture_coordinates, int fiber)
+{
+    return u_circle_fibers ? circle_point(fiber, texture_coordinates) : project(q);
+}
@@ -1,7 +1,17 @@
 #version 460
 
 uniform bool u_display_shadows;
+
+// 0: 7x7 PCF with a manual comparison per texel (49 fetches), 1: 3x3 hardware-filtered comparisons (9 fetches),
+// 2: variance shadow map (1 fetch), see `graphics::ShadowTechnique`
+uniform int u_shadow_technique;
+
+// The same depth map, once as it is and once with comparisons enabled (see `graphics::ShadowMap::bind()`)
 layout(location = 0) uniform sampler2D u_depth_map;
+layout(binding = 1) uniform sampler2DShadow u_shadow_map;
+
+// The first two moments of depth, blurred (for variance shadow mapping)
+layout(binding = 2) uniform sampler2D u_moment_map;
 
 layout(location = 0) out vec4 o_color;
 
@@ -11,6 +21,64 @@ in VS_OUT
     vec4 light_space_position;
 } fs_in;
 
+const float bias = 0.005;
+
+float get_shadow_pcf(vec3 coordinates)
+{
+	float shadow = 0.0;
+
+	const vec2 texel_size = 1.0 / textureSize(u_depth_map, 0);
+	const int kernel_steps = 3;
+	for(int x = -kernel_steps; x <= kernel_steps; ++x)
+	{
+	    for(int y = -kernel_steps; y <= kernel_steps; ++y)
+	    {
+	        float percentage_close = texture(u_depth_map, coordinates.xy + vec2(x, y) * texel_size).r; 
+	        shadow += coordinates.z - bias > percentage_close ? 1.0 : 0.0;        
+	    }    
+	}
+
+	// Normalize based on number of steps
+	return shadow / pow(kernel_steps * 2.0 + 1.0, 2.0);
+}
+
+float get_shadow_hardware_pcf(vec3 coordinates)
+{
+	// Each fetch compares the 4 nearest texels and blends the results bilinearly, so 3x3 fetches that are
+	// 2 texels apart cover about as much of the map as the 7x7 kernel above
+	float lit = 0.0;
+
+	const vec2 texel_size = 1.0 / textureSize(u_shadow_map, 0);
+	for(int x = -1; x <= 1; ++x)
+	{
+	    for(int y = -1; y <= 1; ++y)
+	    {
+	        lit += texture(u_shadow_map, vec3(coordinates.xy + vec2(x, y) * 2.0 * texel_size, coordinates.z - bias));
+	    }
+	}
+
+	return 1.0 - lit / 9.0;
+}
+
+float get_shadow_variance(vec3 coordinates)
+{
+	const vec2 moments = texture(u_moment_map, coordinates.xy).xy;
+	if (coordinates.z <= moments.x)
+	{
+		return 0.0;
+	}
+
+	// Chebyshev's inequality bounds the fraction of the filtered area that is closer to the light
+	const float variance = max(moments.y - moments.x * moments.x, 0.00002);
+	const float distance = coordinates.z - moments.x;
+	float lit = variance / (variance + distance * distance);
+
+	// Cut off the tail of the bound, which otherwise lets light bleed through overlapping occluders
+	lit = clamp((lit - 0.2) / 0.8, 0.0, 1.0);
+
+	return 1.0 - lit;
+}
+
 void main() 
 {	
 	float shadow = 0.0;
@@ -22,24 +90,19 @@ void main()
 		// Transform NDC coordinates from -1..1 to 0..1
 		projection_space_coordinates = projection_space_coordinates * 0.5 + 0.5;
 
-		// Grab the current fragment depth
-		float current = projection_space_coordinates.z;
-
 		// Filtering
-		const float bias = 0.005;
-		const vec2 texel_size = 1.0 / textureSize(u_depth_map, 0);
-		const int kernel_steps = 3;
-		for(int x = -kernel_steps; x <= kernel_steps; ++x)
+		if (u_shadow_technique == 1)
 		{
-		    for(int y = -kernel_steps; y <= kernel_steps; ++y)
-		    {
-		        float percentage_close = texture(u_depth_map, projection_space_coordinates.xy + vec2(x, y) * texel_size).r; 
-		        shadow += current - bias > percentage_close ? 1.0 : 0.0;        
-		    }    
+			shadow = get_shadow_hardware_pcf(projection_space_coordinates);
+		}
+		else if (u_shadow_technique == 2)
+		{
+			shadow = get_shadow_variance(projection_space_coordinates);
+		}
+		else
+		{
+			shadow = get_shadow_pcf(projection_space_coordinates);
 		}
-
-		// Normalize based on number of steps
-		shadow /= pow(kernel_steps * 2.0 + 1.0, 2.0);
 
 		// Prevent shadows from being 100% black
 		shadow = min(shadow, 0.2);
@@ -47,4 +110,4 @@ void main()
 
 	//o_color = vec4(vec3(depth_read), 1.0);
 	o_color = vec4(fs_in.color * (1.0 - shadow), 1.0);
-}
\ No newline at end of file
+}
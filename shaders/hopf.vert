@@ -1,15 +1,29 @@
 #version 460
 
-uniform mat4 u_light_space_matrix;
-uniform float u_time;
+// Shared by every program that draws the scene (see `graphics::FrameUniforms`)
+layout(std140, binding = 0) uniform FrameUniforms
+{
+    mat4 u_projection;
+    mat4 u_view;
+    mat4 u_light_space_matrix;
+    float u_time;
+};
 
-uniform mat4 u_projection;
-uniform mat4 u_view;
 uniform mat4 u_model;
 
+// Set when the vertices are compact (see `graphics::VertexFormat::Compact`): `i_color` is then unused, and
+// the color of each vertex is looked up by `i_fiber` instead
+uniform bool u_fiber_colors;
+
+layout(std430, binding = 0) readonly buffer FiberColors
+{
+    vec4 fiber_colors[];
+};
+
 layout(location = 0) in vec3 i_position;
 layout(location = 1) in vec3 i_color;
 layout(location = 2) in vec2 i_texture_coordinates;
+layout(location = 3) in uint i_fiber;
 
 out VS_OUT
 {
@@ -17,12 +31,26 @@ out VS_OUT
     vec4 light_space_position;
 } vs_out;
 
+#include "fibration.glsl"
 
 void main() 
 {
+    vec3 position = i_position;
+    vec3 color = u_fiber_colors ? fiber_colors[i_fiber].rgb : i_color;
+
+    if (u_s3_positions || u_instanced_fibers)
+    {
+        vec4 q = rotated_fiber_point(i_position, i_texture_coordinates);
+        position = fiber_position(q, i_texture_coordinates, gl_InstanceID);
+
+        // Color by the (rotated) base point, which the Hopf map recovers from any point on its fiber
+        vec3 base_point = vec3(-2.0 * (q.w * q.z + q.x * q.y), 2.0 * (q.w * q.y - q.x * q.z), q.w * q.w + q.x * q.x - q.y * q.y - q.z * q.z);
+        color = base_point * 0.5 + 0.5;
+    }
+
     gl_PointSize = 4.0;
-    gl_Position = u_projection * u_view * u_model * vec4(i_position, 1.0);
+    gl_Position = u_projection * u_view * u_model * vec4(position, 1.0);
 
-    vs_out.color = i_color;
-    vs_out.light_space_position = u_light_space_matrix * u_model * vec4(i_position, 1.0);
+    vs_out.color = color;
+    vs_out.light_space_position = u_light_space_matrix * u_model * vec4(position, 1.0);
 }
\ No newline at end of file
@@ -1,8 +1,14 @@
 #version 460
 
-uniform float u_time;
-uniform mat4 u_projection;
-uniform mat4 u_view;
+// Shared by every program that draws the scene (see `graphics::FrameUniforms`)
+layout(std140, binding = 0) uniform FrameUniforms
+{
+    mat4 u_projection;
+    mat4 u_view;
+    mat4 u_light_space_matrix;
+    float u_time;
+};
+
 uniform mat4 u_model;
 
 layout(location = 0) in vec3 i_position;
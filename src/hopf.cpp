@@ -0,0 +1,1201 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+#include "gtc/matrix_transform.hpp"
+
+#include "hopf.h"
+#include "utils.h"
+#include "worker_pool.h"
+
+namespace hopf
+{
+
+    const std::vector<std::string>& get_modes()
+    {
+        static const std::vector<std::string> modes = { "Great Circle", "Random", "Loxodrome", "Curl" };
+        return modes;
+    }
+
+    glm::mat4 get_rotation_matrix(const Parameters& parameters)
+    {
+        glm::mat4 rotation_matrix{ 1.0f };
+        rotation_matrix = glm::rotate(rotation_matrix, parameters.rotation_x, glm::vec3{ 1.0f, 0.0f, 0.0f });
+        rotation_matrix = glm::rotate(rotation_matrix, parameters.rotation_y, glm::vec3{ 0.0f, 1.0f, 0.0f });
+        rotation_matrix = glm::rotate(rotation_matrix, parameters.rotation_z, glm::vec3{ 0.0f, 0.0f, 1.0f });
+
+        return rotation_matrix;
+    }
+
+    /**
+     * Returns the product `a * b` of two quaternions (vector part in `xyz`, scalar part in `w`).
+     */
+    glm::vec4 multiply_quaternions(const glm::vec4& a, const glm::vec4& b)
+    {
+        const glm::vec3 u{ a.x, a.y, a.z };
+        const glm::vec3 v{ b.x, b.y, b.z };
+
+        return glm::vec4{ v * a.w + u * b.w + glm::cross(u, v), a.w * b.w - glm::dot(u, v) };
+    }
+
+    /**
+     * Returns the unit quaternion for a right-handed rotation by `angle` around the unit vector `axis`.
+     */
+    glm::vec4 axis_angle_quaternion(const glm::vec3& axis, float angle)
+    {
+        return glm::vec4{ axis * sinf(angle * 0.5f), cosf(angle * 0.5f) };
+    }
+
+    glm::vec4 get_rotation_quaternion(const Parameters& parameters)
+    {
+        // The fibers above `p` are mapped back onto `p` by q -> q * i * conj(q), which (as a vector in
+        // <i, j, k>) is `L * p` for the orientation-preserving isometry L(a, b, c) = <c, -a, -b>. So
+        // rotating every base point by an angle around some axis is the same as left-multiplying every
+        // point on S3 by the quaternion for that angle around the axis carried over by L
+        const glm::vec4 rotation_x = axis_angle_quaternion(glm::vec3{ 0.0f, -1.0f, 0.0f }, parameters.rotation_x);
+        const glm::vec4 rotation_y = axis_angle_quaternion(glm::vec3{ 0.0f, 0.0f, -1.0f }, parameters.rotation_y);
+        const glm::vec4 rotation_z = axis_angle_quaternion(glm::vec3{ 1.0f, 0.0f, 0.0f }, parameters.rotation_z);
+
+        // Same order as `get_rotation_matrix()`
+        return multiply_quaternions(multiply_quaternions(rotation_x, rotation_y), rotation_z);
+    }
+
+    glm::vec3 project_point(const glm::vec4& q, Projection projection)
+    {
+        const glm::vec3 v{ q.x, q.y, q.z };
+
+        if (projection == Projection::Stereographic)
+        {
+            return v / (1.0f - q.w);
+        }
+
+        // Modified stereographic projection (see `fiber_point()`), with its limit at the pole filled in
+        const float w = std::min(std::max(q.w, -1.0f), 1.0f);
+        const float sine = sqrtf(1.0f - w * w);
+        const float scale = (sine > 1e-6f) ? acosf(w) / glm::pi<float>() / sine : 1.0f / glm::pi<float>();
+
+        return v * scale;
+    }
+
+    const char* to_string(Projection projection)
+    {
+        switch (projection)
+        {
+        case Projection::Stereographic: return "Stereographic";
+        default: return "Modified Stereographic";
+        }
+    }
+
+    std::vector<Vertex> calculate_base_points_great_circle(const Parameters& parameters, const glm::mat4& transform)
+    {
+        std::vector<Vertex> base_points;
+        base_points.reserve(parameters.number_of_circles * parameters.number_of_fibers);
+
+        if (parameters.offsets.size() < parameters.number_of_circles || parameters.arc_angles.size() < parameters.number_of_circles)
+        {
+            throw std::runtime_error("Each great circle needs both an offset and an arc angle");
+        }
+
+        for (size_t i = 0; i < parameters.number_of_circles; ++i)
+        {
+            const float offset = parameters.offsets[i];
+            const float arc_angle = parameters.arc_angles[i];
+
+            const auto thetas = utils::linear_spacing(0.0f, arc_angle, parameters.number_of_fibers);
+
+            for (const auto theta : thetas)
+            {
+                const float c = cosf(theta) * (1.0f - fabsf(offset));
+                const float s = sinf(theta) * (1.0f - fabsf(offset));
+
+                const glm::vec3 position = glm::vec3{ transform * glm::vec4{ c, s, offset, 1.0f } };
+
+                Vertex vertex;
+
+                vertex.position = position;
+                vertex.color = vertex.position * 0.5f + 0.5f;
+                vertex.texture_coordinate = { 0.0f, 0.0f };
+
+                base_points.push_back(vertex);
+            }
+        }
+
+        return base_points;
+    }
+
+    std::vector<Vertex> calculate_base_points_random(const Parameters& parameters, const glm::mat4& transform)
+    {
+        std::vector<Vertex> base_points;
+        base_points.reserve(parameters.number_of_fibers);
+
+        // Create a normal (Gaussian) distribution generator
+        std::default_random_engine generator{ parameters.seed };
+        std::normal_distribution<float> distribution(parameters.mean, parameters.standard_deviation);
+
+        for (size_t i = 0; i < parameters.number_of_fibers; ++i)
+        {
+            const auto rand_x = distribution(generator);
+            const auto rand_y = distribution(generator);
+            const auto rand_z = distribution(generator);
+
+            const float radius = 1.0f;
+
+            Vertex vertex;
+            vertex.position = glm::vec3{ transform * glm::vec4{ glm::normalize(glm::vec3{ rand_x, rand_y, rand_z }) * radius, 1.0f} };
+            vertex.color = vertex.position * 0.5f + 0.5f;
+            vertex.texture_coordinate = { 0.0f, 0.0f };
+
+            base_points.push_back(vertex);
+        }
+
+        return base_points;
+    }
+
+    std::vector<Vertex> calculate_base_points_loxodrome(const Parameters& parameters, const glm::mat4& transform)
+    {
+        std::vector<Vertex> base_points;
+        base_points.reserve(parameters.number_of_fibers);
+
+        // Don't go all the way to `pi / 2` because there are discontinuities at the poles
+        auto thetas = utils::linear_spacing(-glm::pi<float>() * 0.45f, glm::pi<float>() * 0.45f, parameters.number_of_fibers);
+
+        for (size_t i = 0; i < parameters.number_of_fibers; ++i)
+        {
+            const float radius = 1.0f;
+
+            const float x = radius * cosf(thetas[i]) * cosf(thetas[i] * parameters.loxodrome_offset);
+            const float y = radius * cosf(thetas[i]) * sinf(thetas[i] * parameters.loxodrome_offset);
+            const float z = radius * sinf(thetas[i]);
+
+            Vertex vertex;
+            vertex.position = glm::vec3{ transform * glm::vec4{ x, y, z, 1.0f } };
+            vertex.color = vertex.position * 0.5f + 0.5f;
+            vertex.texture_coordinate = { 0.0f, 0.0f };
+
+            base_points.push_back(vertex);
+        }
+
+        return base_points;
+    }
+
+    std::vector<Vertex> calculate_base_points_curl(const Parameters& parameters, const glm::mat4& transform)
+    {
+        std::vector<Vertex> base_points;
+        base_points.reserve(parameters.number_of_fibers);
+
+        auto thetas = utils::linear_spacing(0.0f, glm::two_pi<float>(), parameters.number_of_fibers);
+
+        for (size_t i = 0; i < parameters.number_of_fibers; ++i)
+        {
+            const float theta = thetas[i];
+            const float radius = 1.0f;
+
+            float coeff_x = sinf(theta * parameters.curl_alpha) * parameters.curl_beta;
+            float coeff_y = cosf(theta * parameters.curl_alpha) * parameters.curl_beta;
+
+            float x = radius * coeff_x + cosf(theta);
+            float y = radius * coeff_y + sinf(theta);
+            float z = 0.0f;
+
+            // Stereographic projection onto a sphere
+            Vertex vertex;
+            vertex.position = glm::vec3{ transform * glm::vec4{
+                (2.0f * x) / (1.0f + x * x + y * y),
+                (2.0f * y) / (1.0f + x * x + y * y),
+                (-1.0f + x * x + y * y) / (1.0f + x * x + y * y),
+                1.0f
+            } };
+            vertex.color = vertex.position * 0.5f + 0.5f;
+            vertex.texture_coordinate = { 0.0f, 0.0f };
+
+            base_points.push_back(vertex);
+        }
+
+        return base_points;
+    }
+
+    std::vector<Vertex> get_base_points(const Parameters& parameters)
+    {
+        const glm::mat4 transform = get_rotation_matrix(parameters);
+
+        std::vector<Vertex> base_points;
+
+        if (parameters.mode == "Great Circle")
+        {
+            base_points = calculate_base_points_great_circle(parameters, transform);
+        }
+        else if (parameters.mode == "Random")
+        {
+            base_points = calculate_base_points_random(parameters, transform);
+        }
+        else if (parameters.mode == "Loxodrome")
+        {
+            base_points = calculate_base_points_loxodrome(parameters, transform);
+        }
+        else if (parameters.mode == "Curl")
+        {
+            base_points = calculate_base_points_curl(parameters, transform);
+        }
+        else
+        {
+            throw std::runtime_error("Attempting to calculate base points from unknown mode");
+        }
+
+        return base_points;
+    }
+
+    /**
+     * Returns the point at angle `phi` along the fiber above the base point `<a, b, c>` on S2,
+     * projected into 3-space.
+     */
+    inline glm::vec3 fiber_point(float a, float b, float c, float phi)
+    {
+        // Points in 4-space: a rotation by the quaternion <x, y, z, w> would send the
+        // point <0, 0, 1> on S2 to the point <a, b, c> - thus, each base point sweeps
+        // out a great circle ("fiber") on S2
+        const float theta = atan2f(-a, b) - phi;
+        const float alpha = sqrtf((1.0f + c) / 2.0f);
+        const float beta = sqrtf((1.0f - c) / 2.0f);
+
+        const float	w = alpha * cosf(theta);
+        const float	x = alpha * sinf(theta);
+        const float	y = beta * cosf(phi);
+        const float	z = beta * sinf(phi);
+
+        // Modified stereographic projection onto the unit ball in 3-space from:
+        // https://nilesjohnson.net/hopf-production.html
+        const float r = acosf(w) / glm::pi<float>();
+        const float projection = r / sqrtf(1.0f - w * w);
+
+        return glm::vec3{
+            projection * x,
+            projection * y,
+            projection * z
+        };
+    }
+
+    /**
+     * Writes the vertices of the fiber that starts at vertex `first_vertex` (whose projected positions
+     * are given in structure-of-arrays form) and the corresponding indices, followed by a primitive
+     * restart index. If `ws` is given, the vertices are points on S3 (see `generate_fibration_s3()`).
+     */
+    void write_fiber(const Vertex& point, size_t first_vertex, size_t iterations_per_fiber, const float* xs, const float* ys, const float* zs, Vertex* vertices, uint32_t* indices, const float* ws = nullptr)
+    {
+        const glm::vec3 color = point.position * 0.5f + 0.5f;
+
+        for (size_t j = 0; j < iterations_per_fiber; ++j)
+        {
+            Vertex& vertex = vertices[j];
+
+            vertex.position = glm::vec3{ xs[j], ys[j], zs[j] };
+            vertex.color = color;
+            vertex.texture_coordinate = glm::vec2{
+                ws ? ws[j] : 0.0f, // The w coordinate of unprojected (S3) vertices
+                0.0f
+            };
+
+            indices[j] = static_cast<uint32_t>(first_vertex + j);
+        }
+
+        // Primitive restart
+        indices[iterations_per_fiber] = std::numeric_limits<uint32_t>::max();
+    }
+
+    /**
+     * Writes the `phis.size()` vertices of the fiber above `point` (which starts at vertex `first_vertex`)
+     * to `vertices` and the corresponding indices (followed by a primitive restart index) to `indices`.
+     */
+    void sweep_fiber(const Vertex& point, size_t first_vertex, const std::vector<float>& phis, Vertex* vertices, uint32_t* indices)
+    {
+        const size_t iterations_per_fiber = phis.size();
+
+        // Grab the current base point on S2
+        const float a = point.position.x;
+        const float b = point.position.y;
+        const float c = point.position.z;
+
+        // Every `iterations_per_fiber` points (in 4-space) form a single fiber of the Hopf fibration
+        for (size_t j = 0; j < iterations_per_fiber; ++j)
+        {
+            Vertex& vertex = vertices[j];
+
+            vertex.position = fiber_point(a, b, c, phis[j]);
+            vertex.color = glm::vec3{
+                a * 0.5f + 0.5f,
+                b * 0.5f + 0.5f,
+                c * 0.5f + 0.5f
+            };
+            vertex.texture_coordinate = glm::vec2{
+                0.0f, // Unused, at the moment
+                0.0f
+            };
+
+            indices[j] = static_cast<uint32_t>(first_vertex + j);
+        }
+
+        // Primitive restart
+        indices[iterations_per_fiber] = std::numeric_limits<uint32_t>::max();
+    }
+
+    /**
+     * Builds the phase table for `phis` (see `get_phase_table()`).
+     */
+    std::shared_ptr<const PhaseTable> make_phase_table(const std::vector<float>& phis)
+    {
+        // Sample at exactly the same (single-precision) angles as the other kernels, but take
+        // the cosine and sine in double precision, so the table adds no error of its own
+        auto table = std::make_shared<PhaseTable>();
+        table->cos_phi.reserve(phis.size());
+        table->sin_phi.reserve(phis.size());
+
+        for (const float phi : phis)
+        {
+            table->cos_phi.push_back(static_cast<float>(std::cos(static_cast<double>(phi))));
+            table->sin_phi.push_back(static_cast<float>(std::sin(static_cast<double>(phi))));
+        }
+
+        return table;
+    }
+
+    std::shared_ptr<const PhaseTable> get_phase_table(size_t iterations_per_fiber)
+    {
+        static std::mutex mutex;
+        static std::shared_ptr<const PhaseTable> cached;
+
+        std::lock_guard<std::mutex> lock{ mutex };
+
+        if (!cached || cached->cos_phi.size() != iterations_per_fiber)
+        {
+            cached = make_phase_table(utils::linear_spacing(0.0f, glm::two_pi<float>(), iterations_per_fiber));
+        }
+
+        return cached;
+    }
+
+    std::vector<Vertex> get_fiber_template(size_t iterations_per_fiber)
+    {
+        const auto table = get_phase_table(iterations_per_fiber);
+
+        std::vector<Vertex> vertices(iterations_per_fiber);
+        for (size_t j = 0; j < iterations_per_fiber; ++j)
+        {
+            vertices[j].position = glm::vec3{ 0.0f };
+            vertices[j].color = glm::vec3{ 0.0f };
+            vertices[j].texture_coordinate = glm::vec2{ table->cos_phi[j], table->sin_phi[j] };
+        }
+
+        return vertices;
+    }
+
+    /**
+     * Returns `true` if the job that `settings` belongs to has been cancelled (see `GeneratorSettings::cancel`).
+     */
+    inline bool is_cancelled(const GeneratorSettings& settings)
+    {
+        return settings.cancel != nullptr && settings.cancel->load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Sweeps the fiber above a base point into structure-of-arrays scratch space.
+     */
+    using FiberSweep = std::function<void(const glm::vec3& point, float* xs, float* ys, float* zs)>;
+
+    /**
+     * Returns the per-fiber sweep for `settings.kernel`, sampling at the angles in `phis` (whose cosines
+     * and sines are in `table`, which is only read by `SweepKernel::PhaseTable`).
+     */
+    FiberSweep get_fiber_sweep(const std::vector<float>& phis, const std::shared_ptr<const PhaseTable>& table, const GeneratorSettings& settings)
+    {
+        switch (settings.kernel)
+        {
+        case SweepKernel::Vectorized:
+        {
+            const SweepFunction sweep = get_sweep_function(settings.isa);
+
+            return [&phis, sweep](const glm::vec3& point, float* xs, float* ys, float* zs)
+            {
+                sweep(point.x, point.y, point.z, phis.data(), phis.size(), xs, ys, zs);
+            };
+        }
+        case SweepKernel::PhaseTable:
+        {
+            const TableSweepFunction sweep = get_table_sweep_function(settings.isa);
+
+            return [table, sweep](const glm::vec3& point, float* xs, float* ys, float* zs)
+            {
+                sweep(point.x, point.y, point.z, table->cos_phi.data(), table->sin_phi.data(), table->cos_phi.size(), xs, ys, zs);
+            };
+        }
+        default:
+            return [&phis](const glm::vec3& point, float* xs, float* ys, float* zs)
+            {
+                for (size_t j = 0; j < phis.size(); ++j)
+                {
+                    const glm::vec3 position = fiber_point(point.x, point.y, point.z, phis[j]);
+
+                    xs[j] = position.x;
+                    ys[j] = position.y;
+                    zs[j] = position.z;
+                }
+            };
+        }
+    }
+
+    /**
+     * Returns the per-fiber sweep for `settings.kernel`, sampling at all of the angles in `phis`.
+     */
+    FiberSweep get_fiber_sweep(const std::vector<float>& phis, const GeneratorSettings& settings)
+    {
+        return get_fiber_sweep(phis, settings.kernel == SweepKernel::PhaseTable ? get_phase_table(phis.size()) : nullptr, settings);
+    }
+
+    /**
+     * Sweeps the fiber above `point` on S3 (without projecting it, see `generate_fibration_s3()`) at the
+     * `count` angles whose cosines and sines are given.
+     */
+    void sweep_fiber_s3(const glm::vec3& point, const float* cos_phis, const float* sin_phis, size_t count, float* xs, float* ys, float* zs, float* ws)
+    {
+        const float a = point.x;
+        const float b = point.y;
+        const float c = point.z;
+
+        // See `kernel::sweep_fiber_table()`
+        const float length = sqrtf(a * a + b * b);
+        const float cos_theta_0 = length > 0.0f ? b / length : 1.0f;
+        const float sin_theta_0 = length > 0.0f ? -a / length : 0.0f;
+        const float alpha = sqrtf((1.0f + c) / 2.0f);
+        const float beta = sqrtf((1.0f - c) / 2.0f);
+
+        for (size_t j = 0; j < count; ++j)
+        {
+            const float cos_phi = cos_phis[j];
+            const float sin_phi = sin_phis[j];
+
+            ws[j] = alpha * (cos_theta_0 * cos_phi + sin_theta_0 * sin_phi);
+            xs[j] = alpha * (sin_theta_0 * cos_phi - cos_theta_0 * sin_phi);
+            ys[j] = beta * cos_phi;
+            zs[j] = beta * sin_phi;
+        }
+    }
+
+    graphics::MeshData generate_fibration(const std::vector<Vertex>& base_points, size_t iterations_per_fiber, const GeneratorSettings& settings)
+    {
+        // Every fiber writes to its own, fixed range of the output, so the buffers can be sized
+        // up-front and filled in any order
+        std::vector<Vertex> vertices(base_points.size() * iterations_per_fiber);
+        std::vector<uint32_t> indices(base_points.size() * (iterations_per_fiber + 1));
+
+        generate_fibration(base_points, iterations_per_fiber, settings, vertices.data(), indices.data());
+
+        return { std::move(vertices), std::move(indices) };
+    }
+
+    void generate_fibration(const std::vector<Vertex>& base_points, size_t iterations_per_fiber, const GeneratorSettings& settings, Vertex* vertices, uint32_t* indices)
+    {
+        const auto phis = utils::linear_spacing(0.0f, glm::two_pi<float>(), iterations_per_fiber);
+
+        if (settings.kernel != SweepKernel::Reference)
+        {
+            const FiberSweep sweep = get_fiber_sweep(phis, settings);
+
+            utils::WorkerPool::get_shared().parallel_for(base_points.size(), settings.thread_count, [&](size_t begin, size_t end)
+            {
+                // The kernels work in structure-of-arrays form, so sweep each fiber into scratch
+                // space and then interleave it into the vertex buffer
+                std::vector<float> xs(iterations_per_fiber);
+                std::vector<float> ys(iterations_per_fiber);
+                std::vector<float> zs(iterations_per_fiber);
+
+                for (size_t i = begin; i < end && !is_cancelled(settings); ++i)
+                {
+                    sweep(base_points[i].position, xs.data(), ys.data(), zs.data());
+
+                    write_fiber(base_points[i], i * iterations_per_fiber, iterations_per_fiber, xs.data(), ys.data(), zs.data(), &vertices[i * iterations_per_fiber], &indices[i * (iterations_per_fiber + 1)]);
+                }
+            });
+        }
+        else
+        {
+            utils::WorkerPool::get_shared().parallel_for(base_points.size(), settings.thread_count, [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end && !is_cancelled(settings); ++i)
+                {
+                    sweep_fiber(base_points[i], i * iterations_per_fiber, phis, &vertices[i * iterations_per_fiber], &indices[i * (iterations_per_fiber + 1)]);
+                }
+            });
+        }
+    }
+
+    graphics::MeshData generate_fibration_s3(const std::vector<Vertex>& base_points, size_t iterations_per_fiber, const GeneratorSettings& settings)
+    {
+        std::vector<Vertex> vertices(base_points.size() * iterations_per_fiber);
+        std::vector<uint32_t> indices(base_points.size() * (iterations_per_fiber + 1));
+
+        generate_fibration_s3(base_points, iterations_per_fiber, settings, vertices.data(), indices.data());
+
+        return { std::move(vertices), std::move(indices) };
+    }
+
+    void generate_fibration_s3(const std::vector<Vertex>& base_points, size_t iterations_per_fiber, const GeneratorSettings& settings, Vertex* vertices, uint32_t* indices)
+    {
+        // There is no projection to approximate, so every kernel produces the same points from the phase table
+        const auto table = get_phase_table(iterations_per_fiber);
+
+        utils::WorkerPool::get_shared().parallel_for(base_points.size(), settings.thread_count, [&](size_t begin, size_t end)
+        {
+            std::vector<float> xs(iterations_per_fiber);
+            std::vector<float> ys(iterations_per_fiber);
+            std::vector<float> zs(iterations_per_fiber);
+            std::vector<float> ws(iterations_per_fiber);
+
+            for (size_t i = begin; i < end && !is_cancelled(settings); ++i)
+            {
+                sweep_fiber_s3(base_points[i].position, table->cos_phi.data(), table->sin_phi.data(), iterations_per_fiber, xs.data(), ys.data(), zs.data(), ws.data());
+
+                write_fiber(base_points[i], i * iterations_per_fiber, iterations_per_fiber, xs.data(), ys.data(), zs.data(), &vertices[i * iterations_per_fiber], &indices[i * (iterations_per_fiber + 1)], ws.data());
+            }
+        });
+    }
+
+    std::vector<size_t> get_adaptive_sample_counts(const std::vector<Vertex>& base_points, size_t max_samples, size_t vertex_budget, size_t min_samples)
+    {
+        min_samples = std::min(min_samples, max_samples);
+
+        // Trace each fiber coarsely and measure how far the midpoint of each segment strays from the chord
+        // between its ends: the error of `n` evenly spaced samples falls off as `1 / n^2`, so keeping it the
+        // same for every fiber takes `n ~ sqrt(e)`, where `e` is the largest such distance
+        const size_t coarse_samples = 32;
+        std::vector<float> demands(base_points.size());
+
+        for (size_t i = 0; i < base_points.size(); ++i)
+        {
+            const glm::vec3& point = base_points[i].position;
+
+            glm::vec3 samples[coarse_samples * 2];
+            for (size_t k = 0; k < coarse_samples * 2; ++k)
+            {
+                samples[k] = fiber_point(point.x, point.y, point.z, glm::pi<float>() * k / coarse_samples);
+            }
+
+            float deviation = 0.0f;
+            for (size_t k = 0; k < coarse_samples; ++k)
+            {
+                const glm::vec3& start = samples[k * 2];
+                const glm::vec3& middle = samples[k * 2 + 1];
+                const glm::vec3& end = samples[(k * 2 + 2) % (coarse_samples * 2)];
+
+                deviation = std::max(deviation, glm::length(middle - (start + end) * 0.5f));
+            }
+
+            demands[i] = std::sqrt(deviation);
+        }
+
+        // Counts are rounded up to a multiple of this, so that fibers can share angles
+        const size_t granularity = 8;
+
+        std::vector<size_t> counts(base_points.size());
+        auto assign_counts = [&](double scale)
+        {
+            size_t total = 0;
+            for (size_t i = 0; i < counts.size(); ++i)
+            {
+                const double wanted = scale * demands[i];
+
+                size_t count = max_samples;
+                if (std::isfinite(wanted) && wanted < max_samples)
+                {
+                    count = (static_cast<size_t>(std::ceil(wanted)) + granularity - 1) / granularity * granularity;
+                }
+                counts[i] = glm::clamp(count, min_samples, max_samples);
+                total += counts[i];
+            }
+
+            return total;
+        };
+
+        // The total only grows with the scale, so find the largest scale that fits in the budget by bisection
+        double low = 0.0;
+        double high = 1.0;
+        while (assign_counts(high) <= vertex_budget && high < 1e12)
+        {
+            low = high;
+            high *= 2.0;
+        }
+        for (size_t step = 0; step < 50 && assign_counts(high) > vertex_budget; ++step)
+        {
+            const double middle = (low + high) * 0.5;
+            if (assign_counts(middle) <= vertex_budget)
+            {
+                low = middle;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+        assign_counts(low);
+
+        return counts;
+    }
+
+    graphics::MeshData generate_adaptive_fibration(const std::vector<Vertex>& base_points, const std::vector<size_t>& sample_counts, const GeneratorSettings& settings, bool s3_output)
+    {
+        // Each fiber starts right after the one before it (and its primitive restart)
+        std::vector<size_t> first_vertices(base_points.size() + 1, 0);
+        for (size_t i = 0; i < base_points.size(); ++i)
+        {
+            first_vertices[i + 1] = first_vertices[i] + sample_counts[i];
+        }
+
+        std::vector<Vertex> vertices(first_vertices.back());
+        std::vector<uint32_t> indices(first_vertices.back() + base_points.size());
+
+        // Fibers with the same number of samples are sampled at the same angles as in `generate_fibration()`,
+        // which only need to be set up once (a `std::map`, so that sweeps can refer to the angles)
+        struct Sampling
+        {
+            std::vector<float> phis;
+            std::shared_ptr<const PhaseTable> table;
+            FiberSweep sweep;
+        };
+        std::map<size_t, Sampling> samplings;
+        size_t max_samples = 0;
+
+        for (const size_t count : sample_counts)
+        {
+            if (samplings.count(count) != 0)
+            {
+                continue;
+            }
+
+            Sampling& sampling = samplings[count];
+            sampling.phis = utils::linear_spacing(0.0f, glm::two_pi<float>(), count);
+            sampling.table = make_phase_table(sampling.phis);
+            if (!s3_output)
+            {
+                sampling.sweep = get_fiber_sweep(sampling.phis, sampling.table, settings);
+            }
+            max_samples = std::max(max_samples, count);
+        }
+
+        utils::WorkerPool::get_shared().parallel_for(base_points.size(), settings.thread_count, [&](size_t begin, size_t end)
+        {
+            std::vector<float> xs(max_samples);
+            std::vector<float> ys(max_samples);
+            std::vector<float> zs(max_samples);
+            std::vector<float> ws(max_samples);
+
+            for (size_t i = begin; i < end && !is_cancelled(settings); ++i)
+            {
+                const size_t count = sample_counts[i];
+                const Sampling& sampling = samplings.find(count)->second;
+
+                if (s3_output)
+                {
+                    sweep_fiber_s3(base_points[i].position, sampling.table->cos_phi.data(), sampling.table->sin_phi.data(), count, xs.data(), ys.data(), zs.data(), ws.data());
+                }
+                else
+                {
+                    sampling.sweep(base_points[i].position, xs.data(), ys.data(), zs.data());
+                }
+
+                write_fiber(base_points[i], first_vertices[i], count, xs.data(), ys.data(), zs.data(), &vertices[first_vertices[i]], &indices[first_vertices[i] + i], s3_output ? ws.data() : nullptr);
+            }
+        });
+
+        return { std::move(vertices), std::move(indices) };
+    }
+
+    std::vector<RefinementLevel> get_refinement_levels(size_t number_of_fibers, size_t iterations_per_fiber, size_t coarse_fibers, size_t coarse_samples)
+    {
+        // The coarsest level uses the largest power-of-two strides that keep enough fibers and samples
+        RefinementLevel level;
+        while ((number_of_fibers + level.fiber_stride * 2 - 1) / (level.fiber_stride * 2) >= coarse_fibers)
+        {
+            level.fiber_stride *= 2;
+        }
+        while ((iterations_per_fiber + level.sample_stride * 2 - 1) / (level.sample_stride * 2) >= coarse_samples)
+        {
+            level.sample_stride *= 2;
+        }
+
+        std::vector<RefinementLevel> levels{ level };
+        while (level.fiber_stride > 1 || level.sample_stride > 1)
+        {
+            level.fiber_stride = std::max<size_t>(level.fiber_stride / 2, 1);
+            level.sample_stride = std::max<size_t>(level.sample_stride / 2, 1);
+            levels.push_back(level);
+        }
+
+        return levels;
+    }
+
+    /**
+     * Returns `begin, begin + step, ...` (up to, but not including, `end`).
+     */
+    std::vector<size_t> strided_range(size_t begin, size_t step, size_t end)
+    {
+        std::vector<size_t> values;
+        for (size_t value = begin; value < end; value += step)
+        {
+            values.push_back(value);
+        }
+
+        return values;
+    }
+
+    /**
+     * Sweeps samples `sample_begin, sample_begin + sample_step, ...` of each fiber in `fibers` into its
+     * place in the full-resolution layout of `generate_fibration()` (or `generate_fibration_s3()`, if
+     * `s3_output` is set). Indices are left alone.
+     */
+    void sweep_fibers(const std::vector<Vertex>& base_points, size_t iterations_per_fiber, const std::vector<size_t>& fibers, size_t sample_begin, size_t sample_step, const GeneratorSettings& settings, bool s3_output, Vertex* vertices)
+    {
+        if (fibers.empty() || sample_begin >= iterations_per_fiber)
+        {
+            return;
+        }
+
+        const size_t sample_count = (iterations_per_fiber - sample_begin + sample_step - 1) / sample_step;
+
+        // Pick the samples out of the full-resolution angles (rather than spacing out fewer angles), so
+        // that every vertex comes out exactly as it does in `generate_fibration()`
+        const auto all_phis = utils::linear_spacing(0.0f, glm::two_pi<float>(), iterations_per_fiber);
+        const auto full_table = get_phase_table(iterations_per_fiber);
+
+        std::vector<float> phis(sample_count);
+        auto table = std::make_shared<PhaseTable>();
+        table->cos_phi.resize(sample_count);
+        table->sin_phi.resize(sample_count);
+
+        for (size_t k = 0; k < sample_count; ++k)
+        {
+            const size_t j = sample_begin + k * sample_step;
+
+            phis[k] = all_phis[j];
+            table->cos_phi[k] = full_table->cos_phi[j];
+            table->sin_phi[k] = full_table->sin_phi[j];
+        }
+
+        const FiberSweep sweep = get_fiber_sweep(phis, table, settings);
+
+        utils::WorkerPool::get_shared().parallel_for(fibers.size(), settings.thread_count, [&](size_t begin, size_t end)
+        {
+            std::vector<float> xs(sample_count);
+            std::vector<float> ys(sample_count);
+            std::vector<float> zs(sample_count);
+            std::vector<float> ws(sample_count, 0.0f);
+
+            for (size_t k = begin; k < end && !is_cancelled(settings); ++k)
+            {
+                const size_t i = fibers[k];
+                const Vertex& point = base_points[i];
+
+                if (s3_output)
+                {
+                    sweep_fiber_s3(point.position, table->cos_phi.data(), table->sin_phi.data(), sample_count, xs.data(), ys.data(), zs.data(), ws.data());
+                }
+                else
+                {
+                    sweep(point.position, xs.data(), ys.data(), zs.data());
+                }
+
+                // See `write_fiber()`
+                const glm::vec3 color = point.position * 0.5f + 0.5f;
+                for (size_t j = 0; j < sample_count; ++j)
+                {
+                    Vertex& vertex = vertices[i * iterations_per_fiber + sample_begin + j * sample_step];
+
+                    vertex.position = glm::vec3{ xs[j], ys[j], zs[j] };
+                    vertex.color = color;
+                    vertex.texture_coordinate = glm::vec2{ ws[j], 0.0f };
+                }
+            }
+        });
+    }
+
+    void refine_fibration(const std::vector<Vertex>& base_points, size_t iterations_per_fiber, const RefinementLevel* previous, const RefinementLevel& level, const GeneratorSettings& settings, bool s3_output, Vertex* vertices)
+    {
+        const size_t number_of_fibers = base_points.size();
+        const size_t fiber_stride = level.fiber_stride;
+        const size_t sample_stride = level.sample_stride;
+
+        if (previous == nullptr)
+        {
+            sweep_fibers(base_points, iterations_per_fiber, strided_range(0, fiber_stride, number_of_fibers), 0, sample_stride, settings, s3_output, vertices);
+            return;
+        }
+
+        // Each stride is either the same as in the previous level or half of it, so the fibers that the
+        // previous level already has only need the samples in between its samples...
+        if (previous->sample_stride != sample_stride)
+        {
+            sweep_fibers(base_points, iterations_per_fiber, strided_range(0, previous->fiber_stride, number_of_fibers), sample_stride, previous->sample_stride, settings, s3_output, vertices);
+        }
+
+        // ...and the fibers in between its fibers need all of them
+        if (previous->fiber_stride != fiber_stride)
+        {
+            sweep_fibers(base_points, iterations_per_fiber, strided_range(fiber_stride, previous->fiber_stride, number_of_fibers), 0, sample_stride, settings, s3_output, vertices);
+        }
+    }
+
+    void gather_refinement_level(const std::vector<Vertex>& vertices, size_t number_of_fibers, size_t iterations_per_fiber, const RefinementLevel& level, graphics::MeshData& output)
+    {
+        const size_t fiber_count = (number_of_fibers + level.fiber_stride - 1) / level.fiber_stride;
+        const size_t sample_count = (iterations_per_fiber + level.sample_stride - 1) / level.sample_stride;
+
+        output.first.resize(fiber_count * sample_count);
+        output.second.resize(fiber_count * (sample_count + 1));
+
+        for (size_t k = 0; k < fiber_count; ++k)
+        {
+            const Vertex* fiber = &vertices[k * level.fiber_stride * iterations_per_fiber];
+
+            for (size_t j = 0; j < sample_count; ++j)
+            {
+                output.first[k * sample_count + j] = fiber[j * level.sample_stride];
+                output.second[k * (sample_count + 1) + j] = static_cast<uint32_t>(k * sample_count + j);
+            }
+
+            // Primitive restart
+            output.second[k * (sample_count + 1) + sample_count] = std::numeric_limits<uint32_t>::max();
+        }
+    }
+
+    void get_fibration_indices(size_t number_of_fibers, size_t iterations_per_fiber, uint32_t* indices)
+    {
+        for (size_t i = 0; i < number_of_fibers; ++i)
+        {
+            uint32_t* fiber = &indices[i * (iterations_per_fiber + 1)];
+            for (size_t j = 0; j < iterations_per_fiber; ++j)
+            {
+                fiber[j] = static_cast<uint32_t>(i * iterations_per_fiber + j);
+            }
+
+            // Primitive restart
+            fiber[iterations_per_fiber] = std::numeric_limits<uint32_t>::max();
+        }
+    }
+
+    size_t FiberCache::count_misses(const std::vector<Vertex>& base_points, size_t iterations_per_fiber, const GeneratorSettings& settings, bool s3_output) const
+    {
+        if (!is_compatible(iterations_per_fiber, settings, s3_output))
+        {
+            return base_points.size();
+        }
+
+        Lookup lookup;
+        size_t misses = 0;
+
+        for (size_t i = 0; i < base_points.size(); ++i)
+        {
+            if (find(base_points[i].position, i, lookup) == not_cached)
+            {
+                ++misses;
+            }
+        }
+
+        return misses;
+    }
+
+    std::vector<graphics::VertexRange> FiberCache::update(const std::vector<Vertex>& base_points, size_t iterations_per_fiber, const GeneratorSettings& settings, bool s3_output)
+    {
+        if (!is_compatible(iterations_per_fiber, settings, s3_output))
+        {
+            reset(iterations_per_fiber, settings, s3_output);
+        }
+
+        const size_t number_of_fibers = base_points.size();
+        const size_t cached_fibers = keys.size();
+
+        // Work out where each fiber comes from: the same place as before (in which case there is nothing
+        // to do), another cached fiber, or a fresh sweep
+        Lookup lookup;
+        std::vector<std::pair<size_t, size_t>> moves;
+        std::vector<size_t> misses;
+        std::vector<bool> changed(number_of_fibers, false);
+
+        for (size_t i = 0; i < number_of_fibers; ++i)
+        {
+            const size_t source = find(base_points[i].position, i, lookup);
+
+            if (source == i)
+            {
+                continue;
+            }
+            changed[i] = true;
+
+            if (source != not_cached)
+            {
+                moves.emplace_back(i, source);
+            }
+            else
+            {
+                misses.push_back(i);
+            }
+        }
+
+        // Set the moved fibers aside before anything is overwritten
+        std::vector<Vertex> moved(moves.size() * iterations_per_fiber);
+        for (size_t k = 0; k < moves.size(); ++k)
+        {
+            std::copy_n(&fibration.first[moves[k].second * iterations_per_fiber], iterations_per_fiber, &moved[k * iterations_per_fiber]);
+        }
+
+        if (number_of_fibers != cached_fibers)
+        {
+            fibration.first.resize(number_of_fibers * iterations_per_fiber);
+            fibration.second.resize(number_of_fibers * (iterations_per_fiber + 1));
+            get_fibration_indices(number_of_fibers, iterations_per_fiber, fibration.second.data());
+
+            keys.resize(number_of_fibers);
+            valid.resize(number_of_fibers, false);
+        }
+
+        for (size_t k = 0; k < moves.size(); ++k)
+        {
+            const size_t i = moves[k].first;
+
+            std::copy_n(&moved[k * iterations_per_fiber], iterations_per_fiber, &fibration.first[i * iterations_per_fiber]);
+            keys[i] = base_points[i].position;
+            valid[i] = true;
+        }
+
+        // A cancelled sweep leaves its fibers incomplete, so they only count once it has finished
+        for (const size_t i : misses)
+        {
+            keys[i] = base_points[i].position;
+            valid[i] = false;
+        }
+        sweep_fibers(base_points, iterations_per_fiber, misses, 0, 1, settings, s3_output, fibration.first.data());
+
+        if (!is_cancelled(settings))
+        {
+            for (const size_t i : misses)
+            {
+                valid[i] = true;
+            }
+        }
+
+        // Merge runs of changed fibers
+        std::vector<graphics::VertexRange> ranges;
+        for (size_t i = 0; i < number_of_fibers; ++i)
+        {
+            if (!changed[i])
+            {
+                continue;
+            }
+
+            if (!ranges.empty() && ranges.back().first + ranges.back().count == i * iterations_per_fiber)
+            {
+                ranges.back().count += iterations_per_fiber;
+            }
+            else
+            {
+                ranges.push_back(graphics::VertexRange{ i * iterations_per_fiber, iterations_per_fiber });
+            }
+        }
+
+        return ranges;
+    }
+
+    void FiberCache::assign(const std::vector<Vertex>& base_points, size_t iterations_per_fiber, const GeneratorSettings& settings, bool s3_output, const graphics::MeshData& generated)
+    {
+        reset(iterations_per_fiber, settings, s3_output);
+
+        fibration = generated;
+        keys.resize(base_points.size());
+        valid.assign(base_points.size(), true);
+
+        for (size_t i = 0; i < base_points.size(); ++i)
+        {
+            keys[i] = base_points[i].position;
+        }
+    }
+
+    void FiberCache::clear()
+    {
+        reset(0, GeneratorSettings{}, false);
+    }
+
+    bool FiberCache::is_compatible(size_t iterations_per_fiber, const GeneratorSettings& settings, bool s3_output) const
+    {
+        // The S3 generator uses the phase table no matter which kernel is selected
+        return iterations_per_fiber == cached_iterations_per_fiber &&
+               s3_output == cached_s3_output &&
+               (s3_output || (settings.kernel == cached_kernel && settings.isa == cached_isa));
+    }
+
+    void FiberCache::reset(size_t iterations_per_fiber, const GeneratorSettings& settings, bool s3_output)
+    {
+        cached_iterations_per_fiber = iterations_per_fiber;
+        cached_s3_output = s3_output;
+        cached_kernel = settings.kernel;
+        cached_isa = settings.isa;
+
+        keys.clear();
+        valid.clear();
+        fibration.first.clear();
+        fibration.second.clear();
+    }
+
+    size_t FiberCache::find(const glm::vec3& point, size_t index, Lookup& lookup) const
+    {
+        // Positions are compared bit for bit: a fiber is only re-used if sweeping it again would give exactly the same vertices
+        const auto same = [](const glm::vec3& a, const glm::vec3& b) { return std::memcmp(&a, &b, sizeof(glm::vec3)) == 0; };
+
+        if (index < keys.size() && valid[index] && same(keys[index], point))
+        {
+            return index;
+        }
+
+        // Only build the lookup table once some fiber has actually moved
+        if (!lookup.built)
+        {
+            for (size_t k = 0; k < keys.size(); ++k)
+            {
+                if (valid[k])
+                {
+                    lookup.fibers.emplace(keys[k], k);
+                }
+            }
+            lookup.built = true;
+        }
+
+        const auto found = lookup.fibers.find(point);
+        if (found != lookup.fibers.end() && same(keys[found->second], point))
+        {
+            return found->second;
+        }
+
+        return not_cached;
+    }
+
+    std::vector<Vertex> project_fibration(const std::vector<Vertex>& s3_vertices, const glm::vec4& rotation, Projection projection, const GeneratorSettings& settings)
+    {
+        std::vector<Vertex> vertices(s3_vertices.size());
+
+        utils::WorkerPool::get_shared().parallel_for(s3_vertices.size(), settings.thread_count, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                const glm::vec4 q = multiply_quaternions(rotation, glm::vec4{ s3_vertices[i].position, s3_vertices[i].texture_coordinate.x });
+
+                // The Hopf map (see `get_rotation_quaternion()`) recovers the rotated base point
+                const glm::vec3 base_point{
+                    -2.0f * (q.w * q.z + q.x * q.y),
+                    2.0f * (q.w * q.y - q.x * q.z),
+                    q.w * q.w + q.x * q.x - q.y * q.y - q.z * q.z
+                };
+
+                vertices[i].position = project_point(q, projection);
+                vertices[i].color = base_point * 0.5f + 0.5f;
+                vertices[i].texture_coordinate = glm::vec2{ 0.0f, 0.0f };
+            }
+        });
+
+        return vertices;
+    }
+
+    std::vector<Circle> get_fiber_circles(const std::vector<Vertex>& base_points, const glm::vec4& rotation)
+    {
+        std::vector<Circle> circles(base_points.size());
+
+        const glm::dvec4 r{ rotation };
+        const auto rotate = [&](const glm::dvec4& q)
+        {
+            const glm::dvec3 u{ r.x, r.y, r.z };
+            const glm::dvec3 v{ q.x, q.y, q.z };
+
+            return glm::dvec4{ v * r.w + u * q.w + glm::cross(u, v), r.w * q.w - glm::dot(u, v) };
+        };
+
+        for (size_t i = 0; i < base_points.size(); ++i)
+        {
+            const double a = base_points[i].position.x;
+            const double b = base_points[i].position.y;
+            const double c = base_points[i].position.z;
+
+            // The fiber is the great circle `cos(phi) * p + sin(phi) * q` (see `sweep_fiber_s3()`)
+            const double length = std::sqrt(a * a + b * b);
+            const double cos_theta_0 = length > 0.0 ? b / length : 1.0;
+            const double sin_theta_0 = length > 0.0 ? -a / length : 0.0;
+            const double alpha = std::sqrt(std::max(0.0, (1.0 + c) / 2.0));
+            const double beta = std::sqrt(std::max(0.0, (1.0 - c) / 2.0));
+
+            const glm::dvec4 p = rotate(glm::dvec4{ alpha * sin_theta_0, beta, 0.0, alpha * cos_theta_0 });
+            const glm::dvec4 q = rotate(glm::dvec4{ -alpha * cos_theta_0, 0.0, beta, alpha * sin_theta_0 });
+
+            // Re-parameterize the great circle by the point `u` that comes closest to the pole (where `w` is
+            // largest, `m`) and the point `v` a quarter turn away from it (where `w` is 0). The circle is
+            // symmetric around the plane through the pole and `u`, so `u` and `-u` project onto the two ends
+            // of a diameter: at distances `m / (1 - m^2) +- 1 / sqrt(1 - m^2)` from the origin along `u`
+            const double m = std::sqrt(p.w * p.w + q.w * q.w);
+            glm::dvec4 u = p;
+            glm::dvec4 v = q;
+            if (m > 0.0)
+            {
+                u = (p * p.w + q * q.w) / m;
+                v = (q * p.w - p * q.w) / m;
+            }
+
+            const glm::dvec3 u_xyz{ u.x, u.y, u.z };
+            const glm::dvec3 v_xyz{ v.x, v.y, v.z };
+            const double sine_squared = 1.0 - m * m;
+
+            if (sine_squared <= 1e-12)
+            {
+                // The fiber passes through the pole, so it projects onto a line through the image of `-u`
+                // (the origin) in the direction of `v`
+                circles[i].center = glm::vec3{ u_xyz / -(1.0 + m) };
+                circles[i].normal = glm::vec3{ glm::normalize(v_xyz) };
+                circles[i].radius = 0.0f;
+            }
+            else
+            {
+                circles[i].center = glm::vec3{ u_xyz * (m / sine_squared) };
+                circles[i].normal = glm::vec3{ glm::normalize(glm::cross(u_xyz, v_xyz)) };
+                circles[i].radius = static_cast<float>(1.0 / std::sqrt(sine_squared));
+            }
+        }
+
+        return circles;
+    }
+
+    FibrationSoA generate_fibration_soa(const std::vector<Vertex>& base_points, size_t iterations_per_fiber, const GeneratorSettings& settings)
+    {
+        const auto phis = utils::linear_spacing(0.0f, glm::two_pi<float>(), iterations_per_fiber);
+
+        FibrationSoA fibration;
+        fibration.iterations_per_fiber = iterations_per_fiber;
+        fibration.x.resize(base_points.size() * iterations_per_fiber);
+        fibration.y.resize(base_points.size() * iterations_per_fiber);
+        fibration.z.resize(base_points.size() * iterations_per_fiber);
+        fibration.colors.resize(base_points.size());
+
+        const FiberSweep sweep = get_fiber_sweep(phis, settings);
+
+        utils::WorkerPool::get_shared().parallel_for(base_points.size(), settings.thread_count, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                const size_t offset = i * iterations_per_fiber;
+
+                sweep(base_points[i].position, &fibration.x[offset], &fibration.y[offset], &fibration.z[offset]);
+                fibration.colors[i] = base_points[i].position * 0.5f + 0.5f;
+            }
+        });
+
+        return fibration;
+    }
+
+}
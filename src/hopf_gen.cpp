@@ -0,0 +1,514 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "fibration_cache_file.h"
+#include "fibration_stream.h"
+#include "hopf.h"
+#include "utils.h"
+
+/**
+ * Prints the command-line usage of this tool.
+ */
+void print_usage()
+{
+    std::cout << "Usage: hopf-gen [scene file] [-o output.obj|.ply|.glb] [-j threads] [-k reference|vectorized|phase-table]\n"
+              << "                [--isa scalar|sse4.1|avx2|avx512] [--vertex-budget count] [--circles] [--quantize]\n"
+              << "                [--stream] [--cache file.hopfcache] [--accuracy-report]\n\n"
+              << "Generates a Hopf fibration without creating a window or an OpenGL context. A scene file\n"
+              << "contains one `key = value` pair per line (lines starting with `#` are ignored), where each\n"
+              << "key is one of the fields of `hopf::Parameters`, for example:\n\n"
+              << "    mode = Great Circle\n"
+              << "    number_of_fibers = 500\n"
+              << "    number_of_circles = 2\n"
+              << "    offsets = 0.0 -0.5\n"
+              << "    arc_angles = 6.28 3.14\n\n"
+              << "The output format is picked by the extension: text OBJ, binary PLY or binary glTF (GLB). `--quantize`\n"
+              << "stores GLB positions as 16-bit integers (KHR_mesh_quantization) and colors as bytes. `--stream`\n"
+              << "writes OBJ and PLY files while the fibers are still being generated, a few thousand fibers at a time, so\n"
+              << "memory use stays flat however many fibers there are (the file is the same either way, but nothing is\n"
+              << "left to cache, so it can't be combined with `--cache`). `--cache` maps the fibration from a cache file\n"
+              << "instead of generating it, if the file holds this scene (and otherwise generates it and writes the cache\n"
+              << "file, for next time). The viewer opens cache files too.\n\n"
+              << "Fibers are generated on all hardware threads unless `-j` is given. `--vertex-budget` samples\n"
+              << "each fiber adaptively (up to `iterations_per_fiber` times), with at most `count` vertices in\n"
+              << "total. `--circles` writes each fiber as the exact circle that the (classic) stereographic projection\n"
+              << "maps it onto, as a curve in the OBJ file (or, if the output ends in `.circles`, as a binary table of\n"
+              << "7 floats per fiber) instead of sampling it. `--accuracy-report` compares every available sweep kernel against a double-precision\n"
+              << "evaluation of the scene (and against the reference kernel) instead of writing any output.\n";
+}
+
+/**
+ * Removes leading and trailing whitespace from `text`.
+ */
+std::string trim(const std::string& text)
+{
+    const auto first = text.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos)
+    {
+        return "";
+    }
+    const auto last = text.find_last_not_of(" \t\r\n");
+
+    return text.substr(first, last - first + 1);
+}
+
+/**
+ * Parses a whitespace-separated list of floats.
+ */
+std::vector<float> parse_floats(const std::string& text)
+{
+    std::vector<float> values;
+    std::istringstream stream{ text };
+
+    float value;
+    while (stream >> value)
+    {
+        values.push_back(value);
+    }
+
+    return values;
+}
+
+/**
+ * Reads a scene file (see `print_usage()`) into a set of fibration parameters.
+ */
+hopf::Parameters load_scene(const std::string& path)
+{
+    std::ifstream file{ path };
+    if (!file)
+    {
+        throw std::runtime_error("Could not open scene file: " + path);
+    }
+
+    hopf::Parameters parameters;
+    bool circles_changed = false;
+    bool offsets_given = false;
+    bool arc_angles_given = false;
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        line = trim(line);
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        const auto separator = line.find('=');
+        if (separator == std::string::npos)
+        {
+            throw std::runtime_error("Malformed line in scene file: " + line);
+        }
+
+        const std::string key = trim(line.substr(0, separator));
+        const std::string value = trim(line.substr(separator + 1));
+
+        if (key == "mode") parameters.mode = value;
+        else if (key == "number_of_fibers") parameters.number_of_fibers = std::stoul(value);
+        else if (key == "iterations_per_fiber") parameters.iterations_per_fiber = std::stoul(value);
+        else if (key == "number_of_circles") { parameters.number_of_circles = std::stoul(value); circles_changed = true; }
+        else if (key == "offsets") { parameters.offsets = parse_floats(value); offsets_given = true; }
+        else if (key == "arc_angles") { parameters.arc_angles = parse_floats(value); arc_angles_given = true; }
+        else if (key == "seed") parameters.seed = std::stoul(value);
+        else if (key == "mean") parameters.mean = std::stof(value);
+        else if (key == "standard_deviation") parameters.standard_deviation = std::stof(value);
+        else if (key == "loxodrome_offset") parameters.loxodrome_offset = std::stof(value);
+        else if (key == "curl_alpha") parameters.curl_alpha = std::stof(value);
+        else if (key == "curl_beta") parameters.curl_beta = std::stof(value);
+        else if (key == "rotation_x") parameters.rotation_x = std::stof(value);
+        else if (key == "rotation_y") parameters.rotation_y = std::stof(value);
+        else if (key == "rotation_z") parameters.rotation_z = std::stof(value);
+        else
+        {
+            throw std::runtime_error("Unknown key in scene file: " + key);
+        }
+    }
+
+    // Match the UI: if only the number of circles was given, space the circles out evenly
+    if (circles_changed && !offsets_given)
+    {
+        parameters.offsets = utils::linear_spacing(0.0f, -0.9f, parameters.number_of_circles);
+    }
+    if (circles_changed && !arc_angles_given)
+    {
+        parameters.arc_angles = utils::linear_spacing((glm::two_pi<float>()) * 0.25f, glm::two_pi<float>() * 0.75f, parameters.number_of_circles);
+    }
+
+    return parameters;
+}
+
+/**
+ * Parses the name of a sweep kernel.
+ */
+hopf::SweepKernel parse_kernel(const std::string& name)
+{
+    if (name == "reference") return hopf::SweepKernel::Reference;
+    if (name == "vectorized") return hopf::SweepKernel::Vectorized;
+    if (name == "phase-table") return hopf::SweepKernel::PhaseTable;
+
+    throw std::runtime_error("Unknown sweep kernel: " + name);
+}
+
+/**
+ * Parses the name of an instruction set.
+ */
+hopf::SweepIsa parse_isa(const std::string& name)
+{
+    if (name == "scalar") return hopf::SweepIsa::Scalar;
+    if (name == "sse4.1") return hopf::SweepIsa::Sse41;
+    if (name == "avx2") return hopf::SweepIsa::Avx2;
+    if (name == "avx512") return hopf::SweepIsa::Avx512;
+
+    throw std::runtime_error("Unknown instruction set: " + name);
+}
+
+/**
+ * Evaluates the fibration of `base_points` in double precision, as the ground truth for
+ * `print_accuracy_report()`.
+ */
+std::vector<glm::dvec3> generate_fibration_double(const std::vector<Vertex>& base_points, size_t iterations_per_fiber)
+{
+    const auto phis = utils::linear_spacing(0.0f, glm::two_pi<float>(), iterations_per_fiber);
+
+    std::vector<glm::dvec3> positions;
+    positions.reserve(base_points.size() * iterations_per_fiber);
+
+    for (const auto& point : base_points)
+    {
+        const double a = point.position.x;
+        const double b = point.position.y;
+        const double c = point.position.z;
+
+        for (const float phi : phis)
+        {
+            const double theta = std::atan2(-a, b) - phi;
+            const double alpha = std::sqrt((1.0 + c) / 2.0);
+            const double beta = std::sqrt((1.0 - c) / 2.0);
+
+            const double w = alpha * std::cos(theta);
+            const double projection = std::acos(w) / glm::pi<double>() / std::sqrt(1.0 - w * w);
+
+            positions.push_back(glm::dvec3{
+                projection * alpha * std::sin(theta),
+                projection * beta * std::cos(phi),
+                projection * beta * std::sin(phi)
+            });
+        }
+    }
+
+    return positions;
+}
+
+/**
+ * Prints the error (against double precision) and the run time of every sweep kernel that is
+ * available on this CPU.
+ */
+void print_accuracy_report(const hopf::Parameters& parameters, const hopf::GeneratorSettings& settings)
+{
+    const auto base_points = hopf::get_base_points(parameters);
+    const auto expected = generate_fibration_double(base_points, parameters.iterations_per_fiber);
+
+    struct Candidate
+    {
+        std::string name;
+        hopf::GeneratorSettings settings;
+    };
+
+    std::vector<Candidate> candidates;
+    candidates.push_back({ "Reference", settings });
+    candidates.back().settings.kernel = hopf::SweepKernel::Reference;
+
+    for (const auto isa : { hopf::SweepIsa::Scalar, hopf::SweepIsa::Sse41, hopf::SweepIsa::Avx2, hopf::SweepIsa::Avx512 })
+    {
+        try
+        {
+            hopf::get_sweep_function(isa);
+        }
+        catch (const std::runtime_error&)
+        {
+            continue;
+        }
+
+        candidates.push_back({ std::string{ "Vectorized (" } + hopf::to_string(isa) + ")", settings });
+        candidates.back().settings.kernel = hopf::SweepKernel::Vectorized;
+        candidates.back().settings.isa = isa;
+
+        candidates.push_back({ std::string{ "Phase table (" } + hopf::to_string(isa) + ")", settings });
+        candidates.back().settings.kernel = hopf::SweepKernel::PhaseTable;
+        candidates.back().settings.isa = isa;
+    }
+
+    std::cout << "Accuracy of " << expected.size() << " vertices (" << base_points.size() << " fibers) against double precision:\n";
+
+    hopf::FibrationSoA reference;
+
+    for (const auto& candidate : candidates)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        const auto fibration = hopf::generate_fibration_soa(base_points, parameters.iterations_per_fiber, candidate.settings);
+        const auto end = std::chrono::steady_clock::now();
+
+        if (candidate.settings.kernel == hopf::SweepKernel::Reference)
+        {
+            reference = fibration;
+        }
+
+        double max_error = 0.0;
+        double total_error = 0.0;
+        double max_difference = 0.0;
+        size_t non_finite = 0;
+
+        for (size_t i = 0; i < expected.size(); ++i)
+        {
+            const glm::dvec3 actual{ fibration.x[i], fibration.y[i], fibration.z[i] };
+            const double error = std::max(std::abs(actual.x - expected[i].x), std::max(std::abs(actual.y - expected[i].y), std::abs(actual.z - expected[i].z)));
+
+            // How far this kernel strays from the one that the UI used to draw with
+            const glm::dvec3 current{ reference.x[i], reference.y[i], reference.z[i] };
+            const double difference = std::max(std::abs(actual.x - current.x), std::max(std::abs(actual.y - current.y), std::abs(actual.z - current.z)));
+            if (std::isfinite(difference))
+            {
+                max_difference = std::max(max_difference, difference);
+            }
+
+            if (!std::isfinite(error))
+            {
+                ++non_finite;
+                continue;
+            }
+            max_error = std::max(max_error, error);
+            total_error += error;
+        }
+
+        std::cout << "    " << candidate.name << ": max error " << max_error
+                  << ", mean error " << total_error / std::max<size_t>(expected.size() - non_finite, 1)
+                  << ", non-finite " << non_finite
+                  << ", max difference from reference " << max_difference
+                  << ", " << std::chrono::duration<double, std::milli>(end - start).count() << " ms\n";
+    }
+}
+
+/**
+ * Formats the size of a written file and the rate it was written at, for example " (12.3 MB, 456.7 MB/s)".
+ */
+std::string get_throughput(size_t bytes, std::chrono::steady_clock::duration duration)
+{
+    const double megabytes = bytes / (1024.0 * 1024.0);
+    const double seconds = std::chrono::duration<double>(duration).count();
+
+    std::ostringstream text;
+    text << " (" << megabytes << " MB, " << (seconds > 0.0 ? megabytes / seconds : 0.0) << " MB/s)";
+
+    return text.str();
+}
+
+int main(int argc, char** argv)
+{
+    std::string scene_path;
+    std::string output_path = "Hopf.obj";
+    hopf::GeneratorSettings settings;
+    settings.thread_count = 0; // All hardware threads
+    size_t vertex_budget = 0;
+    bool circles = false;
+    bool quantize = false;
+    bool stream = false;
+    std::string cache_path;
+    bool accuracy_report = false;
+
+    try
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string argument = argv[i];
+
+            if (argument == "-h" || argument == "--help")
+            {
+                print_usage();
+                return EXIT_SUCCESS;
+            }
+            else if (argument == "-o" && i + 1 < argc)
+            {
+                output_path = argv[++i];
+            }
+            else if (argument == "-j" && i + 1 < argc)
+            {
+                settings.thread_count = std::stoul(argv[++i]);
+            }
+            else if (argument == "-k" && i + 1 < argc)
+            {
+                settings.kernel = parse_kernel(argv[++i]);
+            }
+            else if (argument == "--isa" && i + 1 < argc)
+            {
+                settings.isa = parse_isa(argv[++i]);
+            }
+            else if (argument == "--vertex-budget" && i + 1 < argc)
+            {
+                vertex_budget = std::stoul(argv[++i]);
+            }
+            else if (argument == "--circles")
+            {
+                circles = true;
+            }
+            else if (argument == "--quantize")
+            {
+                quantize = true;
+            }
+            else if (argument == "--stream")
+            {
+                stream = true;
+            }
+            else if (argument == "--cache" && i + 1 < argc)
+            {
+                cache_path = argv[++i];
+            }
+            else if (argument == "--accuracy-report")
+            {
+                accuracy_report = true;
+            }
+            else if (scene_path.empty())
+            {
+                scene_path = argument;
+            }
+            else
+            {
+                print_usage();
+                return EXIT_FAILURE;
+            }
+        }
+
+        // A streamed fibration is never held in memory, so there would be nothing to write the cache file from
+        if (stream && !cache_path.empty())
+        {
+            throw std::runtime_error("--stream and --cache can't be used together");
+        }
+
+        const hopf::Parameters parameters = scene_path.empty() ? hopf::Parameters{} : load_scene(scene_path);
+
+        if (accuracy_report)
+        {
+            print_accuracy_report(parameters, settings);
+            return EXIT_SUCCESS;
+        }
+
+        if (circles)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            const auto fiber_circles = hopf::get_fiber_circles(hopf::get_base_points(parameters));
+            const auto generated = std::chrono::steady_clock::now();
+
+            utils::ExportProgress progress;
+            if (utils::get_extension(output_path) == "circles")
+            {
+                utils::save_circle_table(fiber_circles, output_path, &progress);
+            }
+            else
+            {
+                utils::save_circle_obj(fiber_circles, output_path, 100.0f, &progress);
+            }
+            const auto saved = std::chrono::steady_clock::now();
+
+            std::cout << "Generated " << fiber_circles.size() << " circles in "
+                      << std::chrono::duration<double, std::milli>(generated - start).count() << " ms, saved in "
+                      << std::chrono::duration<double, std::milli>(saved - generated).count() << " ms"
+                      << get_throughput(progress.bytes_written, saved - generated) << "\n";
+
+            return EXIT_SUCCESS;
+        }
+
+        // Everything that the output depends on, for looking it up in (or writing it to) the cache file
+        hopf::FibrationJob job;
+        job.parameters = parameters;
+        job.settings = settings;
+        job.vertex_budget = vertex_budget;
+
+        if (!cache_path.empty())
+        {
+            try
+            {
+                const auto start = std::chrono::steady_clock::now();
+                const hopf::FibrationCacheFile cache{ cache_path };
+                const auto loaded = std::chrono::steady_clock::now();
+
+                if (cache.matches(job))
+                {
+                    // Written straight from the mapped file, without copying the fibration
+                    utils::ExportProgress progress;
+                    utils::save_polylines(cache.get_vertices(), cache.get_vertex_count(), cache.get_indices(), cache.get_index_count(), output_path, quantize, &progress);
+                    const auto saved = std::chrono::steady_clock::now();
+
+                    std::cout << "Loaded " << cache.get_base_point_count() << " fibers (" << cache.get_vertex_count() << " vertices) from "
+                              << cache_path << " in " << std::chrono::duration<double, std::milli>(loaded - start).count() << " ms, saved in "
+                              << std::chrono::duration<double, std::milli>(saved - loaded).count() << " ms"
+                              << get_throughput(progress.bytes_written, saved - loaded) << "\n";
+
+                    return EXIT_SUCCESS;
+                }
+
+                std::cout << cache_path << " holds a different scene: regenerating it\n";
+            }
+            catch (const std::runtime_error& e)
+            {
+                std::cout << e.what() << ": regenerating it\n";
+            }
+        }
+
+        if (stream)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            const auto base_points = hopf::get_base_points(parameters);
+            const auto sample_counts = vertex_budget != 0
+                ? hopf::get_adaptive_sample_counts(base_points, parameters.iterations_per_fiber, vertex_budget)
+                : std::vector<size_t>{};
+
+            utils::ExportProgress progress;
+            hopf::stream_fibration(base_points, parameters.iterations_per_fiber, sample_counts, settings, output_path, {}, &progress);
+            const auto saved = std::chrono::steady_clock::now();
+
+            std::cout << "Generated and saved " << base_points.size() << " fibers in "
+                      << std::chrono::duration<double, std::milli>(saved - start).count() << " ms"
+                      << get_throughput(progress.bytes_written, saved - start) << "\n";
+
+            return EXIT_SUCCESS;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        const auto base_points = hopf::get_base_points(parameters);
+        const auto hopf_data = vertex_budget != 0
+            ? hopf::generate_adaptive_fibration(base_points, hopf::get_adaptive_sample_counts(base_points, parameters.iterations_per_fiber, vertex_budget), settings)
+            : hopf::generate_fibration(base_points, parameters.iterations_per_fiber, settings);
+        const auto generated = std::chrono::steady_clock::now();
+
+        if (!cache_path.empty())
+        {
+            hopf::save_fibration_cache(cache_path, job, base_points, hopf_data);
+        }
+        const auto cached = std::chrono::steady_clock::now();
+
+        utils::ExportProgress progress;
+        utils::save_polylines(hopf_data.first, hopf_data.second, output_path, quantize, &progress);
+        const auto saved = std::chrono::steady_clock::now();
+
+        std::cout << "Generated " << base_points.size() << " fibers (" << hopf_data.first.size() << " vertices) in "
+                  << std::chrono::duration<double, std::milli>(generated - start).count() << " ms, saved in "
+                  << std::chrono::duration<double, std::milli>(saved - cached).count() << " ms"
+                  << get_throughput(progress.bytes_written, saved - cached) << "\n";
+        if (!cache_path.empty())
+        {
+            std::cout << "Cached in " << cache_path << " in " << std::chrono::duration<double, std::milli>(cached - generated).count() << " ms\n";
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -1,5 +1,8 @@
-﻿#include <iostream>
-#include <random>
+﻿#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <memory>
 
 #include "glad/glad.h"
 #include "GLFW/glfw3.h"
@@ -9,7 +12,16 @@
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
 
+#include "export_worker.h"
+#include "fibration_cache_file.h"
+#include "fibration_compute.h"
+#include "fibration_worker.h"
+#include "frame_profiler.h"
+#include "hopf.h"
 #include "mesh.h"
+#include "renderer.h"
+#include "shadow_map.h"
+#include "uniform_buffer.h"
 #include "shader.h"
 #include "utils.h"
 
@@ -17,6 +29,9 @@
 struct InputData
 {
     bool imgui_active = false;
+
+    // Set by the callbacks whenever an event arrives, so the main loop knows to keep drawing for a while
+    bool events = false;
 };
 
 // Viewport and camera settings
@@ -33,34 +48,56 @@ float zoom = 45.0f;
 glm::mat4 arcball_camera_matrix = glm::lookAt(glm::vec3{ 6.0f, 1.0f, 0.0f }, glm::vec3{ 0.0f }, glm::vec3{ 1.0f, 1.0f, 0.0f });
 glm::mat4 arcball_model_matrix = glm::mat4{ 1.0f };
 
-// Global settings
-size_t number_of_fibers = 200;
-size_t iterations_per_fiber = 300;
-const std::vector<std::string> modes = { "Great Circle", "Random", "Loxodrome", "Curl" };
-std::string current_mode = modes[3];
-
-// Per-mode settings
-uint32_t number_of_circles = 1;                             // For mode: "Great Circle"
-std::vector<float> offsets = { 0.0f };                      // For mode: "Great Circle"
-std::vector<float> arc_angles = { glm::two_pi<float>() };   // For mode: "Great Circle"
-float rotation_x = 0.0f;                                    // For mode: "Great Circle"
-float rotation_y = 0.0f;                                    // For mode: "Great Circle"
-float rotation_z = 0.0f;                                    // For mode: "Great Circle"
-uint32_t seed = 0;                                          // For mode: "Random"
-float mean = 0.0f;                                          // For mode: "Random"
-float standard_deviation = 1.0f;                            // For mode: "Random"
-float loxodrome_offset = 2.0f;                              // For mode: "Loxodrome"
-float curl_alpha = 4.0f;                                    // For mode: "Curl"                         
-float curl_beta = 0.5f;                                     // For mode: "Curl"
+// Fibration settings (global and per-mode)
+hopf::Parameters parameters;
+hopf::GeneratorSettings generator_settings;
+
+// When set, the fibration is stored on S3 and rotated and projected in the vertex shader, so
+// changing either of those doesn't require regenerating (or re-uploading) any vertices
+bool rotate_on_gpu = true;
+hopf::Projection projection_mode = hopf::Projection::Modified;
+
+// When set (on the GPU path), only the base points are uploaded and the vertex shader sweeps out
+// each fiber from a shared template of phi samples, one instance per base point
+bool draw_instanced = true;
+
+// When set (when drawing instanced with the stereographic projection), each fiber is swept out around its
+// exact circle (7 floats per fiber, see `hopf::get_fiber_circles()`) and exported as an exact curve
+bool draw_circles = false;
+
+// When set (and not drawing instanced), fibers are generated by a compute shader instead of on the CPU
+bool generate_on_gpu = false;
+
+// When set, fibers that are generated on the CPU are shown at a coarse level of detail first and then
+// refined over the next few frames, so dragging a slider stays responsive at high fiber counts
+bool refine_progressively = true;
+
+// The most memory that recently generated fibrations may take up (see `hopf::SceneCache`)
+int scene_cache_budget_mb = 256;
+
+// When set, fibers that are generated on the CPU get as many samples as they need to look smooth (up to
+// the number of iterations per fiber), with at most `vertex_budget` vertices in total
+bool adaptive_sampling = false;
+int vertex_budget = 100000;
+
+// When set, fibers that are generated on the CPU are uploaded with 16-bit positions (8 bytes per vertex
+// instead of 32, see `graphics::VertexFormat`), and colored per fiber
+bool compact_vertices = true;
 
 // Appearance and export settings
 static char filename[64] = "Hopf.obj";
+bool quantize_export = false;
 ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);   
 bool show_floor_plane = true;
 bool draw_as_points = false;
 bool display_shadows = true;
+graphics::ShadowTechnique shadow_technique = graphics::ShadowTechnique::HardwarePcf;
 float line_width = 2.0f;
 
+// Whether a record of every frame's timings is being written to `timings_filename`
+bool record_timings = false;
+const char* timings_filename = "timings.csv";
+
 InputData input_data;
 
 /**
@@ -68,6 +105,8 @@ InputData input_data;
  */
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
+    static_cast<InputData*>(glfwGetWindowUserPointer(window))->events = true;
+
     if (zoom >= 1.0f && zoom <= 45.0f)
     {
         zoom -= yoffset;
@@ -87,6 +126,8 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
  */
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
+    static_cast<InputData*>(glfwGetWindowUserPointer(window))->events = true;
+
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
     {
         // Close the GLFW window
@@ -140,6 +181,7 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
     // First, check if the user is interacting with the ImGui interface - if they are,
     // we don't want to process mouse events any further
     auto input_data = static_cast<InputData*>(glfwGetWindowUserPointer(window));
+    input_data->events = true;
 
     if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS && !input_data->imgui_active)
     {
@@ -177,6 +219,20 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
     }
 }
 
+/**
+ * Notes mouse button presses and releases (which the UI reacts to), as well as requests from the window
+ * system to redraw the window (for example, after it was uncovered).
+ */
+void mouse_button_callback(GLFWwindow* window, int /*button*/, int /*action*/, int /*mods*/)
+{
+    static_cast<InputData*>(glfwGetWindowUserPointer(window))->events = true;
+}
+
+void refresh_callback(GLFWwindow* window)
+{
+    static_cast<InputData*>(glfwGetWindowUserPointer(window))->events = true;
+}
+
 /**
  * Debug function that will be used internally by OpenGL to print out warnings, errors, etc.
  */
@@ -219,233 +275,231 @@ void message_callback(GLenum source, GLenum type, GLuint id, GLenum severity, GL
     std::cout << src_str << ", " << type_str << ", " << severity_str << ", " << id << ": " << message << '\n';
 }
 
-namespace hopf
+/**
+ * Snapshots the current settings into a job for the background generator. On the GPU path, the base
+ * points are left unrotated (the rotation is applied in the vertex shader) and the fibers are left on S3.
+ */
+hopf::FibrationJob make_fibration_job()
 {
-
-    std::vector<Vertex> calculate_base_points_great_circle(const glm::mat4& transform = glm::mat4{ 1.0f })
+    hopf::FibrationJob job;
+    job.parameters = parameters;
+    job.settings = generator_settings;
+    job.rotate_base_points = !rotate_on_gpu;
+    job.progressive = refine_progressively;
+    job.vertex_budget = adaptive_sampling ? static_cast<size_t>(vertex_budget) : 0;
+
+    if ((rotate_on_gpu && draw_instanced) || generate_on_gpu)
     {
-        std::vector<Vertex> base_points;
-
-        for (size_t i = 0; i < number_of_circles; ++i)
-        {
-            const float offset = offsets[i];
-            const float arc_angle = arc_angles[i];
-
-            const auto thetas = utils::linear_spacing(0.0f, arc_angle, number_of_fibers);
-
-            for (const auto theta : thetas)
-            {
-                const float c = cosf(theta) * (1.0f - fabsf(offset));
-                const float s = sinf(theta) * (1.0f - fabsf(offset));
-
-                const glm::vec3 position = glm::vec3{ transform * glm::vec4{ c, s, offset, 1.0f } };
-
-                Vertex vertex;
+        // The fibers are swept out on the GPU, from nothing but the base points
+        job.output = hopf::FiberOutput::None;
+    }
+    else
+    {
+        job.output = rotate_on_gpu ? hopf::FiberOutput::S3 : hopf::FiberOutput::Projected;
+    }
 
-                vertex.position = position;
-                vertex.color = vertex.position * 0.5f + 0.5f;
-                vertex.texture_coordinate = { 0.0f, 0.0f };
+    return job;
+}
 
-                base_points.push_back(vertex);
-            }
-        }
+/**
+ * Sets up the UI so that `make_fibration_job()` returns `job` again (for example, one that was restored from
+ * a cache file). Of the ways to sweep out the fibers on the GPU, which all make the same job, instancing is
+ * picked unless the base points are rotated on the CPU.
+ */
+void restore_fibration_job(const hopf::FibrationJob& job)
+{
+    parameters = job.parameters;
+    generator_settings.kernel = job.settings.kernel;
+    generator_settings.isa = job.settings.isa;
+    rotate_on_gpu = !job.rotate_base_points;
 
-        return base_points;
+    adaptive_sampling = job.vertex_budget != 0;
+    if (adaptive_sampling)
+    {
+        vertex_budget = static_cast<int>(job.vertex_budget);
     }
 
-    std::vector<Vertex> calculate_base_points_random(const glm::mat4& transform = glm::mat4{ 1.0f })
+    if (job.output == hopf::FiberOutput::None)
     {
-        std::vector<Vertex> base_points;
-
-        // Create a normal (Gaussian) distribution generator
-        std::default_random_engine generator{ seed };
-        std::normal_distribution<float> distribution(mean, standard_deviation);
-
-        for (size_t i = 0; i < number_of_fibers; ++i)
+        generate_on_gpu = !rotate_on_gpu;
+        if (rotate_on_gpu)
         {
-            const auto rand_x = distribution(generator);
-            const auto rand_y = distribution(generator);
-            const auto rand_z = distribution(generator);
-
-            const float radius = 1.0f;
-
-            Vertex vertex;
-            vertex.position = glm::vec3{ transform * glm::vec4{ glm::normalize(glm::vec3{ rand_x, rand_y, rand_z }) * radius, 1.0f} };
-            vertex.color = vertex.position * 0.5f + 0.5f;
-            vertex.texture_coordinate = { 0.0f, 0.0f };
-
-            base_points.push_back(vertex);
+            draw_instanced = true;
         }
-
-        return base_points;
     }
-
-    std::vector<Vertex> calculate_base_points_loxodrome(const glm::mat4& transform = glm::mat4{ 1.0f })
+    else
     {
-        std::vector<Vertex> base_points;
-
-        // Don't go all the way to `pi / 2` because there are discontinuities at the poles
-        auto thetas = utils::linear_spacing(-glm::pi<float>() * 0.45f, glm::pi<float>() * 0.45f, number_of_fibers);
-
-        for (size_t i = 0; i < number_of_fibers; ++i)
+        // Fibers on S3 are only generated on the CPU when they aren't drawn instanced
+        generate_on_gpu = false;
+        if (rotate_on_gpu)
         {
-            const float radius = 1.0f;
-
-            const float x = radius * cosf(thetas[i]) * cosf(thetas[i] * loxodrome_offset);
-            const float y = radius * cosf(thetas[i]) * sinf(thetas[i] * loxodrome_offset);
-            const float z = radius * sinf(thetas[i]);
-
-            Vertex vertex;
-            vertex.position = glm::vec3{ transform * glm::vec4{ x, y, z, 1.0f } };
-            vertex.color = vertex.position * 0.5f + 0.5f;
-            vertex.texture_coordinate = { 0.0f, 0.0f };
-
-            base_points.push_back(vertex);
+            draw_instanced = false;
         }
-
-        return base_points;
     }
+}
 
-    std::vector<Vertex> calculate_base_points_curl(const glm::mat4& transform = glm::mat4{ 1.0f })
+/**
+ * Uploads the fibers of `cache` straight from the mapped file: the driver copies the pages into GPU memory
+ * as they are read from disk, without going through any intermediate vectors.
+ */
+graphics::Mesh upload_cached_fibration(const hopf::FibrationCacheFile& cache)
+{
+    if (cache.get_vertex_count() == 0)
     {
-        std::vector<Vertex> base_points;
+        return graphics::Mesh{};
+    }
 
-        auto thetas = utils::linear_spacing(0.0f, glm::two_pi<float>(), number_of_fibers);
+    uint32_t vertex_buffer;
+    glCreateBuffers(1, &vertex_buffer);
+    glNamedBufferStorage(vertex_buffer, sizeof(Vertex) * cache.get_vertex_count(), cache.get_vertices(), 0);
 
-        for (size_t i = 0; i < number_of_fibers; ++i)
-        {
-            const float theta = thetas[i];
-            const float radius = 1.0f;
-
-            float coeff_x = sinf(theta * curl_alpha) * curl_beta;
-            float coeff_y = cosf(theta * curl_alpha) * curl_beta;
-
-            float x = radius * coeff_x + cosf(theta);
-            float y = radius * coeff_y + sinf(theta);
-            float z = 0.0f;
-
-            // Stereographic projection onto a sphere
-            Vertex vertex;
-            vertex.position = glm::vec3{ transform * glm::vec4{
-                (2.0f * x) / (1.0f + x * x + y * y),
-                (2.0f * y) / (1.0f + x * x + y * y),
-                (-1.0f + x * x + y * y) / (1.0f + x * x + y * y),
-                1.0f
-            } };
-            vertex.color = vertex.position * 0.5f + 0.5f;
-            vertex.texture_coordinate = { 0.0f, 0.0f };
-
-            base_points.push_back(vertex);
-        }
-
-        return base_points;
+    uint32_t index_buffer = 0;
+    if (cache.get_index_count() != 0)
+    {
+        glCreateBuffers(1, &index_buffer);
+        glNamedBufferStorage(index_buffer, sizeof(uint32_t) * cache.get_index_count(), cache.get_indices(), 0);
     }
 
-    std::vector<Vertex> get_base_points(const std::string& mode, const glm::mat4& transform = glm::mat4{ 1.0f })
-    {
-        std::vector<Vertex> base_points;
+    return graphics::Mesh{ vertex_buffer, cache.get_vertex_count(), index_buffer, cache.get_index_count() };
+}
 
-        if (current_mode == "Great Circle")
-        {
-            base_points = calculate_base_points_great_circle(transform);
-        }
-        else if (current_mode == "Random")
-        {
-            base_points = calculate_base_points_random(transform);
-        }
-        else if (current_mode == "Loxodrome")
-        {
-            base_points = calculate_base_points_loxodrome(transform);
-        }
-        else if (current_mode == "Curl")
+/**
+ * Brings `mesh_hopf` up to date with a finished job (whose base points have already been uploaded to
+ * `mesh_base_points`). Fibers that were generated on the CPU are copied into the next region of a
+ * streaming mesh, so continuous slider drags never re-allocate GPU storage, and only the fibers that
+ * changed are copied when the layout stays the same.
+ */
+void update_fibration(graphics::Mesh& mesh_hopf, const graphics::Mesh& mesh_base_points, const hopf::FibrationResult& result, graphics::FibrationCompute& fibration_compute)
+{
+    const bool on_gpu = !result.job.rotate_base_points;
+
+    if (result.job.output == hopf::FiberOutput::None)
+    {
+        if (generate_on_gpu && !(on_gpu && draw_instanced))
         {
-            base_points = calculate_base_points_curl(transform);
+            mesh_hopf = fibration_compute.generate(mesh_base_points, result.job.parameters.iterations_per_fiber, on_gpu);
         }
         else
         {
-            throw std::runtime_error("Attempting to calculate base points from unknown mode");
+            // The vertex shader sweeps out the fibers from the base points, so there is nothing to upload
+            mesh_hopf = graphics::Mesh{};
         }
+        return;
+    }
 
-        return base_points;
+    // Compact vertices can only tell apart as many fibers as fit in 16 bits
+    graphics::VertexFormat format = graphics::VertexFormat::Standard;
+    if (compact_vertices && result.base_points.size() <= std::numeric_limits<uint16_t>::max() + size_t{ 1 })
+    {
+        format = result.job.output == hopf::FiberOutput::S3 ? graphics::VertexFormat::CompactS3 : graphics::VertexFormat::Compact;
     }
 
-    graphics::MeshData generate_fibration(const std::vector<Vertex>& base_points, size_t iterations_per_fiber = 300)
+    if (!mesh_hopf.is_streaming() || mesh_hopf.get_format() != format)
     {
-        auto phis = utils::linear_spacing(0.0f, glm::two_pi<float>(), iterations_per_fiber);
-        std::vector<Vertex> vertices;
-        std::vector<uint32_t> indices;
+        mesh_hopf = graphics::Mesh::streaming(3, format);
+    }
 
-        for (size_t i = 0; i < base_points.size(); ++i)
-        {
-            // Grab the current base point on S2
-            const auto point = base_points[i];
-            const float a = point.position.x;
-            const float b = point.position.y;
-            const float c = point.position.z;
+    // If only some fibers changed (see `hopf::FiberCache`), only re-upload those
+    if (result.partial && mesh_hopf.update_vertices(result.fibration.first, result.changed_vertices))
+    {
+        return;
+    }
 
-            const float coeff = 1.0f / sqrtf(2.0f * (1.0f + c));
+    mesh_hopf.update(result.fibration.first, result.fibration.second);
+}
 
-            // Every `iterations_per_fiber` points (in 4-space) form a single fiber of the Hopf fibration
-            for (size_t j = 0; j < iterations_per_fiber; ++j)
+/**
+ * Uploads `circles` to the shader storage buffer `buffer` in the layout of `FiberCircles` (see `hopf.vert`):
+ * the center and radius of each circle, followed by its normal.
+ */
+void upload_fiber_circles(uint32_t buffer, const std::vector<Circle>& circles)
+{
+    std::vector<glm::vec4> entries;
+    entries.reserve(circles.size() * 2);
+    for (const auto& circle : circles)
+    {
+        entries.push_back(glm::vec4{ circle.center, circle.radius });
+        entries.push_back(glm::vec4{ circle.normal, 0.0f });
+    }
+
+    // An empty buffer can't be bound, so always allocate at least one circle
+    entries.resize(std::max<size_t>(entries.size(), 2));
+    glNamedBufferData(buffer, entries.size() * sizeof(glm::vec4), entries.data(), GL_DYNAMIC_DRAW);
+}
+
+/**
+ * Compares the compute-shader generator against the CPU generator in every mode (for both projected
+ * and S3 output) and prints the largest differences. Returns `true` if they agree within tolerance.
+ */
+bool validate_compute_generator(graphics::FibrationCompute& compute)
+{
+    // The modified projection is ill-conditioned near w = -1, where different (correct) implementations
+    // of `acos` can disagree by ~1e-4 (see `hopf-gen --accuracy-report`)
+    const float tolerance = 1e-3f;
+    bool passed = true;
+
+    for (const auto& mode : hopf::get_modes())
+    {
+        hopf::Parameters validation_parameters = parameters;
+        validation_parameters.mode = mode;
+
+        for (const bool s3_output : { false, true })
+        {
+            const auto base_points = hopf::get_base_points(validation_parameters);
+            const auto expected = s3_output ? hopf::generate_fibration_s3(base_points, validation_parameters.iterations_per_fiber, generator_settings)
+                                            : hopf::generate_fibration(base_points, validation_parameters.iterations_per_fiber, generator_settings);
+
+            graphics::Mesh mesh_base_points{ base_points, { /* No indices */ } };
+            auto mesh = compute.generate(mesh_base_points, validation_parameters.iterations_per_fiber, s3_output);
+            mesh.read_back();
+
+            // Vertices are only compared if there are as many as expected
+            const auto& vertices = mesh.get_vertices();
+            const bool sizes_match = vertices.size() == expected.first.size();
+            float max_position_error = 0.0f;
+            float max_color_error = 0.0f;
+            for (size_t i = 0; sizes_match && i < vertices.size(); ++i)
             {
-                const float phi = phis[j];
-
-                // Points in 4-space: a rotation by the quaternion <x, y, z, w> would send the
-                // point <0, 0, 1> on S2 to the point <a, b, c> - thus, each base point sweeps
-                // out a great circle ("fiber") on S2
-                const float theta = atan2f(-a, b) - phi;
-                const float alpha = sqrtf((1.0f + c) / 2.0f);
-                const float beta = sqrtf((1.0f - c) / 2.0f);
-
-                const float	w = alpha * cosf(theta);
-                const float	x = alpha * sinf(theta);
-                const float	y = beta * cosf(phi);
-                const float	z = beta * sinf(phi);
-
-                // Modified stereographic projection onto the unit ball in 3-space from:
-                // https://nilesjohnson.net/hopf-production.html
-                const float r = acosf(w) / glm::pi<float>();
-                const float projection = r / sqrtf(1.0f - w * w);
-
-                Vertex vertex;
-
-                vertex.position = glm::vec3{
-                    projection * x,
-                    projection * y,
-                    projection * z
-                };
-                vertex.color = glm::vec3{
-                    a * 0.5f + 0.5f,
-                    b * 0.5f + 0.5f,
-                    c * 0.5f + 0.5f
-                };
-                vertex.texture_coordinate = glm::vec2{
-                    0.0f, // Unused, at the moment
-                    0.0f
-                };
-
-                vertices.push_back(vertex);
-                indices.push_back(j + iterations_per_fiber * i);
+                const Vertex& a = vertices[i];
+                const Vertex& b = expected.first[i];
+
+                max_position_error = std::max(max_position_error, glm::length(a.position - b.position));
+                max_position_error = std::max(max_position_error, std::abs(a.texture_coordinate.x - b.texture_coordinate.x));
+                max_color_error = std::max(max_color_error, glm::length(a.color - b.color));
             }
+            const bool indices_match = mesh.get_indices() == expected.second;
+            const bool ok = sizes_match && indices_match && max_position_error <= tolerance && max_color_error <= tolerance;
 
-            // Primitive restart
-            indices.push_back(std::numeric_limits<uint32_t>::max());
-        }
+            std::cout << (ok ? "[PASS] " : "[FAIL] ") << mode << (s3_output ? " (S3)" : " (projected)")
+                      << ": " << vertices.size() << " vertices (expected " << expected.first.size() << "), max position error " << max_position_error
+                      << ", max color error " << max_color_error
+                      << ", indices " << (indices_match ? "identical" : "differ") << "\n";
 
-        return { vertices, indices };
+            passed &= ok;
+        }
     }
 
+    return passed;
 }
 
-int main()
+int main(int argc, char** argv)
 {
+    // `--validate-compute` checks the compute-shader generator against the CPU and exits: it only
+    // needs OpenGL 4.5, so it also runs on Mesa's llvmpipe (`LIBGL_ALWAYS_SOFTWARE=1`)
+    const bool validate_compute = argc > 1 && std::string{ argv[1] } == "--validate-compute";
+
+    // Generate fibers on all hardware threads, with the fastest kernel
+    generator_settings.thread_count = 0;
+    generator_settings.kernel = hopf::SweepKernel::PhaseTable;
+
     // Create and configure the GLFW window 
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, validate_compute ? 5 : 6);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_RESIZABLE, false);
     glfwWindowHint(GLFW_SAMPLES, 4);
+    glfwWindowHint(GLFW_VISIBLE, !validate_compute);
     GLFWwindow* window = glfwCreateWindow(window_w, window_h, "Hopf Fibration", nullptr, nullptr);
 
     if (window == nullptr)
@@ -459,6 +513,8 @@ int main()
     glfwSetScrollCallback(window, scroll_callback);
     glfwSetKeyCallback(window, key_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
+    glfwSetWindowRefreshCallback(window, refresh_callback);
     glfwSetWindowUserPointer(window, &input_data);
 
     // Load function pointers from glad
@@ -467,6 +523,22 @@ int main()
         std::cout << "Failed to initialize GLAD" << std::endl;
         exit(EXIT_FAILURE);
     }
+
+    // Linked programs are kept on disk between runs, since compiling them dominates startup under software
+    // rasterizers (see `graphics::ProgramCache`)
+    graphics::ProgramCache program_cache{ "program_cache" };
+
+    graphics::FibrationCompute fibration_compute{ "../shaders/fibration.comp", &program_cache };
+
+    if (validate_compute)
+    {
+        const bool passed = validate_compute_generator(fibration_compute);
+
+        glfwDestroyWindow(window);
+        glfwTerminate();
+
+        return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
     
     // Initialize ImGui
     IMGUI_CHECKVERSION();
@@ -487,7 +559,8 @@ int main()
         // Depth testing
         glEnable(GL_DEPTH_TEST);
         
-        // Primitive restart (for drawing all fibers via a single VBO)
+        // Primitive restart (for meshes that draw several primitives from one index buffer: fibrations are
+        // drawn with one indirect command per fiber instead, see `graphics::Mesh::update()`)
         glEnable(GL_PRIMITIVE_RESTART);
         glPrimitiveRestartIndex(std::numeric_limits<uint32_t>::max());
 
@@ -504,23 +577,108 @@ int main()
     }
 
     // Load shader programs
-    auto shader_depth = graphics::Shader{ "../shaders/depth.vert", "../shaders/depth.frag" };
-    auto shader_hopf = graphics::Shader{ "../shaders/hopf.vert", "../shaders/hopf.frag" };
-    auto shader_ui = graphics::Shader{ "../shaders/ui.vert", "../shaders/ui.frag" };
+    auto shader_depth = graphics::Shader{ "../shaders/depth.vert", "../shaders/depth.frag", &program_cache };
+    auto shader_hopf = graphics::Shader{ "../shaders/hopf.vert", "../shaders/hopf.frag", &program_cache };
+    auto shader_ui = graphics::Shader{ "../shaders/ui.vert", "../shaders/ui.frag", &program_cache };
+
+    // The uniforms that are set for every draw of the fibration, looked up once (in either of the programs
+    // that draw it)
+    struct FibrationLocations
+    {
+        int32_t model;
+        int32_t s3_positions;
+        int32_t instanced_fibers;
+        int32_t rotation;
+        int32_t projection_mode;
+        int32_t fiber_colors;
+        int32_t circle_fibers;
+    };
+    const auto get_fibration_locations = [](const graphics::Shader& shader)
+    {
+        return FibrationLocations{
+            shader.get_uniform_location("u_model"),
+            shader.get_uniform_location("u_s3_positions"),
+            shader.get_uniform_location("u_instanced_fibers"),
+            shader.get_uniform_location("u_rotation"),
+            shader.get_uniform_location("u_projection_mode"),
+            shader.get_uniform_location("u_fiber_colors"),
+            shader.get_uniform_location("u_circle_fibers")
+        };
+    };
+    const FibrationLocations locations_depth = get_fibration_locations(shader_depth);
+    const FibrationLocations locations_hopf = get_fibration_locations(shader_hopf);
+    const int32_t location_ui_model = shader_ui.get_uniform_location("u_model");
+    const int32_t location_display_shadows = shader_hopf.get_uniform_location("u_display_shadows");
+    const int32_t location_shadow_technique = shader_hopf.get_uniform_location("u_shadow_technique");
+
+    // The matrices (and time) that the programs share: one slot for the preview of the base points, and
+    // one for the scene (which both the shadow map and the window are rendered with)
+    const size_t frame_slot_preview = 0;
+    const size_t frame_slot_scene = 1;
+    graphics::UniformBuffer<graphics::FrameUniforms> frame_uniforms{ 2 };
     
-    // Generate initial base points on S2 as well as other mesh primitives
-    std::vector<Vertex> base_points = hopf::get_base_points(current_mode);
-    auto hopf_data = hopf::generate_fibration(base_points, iterations_per_fiber);
+    // Generate the initial fibration (waiting for it, since there is nothing to draw before it) as well as
+    // other mesh primitives. From here on, the fibration is regenerated on a background thread and the
+    // result that is on screen is kept in `fibration_result`, which describes the path it was generated for
+    hopf::FibrationWorker fibration_worker;
+    utils::ExportWorker export_worker;
+    hopf::FibrationResult fibration_result;
+
+    // A cache file (see `hopf::save_fibration_cache()`) on the command line takes the place of the initial
+    // fibration: its settings are restored and its fibers are drawn (and exported) from the mapped file, until
+    // the first regeneration replaces them
+    std::shared_ptr<const hopf::FibrationCacheFile> displayed_cache;
+    if (argc > 1 && utils::get_extension(argv[1]) == "hopfcache")
+    {
+        try
+        {
+            displayed_cache = std::make_shared<const hopf::FibrationCacheFile>(argv[1]);
+        }
+        catch (const std::runtime_error& e)
+        {
+            std::cerr << "Error: " << e.what() << "\n";
+        }
+    }
+
+    if (displayed_cache)
+    {
+        restore_fibration_job(displayed_cache->get_job());
+        fibration_result.job = make_fibration_job();
+        fibration_result.base_points.assign(displayed_cache->get_base_points(), displayed_cache->get_base_points() + displayed_cache->get_base_point_count());
+    }
+    else
+    {
+        fibration_worker.submit(make_fibration_job());
+        fibration_worker.poll(fibration_result, true);
+    }
+
     auto sphere_data = graphics::Mesh::from_sphere(0.75f, glm::vec3{ 0.0f, 0.0f, 0.0f }, 20, 20);
     auto grid_data = graphics::Mesh::from_grid(2.0f, 2.0f, glm::vec3{ 0.0f, -1.0f, 0.0f });
     auto coordinate_frame_data = graphics::Mesh::from_coordinate_frame(0.75f, glm::vec3{ -2.0f, -2.0f, -2.0f });
 
-    graphics::Mesh mesh_base_points{ base_points, { /* No indices */ } };
-    graphics::Mesh mesh_hopf{ hopf_data.first, hopf_data.second };
+    graphics::Mesh mesh_base_points{ fibration_result.base_points, { /* No indices */ } };
+    graphics::Mesh mesh_hopf;
+    if (displayed_cache && fibration_result.job.output != hopf::FiberOutput::None)
+    {
+        mesh_hopf = upload_cached_fibration(*displayed_cache);
+    }
+    else
+    {
+        update_fibration(mesh_hopf, mesh_base_points, fibration_result, fibration_compute);
+    }
+    graphics::Mesh mesh_fiber_template{ hopf::get_fiber_template(parameters.iterations_per_fiber), { /* No indices */ } };
     graphics::Mesh mesh_sphere{ sphere_data.first, sphere_data.second };
     graphics::Mesh mesh_grid{ grid_data.first, grid_data.second };
     graphics::Mesh mesh_coordinate_frame{ coordinate_frame_data.first, coordinate_frame_data.second };
 
+    // The exact circle of every fiber (when `draw_circles` is set), which only has to be recomputed when
+    // the base points or the rotation change
+    uint32_t buffer_circles;
+    glCreateBuffers(1, &buffer_circles);
+    upload_fiber_circles(buffer_circles, {});
+    bool circles_need_update = true;
+    glm::vec4 circles_rotation{ 0.0f };
+
     // Create the offscreen framebuffer that we will render the S2 sphere into
     uint32_t framebuffer_ui;
     uint32_t texture_ui;
@@ -548,40 +706,93 @@ int main()
         }
     }
     
-    // Create the offscreen framebuffer that we will render depth into (for shadow mapping)
-    uint32_t framebuffer_depth;
-    uint32_t texture_depth;
+    // The offscreen targets that we will render depth into (for shadow mapping)
+    graphics::ShadowMap shadow_map{ depth_w, depth_h, "../shaders/blur.comp", &program_cache };
+
+    // Every program has been created by now
+    const graphics::ProgramCache::Statistics& program_statistics = program_cache.get_statistics();
+    std::cout << "Programs: " << program_statistics.loaded << " loaded from cache, " << program_statistics.compiled << " compiled";
+    if (program_statistics.rejected != 0)
     {
-        glCreateFramebuffers(1, &framebuffer_depth);
+        std::cout << " (" << program_statistics.rejected << " cached binaries rejected by the driver)";
+    }
+    std::cout << ", " << program_statistics.seconds_saved * 1000.0 << " ms saved\n";
 
-        // Create a color attachment texture and associate it with the framebuffer
-        const float border[] = { 1.0, 1.0, 1.0, 1.0 };
-        glCreateTextures(GL_TEXTURE_2D, 1, &texture_depth);
-        glTextureStorage2D(texture_depth, 1, GL_DEPTH_COMPONENT32F, depth_w, depth_h);
-        glTextureParameteri(texture_depth, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTextureParameteri(texture_depth, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTextureParameteri(texture_depth, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-        glTextureParameteri(texture_depth, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-        glTextureParameterfv(texture_depth, GL_TEXTURE_BORDER_COLOR, border);
-        glNamedFramebufferTexture(framebuffer_depth, GL_DEPTH_ATTACHMENT, texture_depth, 0);
-        
-        glNamedFramebufferDrawBuffer(framebuffer_depth, GL_NONE);
-        glNamedFramebufferReadBuffer(framebuffer_depth, GL_NONE);
+    // Skips the offscreen passes whose inputs haven't changed, and tells the loop below when it can stop drawing
+    graphics::Renderer renderer;
 
-        // Now that we actually created the framebuffer and added all attachments we want to check if it is actually complete 
-        if (glCheckNamedFramebufferStatus(framebuffer_depth, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        {
-            std::cerr << "Error: framebuffer is not complete\n";
-        }
-    }
+    // Where the time goes on each frame (the GPU timings only cover the passes that actually ran)
+    graphics::FrameProfiler profiler;
+    const size_t timing_frame = profiler.add_series("Frame (CPU)", graphics::FrameProfiler::Clock::Cpu);
+    const size_t timing_base_points = profiler.add_series("Base Points (CPU)", graphics::FrameProfiler::Clock::Cpu);
+    const size_t timing_generation = profiler.add_series("Generation (CPU)", graphics::FrameProfiler::Clock::Cpu);
+    const size_t timing_upload = profiler.add_series("Upload (CPU)", graphics::FrameProfiler::Clock::Cpu);
+    const size_t timing_preview = profiler.add_series("Preview (GPU)", graphics::FrameProfiler::Clock::Gpu);
+    const size_t timing_shadow_map = profiler.add_series("Shadow Map (GPU)", graphics::FrameProfiler::Clock::Gpu);
+    const size_t timing_scene = profiler.add_series("Scene (GPU)", graphics::FrameProfiler::Clock::Gpu);
+    const size_t timing_imgui = profiler.add_series("ImGui (GPU)", graphics::FrameProfiler::Clock::Gpu);
+
+    // Incremented whenever a new fibration is swapped in (new base points, fibers or fiber template)
+    uint64_t fibration_version = 0;
 
     while (!glfwWindowShouldClose(window))
     {
         // Update flag that denotes whether or not the user is interacting with ImGui
         input_data.imgui_active = io.WantCaptureMouse;
 
-        // Poll regular GLFW window events
-        glfwPollEvents();
+        // Once the frame on screen is up to date, sleep until the next event instead of drawing the same frame
+        // over and over again, unless a background worker is about to change what is on screen
+        const bool workers_busy = fibration_worker.is_busy() || export_worker.is_busy();
+        if (renderer.is_idle() && !workers_busy)
+        {
+            glfwWaitEvents();
+        }
+        else
+        {
+            glfwPollEvents();
+        }
+
+        // Keep drawing while there is progress to show, and for a few frames after it is done
+        if (input_data.events || workers_busy)
+        {
+            renderer.request_frames();
+            input_data.events = false;
+        }
+        renderer.begin_frame();
+        profiler.begin_frame();
+        const auto frame_start = std::chrono::steady_clock::now();
+
+        // Swap in the fibration from the background generator once it is done (until then, the last
+        // finished one is drawn)
+        if (fibration_worker.poll(fibration_result))
+        {
+            displayed_cache.reset();
+            ++fibration_version;
+
+            const auto upload_start = std::chrono::steady_clock::now();
+            mesh_base_points.set_vertices(fibration_result.base_points);
+            update_fibration(mesh_hopf, mesh_base_points, fibration_result, fibration_compute);
+            profiler.add_cpu(timing_upload, std::chrono::duration<double>(std::chrono::steady_clock::now() - upload_start).count());
+
+            if (fibration_result.base_points_seconds > 0.0)
+            {
+                profiler.add_cpu(timing_base_points, fibration_result.base_points_seconds);
+            }
+            profiler.add_cpu(timing_generation, fibration_result.generation_seconds);
+            circles_need_update = true;
+
+            const size_t iterations_per_fiber = fibration_result.job.parameters.iterations_per_fiber;
+            if (mesh_fiber_template.get_vertex_count() != iterations_per_fiber)
+            {
+                mesh_fiber_template.set_vertices(hopf::get_fiber_template(iterations_per_fiber));
+            }
+        }
+
+        // Whether the fibration that is on screen was generated for the GPU path (the checkbox may have
+        // changed since), and whether it is drawn instanced
+        const bool displayed_on_gpu = !fibration_result.job.rotate_base_points;
+        const bool displayed_instanced = displayed_on_gpu && draw_instanced;
+        const bool displayed_circles = displayed_instanced && draw_circles && projection_mode == hopf::Projection::Stereographic;
 
         // This flag will be set to `true` by the various UI elements if the settings have changed
         // in such a way as to warrant a recalculation of the fibration topology 
@@ -598,18 +809,23 @@ int main()
 
                 // Global settings (shared across modes)
                 ImGui::TextColored(ImGui::GetStyleColorVec4(ImGuiCol_PlotHistogram), "Primary Controls");
-                topology_needs_update |= ImGui::SliderInt("Number of Fibers", (int*)&number_of_fibers, 1, 1000);
-                topology_needs_update |= ImGui::SliderInt("Iterations per Fibers", (int*)&iterations_per_fiber, 10, 500);
-                ImGui::Text("Total Vertices: %d", number_of_fibers * iterations_per_fiber);
-                if (ImGui::BeginCombo("Mode", current_mode.c_str())) 
+                topology_needs_update |= ImGui::SliderInt("Number of Fibers", (int*)&parameters.number_of_fibers, 1, 1000);
+                topology_needs_update |= ImGui::SliderInt("Iterations per Fibers", (int*)&parameters.iterations_per_fiber, 10, 500);
+                ImGui::Text("Total Vertices: %zu", parameters.number_of_fibers * parameters.iterations_per_fiber);
+                if (fibration_result.job.vertex_budget != 0 && fibration_result.job.output != hopf::FiberOutput::None)
+                {
+                    ImGui::Text("Generated Vertices: %zu (Adaptive)", fibration_result.fibration.first.size());
+                }
+                if (ImGui::BeginCombo("Mode", parameters.mode.c_str())) 
                 {
+                    const auto& modes = hopf::get_modes();
                     for (size_t i = 0; i < modes.size(); ++i)
                     {
-                        bool is_selected = current_mode.c_str() == modes[i];
+                        bool is_selected = parameters.mode == modes[i];
                         if (ImGui::Selectable(modes[i].c_str(), is_selected))
                         {
                             topology_needs_update |= true;
-                            current_mode = modes[i];
+                            parameters.mode = modes[i];
                         }
                         if (is_selected)
                         {
@@ -622,58 +838,105 @@ int main()
                 ImGui::Separator();
 
                 // Per-mode UI settings
-                if (current_mode == "Great Circle")
+                if (parameters.mode == "Great Circle")
                 {
                     ImGui::TextColored(ImGui::GetStyleColorVec4(ImGuiCol_PlotHistogram), "Per-Fiber Settings");
-                    bool number_of_circles_changed = ImGui::SliderInt("Number of Circles", (int*)&number_of_circles, 1, 10);
+                    bool number_of_circles_changed = ImGui::SliderInt("Number of Circles", (int*)&parameters.number_of_circles, 1, 10);
                     topology_needs_update |= number_of_circles_changed;
 
                     // Resize radii / arc angle vectors if the user has changed the number of circles
                     if (number_of_circles_changed)
                     {
-                        offsets = utils::linear_spacing(0.0f, -0.9f, number_of_circles);
-                        arc_angles = utils::linear_spacing((glm::two_pi<float>()) * 0.25f, glm::two_pi<float>() * 0.75f, number_of_circles);
+                        parameters.offsets = utils::linear_spacing(0.0f, -0.9f, parameters.number_of_circles);
+                        parameters.arc_angles = utils::linear_spacing((glm::two_pi<float>()) * 0.25f, glm::two_pi<float>() * 0.75f, parameters.number_of_circles);
                     }
 
                     // Draw per-circle sliders with a different color
                     ImGui::PushStyleColor(ImGuiCol_SliderGrab, ImGui::GetStyleColorVec4(ImGuiCol_PlotHistogram));
                     {
-                        for (size_t i = 0; i < number_of_circles; ++i)
+                        for (size_t i = 0; i < parameters.number_of_circles; ++i)
                         {
                             const std::string name = "Circle " + std::to_string(i + 1);
                             const std::string offset_name = "Offset##" + std::to_string(i + 1);
                             const std::string arc_angle_name = "Arc Angle##" + std::to_string(i + 1);
                             ImGui::Text(name.c_str());
 
-                            topology_needs_update |= ImGui::SliderFloat(offset_name.c_str(), &offsets[i], -0.99f, 0.99f);
-                            topology_needs_update |= ImGui::SliderFloat(arc_angle_name.c_str(), &arc_angles[i], 0.01f, glm::two_pi<float>());
+                            topology_needs_update |= ImGui::SliderFloat(offset_name.c_str(), &parameters.offsets[i], -0.99f, 0.99f);
+                            topology_needs_update |= ImGui::SliderFloat(arc_angle_name.c_str(), &parameters.arc_angles[i], 0.01f, glm::two_pi<float>());
                         }
                     }
                     ImGui::PopStyleColor();
                 }
-                else if (current_mode == "Random")
+                else if (parameters.mode == "Random")
                 {
-                    topology_needs_update |= ImGui::SliderInt("Seed", (int*)&seed, 0, 1000);
-                    topology_needs_update |= ImGui::SliderFloat("Mean", &mean, -3.0f, 3.0f);
-                    topology_needs_update |= ImGui::SliderFloat("Standard Deviation", &standard_deviation, 0.1f, 3.0f);
+                    topology_needs_update |= ImGui::SliderInt("Seed", (int*)&parameters.seed, 0, 1000);
+                    topology_needs_update |= ImGui::SliderFloat("Mean", &parameters.mean, -3.0f, 3.0f);
+                    topology_needs_update |= ImGui::SliderFloat("Standard Deviation", &parameters.standard_deviation, 0.1f, 3.0f);
                 }
-                else if (current_mode == "Loxodrome")
+                else if (parameters.mode == "Loxodrome")
                 {
-                    topology_needs_update |= ImGui::SliderFloat("Loxodrome Offset", &loxodrome_offset, 2.0f, 20.0f);
+                    topology_needs_update |= ImGui::SliderFloat("Loxodrome Offset", &parameters.loxodrome_offset, 2.0f, 20.0f);
                 }
-                else if (current_mode == "Curl")
+                else if (parameters.mode == "Curl")
                 {
-                    topology_needs_update |= ImGui::SliderFloat("Curl Alpha", &curl_alpha, 4.0f, 10.0f);
-                    topology_needs_update |= ImGui::SliderFloat("Curl Beta", &curl_beta, 0.0f, 1.0f);
+                    topology_needs_update |= ImGui::SliderFloat("Curl Alpha", &parameters.curl_alpha, 4.0f, 10.0f);
+                    topology_needs_update |= ImGui::SliderFloat("Curl Beta", &parameters.curl_beta, 0.0f, 1.0f);
                 }
 
                 ImGui::Separator();
 
                 // Global rotation applied to all base points in every mode
                 ImGui::TextColored(ImGui::GetStyleColorVec4(ImGuiCol_PlotHistogram), "Rotations - Euler Angles (Applied to Points)");
-                topology_needs_update |= ImGui::SliderFloat("Rotation X", &rotation_x, 0.0f, glm::pi<float>());
-                topology_needs_update |= ImGui::SliderFloat("Rotation Y", &rotation_y, 0.0f, glm::pi<float>());
-                topology_needs_update |= ImGui::SliderFloat("Rotation Z", &rotation_z, 0.0f, glm::pi<float>());
+                bool rotation_changed = false;
+                rotation_changed |= ImGui::SliderFloat("Rotation X", &parameters.rotation_x, 0.0f, glm::pi<float>());
+                rotation_changed |= ImGui::SliderFloat("Rotation Y", &parameters.rotation_y, 0.0f, glm::pi<float>());
+                rotation_changed |= ImGui::SliderFloat("Rotation Z", &parameters.rotation_z, 0.0f, glm::pi<float>());
+
+                // On the GPU path, rotations are just a uniform (but adaptive fibers are sized by how they end up on screen)
+                topology_needs_update |= rotation_changed && (!rotate_on_gpu || adaptive_sampling);
+                topology_needs_update |= ImGui::Checkbox("Rotate and Project on the GPU", &rotate_on_gpu);
+                if (rotate_on_gpu)
+                {
+                    topology_needs_update |= ImGui::Checkbox("Draw Fibers Instanced (From Base Points)", &draw_instanced);
+                }
+                if (!(rotate_on_gpu && draw_instanced))
+                {
+                    topology_needs_update |= ImGui::Checkbox("Generate Fibers with a Compute Shader", &generate_on_gpu);
+                }
+                if (!(rotate_on_gpu && draw_instanced) && !generate_on_gpu)
+                {
+                    ImGui::Checkbox("Refine Fibers Progressively", &refine_progressively);
+                    topology_needs_update |= ImGui::Checkbox("Sample Fibers Adaptively", &adaptive_sampling);
+                    if (adaptive_sampling)
+                    {
+                        topology_needs_update |= ImGui::SliderInt("Vertex Budget", &vertex_budget, 1000, 500000);
+                    }
+                    topology_needs_update |= ImGui::Checkbox("Compact Vertices (16-Bit Positions)", &compact_vertices);
+                }
+
+                // Only the GPU path supports projections other than the modified stereographic projection
+                if (rotate_on_gpu && ImGui::BeginCombo("Projection", hopf::to_string(projection_mode)))
+                {
+                    for (const auto projection : { hopf::Projection::Modified, hopf::Projection::Stereographic })
+                    {
+                        bool is_selected = projection_mode == projection;
+                        if (ImGui::Selectable(hopf::to_string(projection), is_selected))
+                        {
+                            projection_mode = projection;
+                        }
+                        if (is_selected)
+                        {
+                            ImGui::SetItemDefaultFocus();
+                        }
+                    }
+                    ImGui::EndCombo();
+                }
+
+                // Only the stereographic projection maps fibers onto circles
+                if (rotate_on_gpu && draw_instanced && projection_mode == hopf::Projection::Stereographic)
+                {
+                    ImGui::Checkbox("Draw Fibers as Exact Circles", &draw_circles);
+                }
 
                 ImGui::End();
             }
@@ -686,22 +949,244 @@ int main()
             // Container #3: appearance and export
             {
                 ImGui::Begin("Appearance and Export");
+                // The format is picked by the extension of the filename (see `utils::save_polylines()`)
+                const std::string extension = utils::get_extension(filename);
+                if (ImGui::BeginCombo("Format", extension.c_str()))
+                {
+                    for (const char* format : { "obj", "ply", "glb", "hopfcache" })
+                    {
+                        bool is_selected = extension == format;
+                        if (ImGui::Selectable(format, is_selected))
+                        {
+                            const std::string name{ filename };
+                            const std::string stem = extension.empty() ? name : name.substr(0, name.size() - extension.size() - 1);
+                            snprintf(filename, sizeof(filename), "%s.%s", stem.c_str(), format);
+                        }
+                        if (is_selected)
+                        {
+                            ImGui::SetItemDefaultFocus();
+                        }
+                    }
+                    ImGui::EndCombo();
+                }
+                if (extension == "glb")
+                {
+                    ImGui::Checkbox("Quantize (KHR_mesh_quantization)", &quantize_export);
+                }
                 ImGui::InputText("", filename, 64);
                 ImGui::SameLine();
-                if (ImGui::Button("Export"))
+                if (ImGui::Button("Export") && !export_worker.is_busy())
+                {
+                    // Export the fibration that is on screen (not one that is still being generated), at full
+                    // precision. Only what needs the OpenGL context happens here: the fibration is copied (or,
+                    // where the GPU path never generated it on the CPU, regenerated), projected and written on
+                    // the export thread, so the render loop keeps going while a large file is written
+                    const std::string name{ filename };
+                    std::function<void(utils::ExportProgress&)> task;
+
+                    const std::string export_extension = utils::get_extension(name);
+                    if (export_extension == "hopfcache")
+                    {
+                        // The result is cached as it was generated (on S3, or without any fibers, on the GPU path), along
+                        // with its job, so that opening the file restores the settings too
+                        auto result = std::make_shared<hopf::FibrationResult>();
+                        auto cache = displayed_cache;
+                        if (!cache)
+                        {
+                            *result = fibration_result;
+                        }
+                        const bool refined = fibration_result.level.fiber_stride == 1 && fibration_result.level.sample_stride == 1;
+
+                        task = [result, cache, refined, name](utils::ExportProgress& progress)
+                        {
+                            if (cache)
+                            {
+                                hopf::save_fibration_cache(name, cache->get_job(), cache->get_base_points(), cache->get_base_point_count(),
+                                                           cache->get_vertices(), cache->get_vertex_count(), cache->get_indices(), cache->get_index_count(), &progress);
+                            }
+                            else if (!refined)
+                            {
+                                throw std::runtime_error("The fibration is still being refined");
+                            }
+                            else
+                            {
+                                hopf::save_fibration_cache(name, result->job, result->base_points, result->fibration, &progress);
+                            }
+                        };
+                    }
+                    else if (displayed_circles && export_extension != "ply" && export_extension != "glb")
+                    {
+                        // Exact circles are written as curves, or (with a `.circles` extension) as a binary table (the
+                        // binary mesh formats have no curves, so they get sampled fibers instead)
+                        auto circles = std::make_shared<std::vector<Circle>>(hopf::get_fiber_circles(fibration_result.base_points, hopf::get_rotation_quaternion(parameters)));
+                        task = [circles, name, export_extension](utils::ExportProgress& progress)
+                        {
+                            if (export_extension == "circles")
+                            {
+                                utils::save_circle_table(*circles, name, &progress);
+                            }
+                            else
+                            {
+                                utils::save_circle_obj(*circles, name, 100.0f, &progress);
+                            }
+                        };
+                    }
+                    else
+                    {
+                        // Fibers that were generated on the CPU are still at hand (the GPU may only have a quantized
+                        // copy), fibers that were written by the compute shader have to be read back, and when
+                        // drawing instanced, the fibers have never been generated on the CPU at all
+                        auto displayed = std::make_shared<graphics::MeshData>();
+                        const bool generate = displayed_instanced;
+                        if (generate)
+                        {
+                            displayed->first = fibration_result.base_points;
+                        }
+                        else if (fibration_result.job.output == hopf::FiberOutput::None)
+                        {
+                            mesh_hopf.read_back();
+                            *displayed = { mesh_hopf.get_vertices(), mesh_hopf.get_indices() };
+                        }
+                        else if (!displayed_cache)
+                        {
+                            *displayed = fibration_result.fibration;
+                        }
+                        const auto cache = generate ? nullptr : displayed_cache;
+
+                        const size_t iterations_per_fiber = fibration_result.job.parameters.iterations_per_fiber;
+                        const bool project = displayed_on_gpu;
+                        const glm::vec4 rotation = hopf::get_rotation_quaternion(parameters);
+                        const bool quantize = quantize_export;
+                        const hopf::Projection projection = projection_mode;
+                        const hopf::GeneratorSettings settings = generator_settings;
+
+                        task = [=](utils::ExportProgress& progress)
+                        {
+                            if (generate)
+                            {
+                                *displayed = hopf::generate_fibration_s3(displayed->first, iterations_per_fiber, settings);
+                            }
+                            else if (cache && !project)
+                            {
+                                // Nothing to do but write the mapped file out in another format
+                                utils::save_polylines(cache->get_vertices(), cache->get_vertex_count(), cache->get_indices(), cache->get_index_count(), name, quantize, &progress);
+                                return;
+                            }
+                            else if (cache)
+                            {
+                                displayed->first.assign(cache->get_vertices(), cache->get_vertices() + cache->get_vertex_count());
+                                displayed->second.assign(cache->get_indices(), cache->get_indices() + cache->get_index_count());
+                            }
+
+                            if (project)
+                            {
+                                // Export what is on screen, which (on the GPU path) only exists after the vertex shader
+                                displayed->first = hopf::project_fibration(displayed->first, rotation, projection, settings);
+                            }
+
+                            utils::save_polylines(displayed->first, displayed->second, name, quantize, &progress);
+                        };
+                    }
+
+                    export_worker.start(name, task);
+                }
+
+                const auto export_status = export_worker.get_status();
+                if (export_status.busy)
                 {
-                    utils::save_polyline_obj(mesh_hopf, filename);
+                    ImGui::ProgressBar(export_status.get_fraction(), ImVec2(-1.0f, 0.0f));
                 }
+                else if (!export_status.error.empty())
+                {
+                    ImGui::Text("Export Failed: %s", export_status.error.c_str());
+                }
+                else if (!export_status.filename.empty())
+                {
+                    ImGui::Text("Exported %.1f MB in %.2f S (%.1f MB/S)",
+                                export_status.bytes_written / (1024.0f * 1024.0f),
+                                export_status.seconds,
+                                export_status.get_megabytes_per_second());
+                }
+
                 ImGui::ColorEdit3("Background Color", (float*)&clear_color);
                 ImGui::Checkbox("Show Floor Plane", &show_floor_plane);
                 ImGui::Checkbox("Draw as Points (Instead of Lines)", &draw_as_points);
                 ImGui::Checkbox("Display Shadows", &display_shadows);
+                if (display_shadows && ImGui::BeginCombo("Shadow Technique", graphics::to_string(shadow_technique)))
+                {
+                    for (const auto technique : { graphics::ShadowTechnique::Pcf, graphics::ShadowTechnique::HardwarePcf, graphics::ShadowTechnique::Variance })
+                    {
+                        bool is_selected = shadow_technique == technique;
+                        if (ImGui::Selectable(graphics::to_string(technique), is_selected))
+                        {
+                            shadow_technique = technique;
+                        }
+                        if (is_selected)
+                        {
+                            ImGui::SetItemDefaultFocus();
+                        }
+                    }
+                    ImGui::EndCombo();
+                }
                 ImGui::SliderFloat("Line Width", &line_width, 1.0f, 10.0f);
 
                 ImGui::Separator();
 
                 // Some statistics about framerate, etc.
                 ImGui::Text("Application Average %.3f MS/Frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+                if (fibration_worker.is_busy())
+                {
+                    ImGui::Text("Generating Fibration...");
+                }
+                for (const auto& pass : renderer.get_statistics())
+                {
+                    ImGui::Text("%s Pass: %zu Rendered, %zu Skipped", pass.name.c_str(), pass.rendered, pass.skipped);
+                }
+                ImGui::Text("Programs: %zu Cached, %zu Compiled (%.1f MS Saved at Startup)", program_statistics.loaded, program_statistics.compiled, program_statistics.seconds_saved * 1000.0);
+
+                // The most recent timings of each series, with their percentiles
+                for (size_t i = 0; i < profiler.get_series_count(); ++i)
+                {
+                    const graphics::TimingHistory& history = profiler.get_history(i);
+                    const std::vector<float> samples = history.get_samples();
+
+                    char overlay[96];
+                    std::snprintf(overlay, sizeof(overlay), "P50 %.2f / P95 %.2f / P99 %.2f MS",
+                                  history.get_percentile(50.0f),
+                                  history.get_percentile(95.0f),
+                                  history.get_percentile(99.0f));
+                    ImGui::PlotLines(profiler.get_name(i).c_str(), samples.data(), static_cast<int>(samples.size()), 0, overlay, 0.0f, std::numeric_limits<float>::max(), ImVec2(0.0f, 40.0f));
+                }
+                if (ImGui::Checkbox("Record Frame Timings (timings.csv)", &record_timings))
+                {
+                    if (record_timings)
+                    {
+                        try
+                        {
+                            profiler.start_recording(timings_filename);
+                        }
+                        catch (const std::runtime_error& error)
+                        {
+                            std::cerr << error.what() << '\n';
+                            record_timings = false;
+                        }
+                    }
+                    else
+                    {
+                        profiler.stop_recording();
+                    }
+                }
+
+                if (ImGui::SliderInt("Scene Cache Budget (MB)", &scene_cache_budget_mb, 0, 2048))
+                {
+                    fibration_worker.set_scene_cache_budget(static_cast<size_t>(scene_cache_budget_mb) * 1024 * 1024);
+                }
+                const auto scene_cache_statistics = fibration_worker.get_scene_cache_statistics();
+                ImGui::Text("Scene Cache: %zu Hits, %zu Misses (%zu Scenes, %.1f MB)",
+                            scene_cache_statistics.hits,
+                            scene_cache_statistics.misses,
+                            scene_cache_statistics.entries,
+                            scene_cache_statistics.bytes / (1024.0f * 1024.0f));
 
                 ImGui::End();
             }
@@ -709,22 +1194,31 @@ int main()
         ImGui::Render();
 
         // The transformation matrix that will be applied to the base points on S2 to generate the fibration
-        glm::mat4 ui_rotation_matrix{ 1.0f };
-        ui_rotation_matrix = glm::rotate(ui_rotation_matrix, rotation_x, glm::vec3{ 1.0f, 0.0f, 0.0f });
-        ui_rotation_matrix = glm::rotate(ui_rotation_matrix, rotation_y, glm::vec3{ 0.0f, 1.0f, 0.0f });
-        ui_rotation_matrix = glm::rotate(ui_rotation_matrix, rotation_z, glm::vec3{ 0.0f, 0.0f, 1.0f });
+        const glm::mat4 ui_rotation_matrix = hopf::get_rotation_matrix(parameters);
 
-        if (topology_needs_update)
+        // The same rotation, acting on S3 (for the GPU path)
+        const glm::vec4 rotation_quaternion = hopf::get_rotation_quaternion(parameters);
+
+        if (displayed_circles && (circles_need_update || rotation_quaternion != circles_rotation))
         {
-            std::vector<Vertex> base_points = hopf::get_base_points(current_mode, ui_rotation_matrix);
-            hopf_data = hopf::generate_fibration(base_points, iterations_per_fiber);
+            upload_fiber_circles(buffer_circles, hopf::get_fiber_circles(fibration_result.base_points, rotation_quaternion));
+            circles_need_update = false;
+            circles_rotation = rotation_quaternion;
+        }
 
-            mesh_base_points.set_vertices(base_points);
-            mesh_hopf = graphics::Mesh{ hopf_data.first, hopf_data.second };
+        // Hand the new settings to the background generator (cancelling whatever it was working on)
+        if (topology_needs_update)
+        {
+            fibration_worker.submit(make_fibration_job());
         }
 
-        // Render 3D objects to UI (offscreen) framebuffer
+
+        // Render 3D objects to UI (offscreen) framebuffer, unless the base points are the same as last time (only
+        // rotate the base points here if they weren't already rotated when they were generated)
+        const glm::mat4 preview_model_matrix = displayed_on_gpu ? ui_rotation_matrix : glm::mat4{ 1.0f };
+        if (renderer.begin_pass("Preview", graphics::PassInputs{}.add(fibration_version).add(preview_model_matrix)))
         {
+            profiler.begin_gpu(timing_preview);
             glLineWidth(4.0f);
 
             glViewport(0, 0, window_w, window_h);
@@ -749,23 +1243,50 @@ int main()
                 glm::vec3{ 0.0f, 1.0f, 0.0f }
             );
 
+            graphics::FrameUniforms frame{};
+            frame.projection = projection;
+            frame.view = view;
+            frame.time = static_cast<float>(glfwGetTime());
+            frame_uniforms.update(frame_slot_preview, frame);
+            frame_uniforms.bind(graphics::frame_uniforms_binding, frame_slot_preview);
+
             shader_ui.use();
-            shader_ui.uniform_float("u_time", glfwGetTime());
-            shader_ui.uniform_mat4("u_projection", projection);
-            shader_ui.uniform_mat4("u_view", view);
 
-            shader_ui.uniform_mat4("u_model", ui_rotation_matrix);
+            shader_ui.uniform_mat4(location_ui_model, preview_model_matrix);
             mesh_base_points.draw(GL_POINTS);
 
-            shader_ui.uniform_mat4("u_model", glm::mat4{ 1.0f });
+            shader_ui.uniform_mat4(location_ui_model, glm::mat4{ 1.0f });
             mesh_coordinate_frame.draw(GL_LINES);
 
-            shader_ui.uniform_mat4("u_model", glm::mat4{ 1.0f });
+            shader_ui.uniform_mat4(location_ui_model, glm::mat4{ 1.0f });
             mesh_sphere.draw();
 
             glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            profiler.end_gpu(timing_preview);
         }
 
+        // Draws the fibration (with whichever of the depth or color programs is bound) along the current path
+        auto draw_fibration = [&](const graphics::Shader& shader, const FibrationLocations& locations)
+        {
+            shader.uniform_bool(locations.s3_positions, displayed_on_gpu && !displayed_instanced);
+            shader.uniform_bool(locations.instanced_fibers, displayed_instanced);
+            shader.uniform_vec4(locations.rotation, rotation_quaternion);
+            shader.uniform_int(locations.projection_mode, static_cast<int>(projection_mode));
+            shader.uniform_bool(locations.fiber_colors, !displayed_instanced && mesh_hopf.get_format() == graphics::VertexFormat::Compact);
+            shader.uniform_bool(locations.circle_fibers, displayed_circles);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, buffer_circles);
+
+            const uint32_t mode = draw_as_points ? GL_POINTS : GL_LINE_LOOP;
+            if (displayed_instanced)
+            {
+                mesh_fiber_template.draw_instanced(mesh_base_points, mode);
+            }
+            else
+            {
+                mesh_hopf.draw(mode);
+            }
+        };
+
         // Render 3D objects to default framebuffer
         {
             glLineWidth(line_width);
@@ -778,83 +1299,112 @@ int main()
             const auto light_view = glm::lookAt(light_position, glm::vec3(0.0f), glm::vec3(0.0, 1.0, 0.0));
             const auto light_space_matrix = light_projection * light_view;
 
-            // Render pass #1: render depth
+            glm::mat4 projection = glm::perspective(
+                glm::radians(zoom),
+                static_cast<float>(window_w) / static_cast<float>(window_h),
+                0.1f,
+                1000.0f
+            );
+
+            graphics::FrameUniforms frame{};
+            frame.projection = projection;
+            frame.view = arcball_camera_matrix;
+            frame.light_space_matrix = light_space_matrix;
+            frame.time = static_cast<float>(glfwGetTime());
+
+            // Everything that changes how the fibration (and the floor) looks from any point of view
+            graphics::PassInputs scene_inputs;
+            scene_inputs.add(fibration_version)
+                        .add(arcball_model_matrix)
+                        .add(rotation_quaternion)
+                        .add(projection_mode)
+                        .add(displayed_on_gpu)
+                        .add(displayed_instanced)
+                        .add(displayed_circles)
+                        .add(draw_as_points)
+                        .add(line_width)
+                        .add(show_floor_plane);
+
+            // Render pass #1: render depth (only when it is sampled, and the scene has changed since it was last rendered)
+            graphics::PassInputs shadow_inputs = scene_inputs;
+            shadow_inputs.add(shadow_technique);
+
+            if (display_shadows && renderer.begin_pass("Shadow Map", shadow_inputs))
             {
-                glViewport(0, 0, depth_w, depth_h);
-                glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_depth);
+                profiler.begin_gpu(timing_shadow_map);
+                shadow_map.begin(shadow_technique);
 
-                // Clear the depth attachment (there are no color attachments)
-                const float clear_depth_value = 1.0f;
-                glClearNamedFramebufferfv(framebuffer_depth, GL_DEPTH, 0, &clear_depth_value);
+                frame_uniforms.update(frame_slot_scene, frame);
+                frame_uniforms.bind(graphics::frame_uniforms_binding, frame_slot_scene);
 
                 shader_depth.use();
-                shader_depth.uniform_mat4("u_light_space_matrix", light_space_matrix);
 
-                shader_depth.uniform_mat4("u_model", arcball_model_matrix);
-                if (draw_as_points)
-                {
-                    mesh_hopf.draw(GL_POINTS);
-                }
-                else
-                {
-                    mesh_hopf.draw(GL_LINE_LOOP);
-                }
+                shader_depth.uniform_mat4(locations_depth.model, arcball_model_matrix);
+                draw_fibration(shader_depth, locations_depth);
 
                 if (show_floor_plane)
                 {
-                    shader_depth.uniform_mat4("u_model", glm::mat4{ 1.0f });
+                    shader_depth.uniform_bool(locations_depth.s3_positions, false);
+                    shader_depth.uniform_bool(locations_depth.instanced_fibers, false);
+                    shader_depth.uniform_mat4(locations_depth.model, glm::mat4{ 1.0f });
                     mesh_grid.draw();
                 }
 
-                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                shadow_map.end(shadow_technique);
+                profiler.end_gpu(timing_shadow_map);
             }
             
-            // Render pass #2: draw scene with shadows
+            // Render pass #2: draw scene with shadows, along with the UI (which may change on any frame that is
+            // requested, see `graphics::Renderer`)
+            graphics::PassInputs window_inputs = scene_inputs;
+            window_inputs.add(arcball_camera_matrix)
+                         .add(zoom)
+                         .add(clear_color)
+                         .add(display_shadows)
+                         .add(shadow_technique)
+                         .add(renderer.get_version("Shadow Map"))
+                         .add(renderer.get_version("Preview"));
+
+            if (renderer.begin_pass("Window", window_inputs, renderer.is_frame_requested()))
             {
+                profiler.begin_gpu(timing_scene);
                 glViewport(0, 0, window_w, window_h);
 
                 glClearColor(clear_color.x, clear_color.y, clear_color.z, clear_color.w);
                 glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-                glm::mat4 projection = glm::perspective(
-                    glm::radians(zoom),
-                    static_cast<float>(window_w) / static_cast<float>(window_h),
-                    0.1f,
-                    1000.0f
-                );
+                frame_uniforms.update(frame_slot_scene, frame);
+                frame_uniforms.bind(graphics::frame_uniforms_binding, frame_slot_scene);
 
                 shader_hopf.use();
-                shader_hopf.uniform_texture(0, texture_depth);
-                shader_hopf.uniform_bool("u_display_shadows", display_shadows);
-                shader_hopf.uniform_mat4("u_light_space_matrix", light_space_matrix);
-                shader_hopf.uniform_float("u_time", glfwGetTime());
-                shader_hopf.uniform_mat4("u_projection", projection);
-                shader_hopf.uniform_mat4("u_view", arcball_camera_matrix);
-
-                shader_hopf.uniform_mat4("u_model", arcball_model_matrix);
-                if (draw_as_points)
-                {
-                    mesh_hopf.draw(GL_POINTS);
-                }
-                else
-                {
-                    mesh_hopf.draw(GL_LINE_LOOP);
-                }
+                shadow_map.bind();
+                shader_hopf.uniform_bool(location_display_shadows, display_shadows);
+                shader_hopf.uniform_int(location_shadow_technique, static_cast<int>(shadow_technique));
+
+                shader_hopf.uniform_mat4(locations_hopf.model, arcball_model_matrix);
+                draw_fibration(shader_hopf, locations_hopf);
 
                 if (show_floor_plane)
                 {
-                    shader_hopf.uniform_mat4("u_model", glm::mat4{ 1.0f });
+                    shader_hopf.uniform_bool(locations_hopf.s3_positions, false);
+                    shader_hopf.uniform_bool(locations_hopf.instanced_fibers, false);
+                    shader_hopf.uniform_bool(locations_hopf.fiber_colors, false);
+                    shader_hopf.uniform_mat4(locations_hopf.model, glm::mat4{ 1.0f });
                     mesh_grid.draw();
                 }
-            }
-        }
 
-        // Render UI
-        {
-            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+                profiler.end_gpu(timing_scene);
+
+                // Render UI
+                profiler.begin_gpu(timing_imgui);
+                ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+                profiler.end_gpu(timing_imgui);
+
+                glfwSwapBuffers(window);
+            }
         }
 
-        glfwSwapBuffers(window);
+        profiler.add_cpu(timing_frame, std::chrono::duration<double>(std::chrono::steady_clock::now() - frame_start).count());
     }
 
     // Clean-up ImGui
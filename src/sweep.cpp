@@ -0,0 +1,145 @@
+#include <stdexcept>
+#include <string>
+
+#if defined(HOPF_X86_KERNELS) && defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+#include "sweep.h"
+
+namespace hopf
+{
+
+#if defined(HOPF_X86_KERNELS)
+
+    /**
+     * Returns `true` if the CPU (and the OS, for the wider registers) supports `isa`.
+     */
+    bool cpu_supports(SweepIsa isa)
+    {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        const int max_leaf = info[0];
+
+        __cpuid(info, 1);
+        const bool sse41 = (info[2] & (1 << 19)) != 0;
+        const bool fma = (info[2] & (1 << 12)) != 0;
+        const bool os_saves_ymm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x06) == 0x06;
+        const bool os_saves_zmm = os_saves_ymm && (_xgetbv(0) & 0xE0) == 0xE0;
+
+        bool avx2 = false;
+        bool avx512f = false;
+        if (max_leaf >= 7)
+        {
+            __cpuidex(info, 7, 0);
+            avx2 = (info[1] & (1 << 5)) != 0;
+            avx512f = (info[1] & (1 << 16)) != 0;
+        }
+
+        switch (isa)
+        {
+        case SweepIsa::Sse41: return sse41;
+        case SweepIsa::Avx2: return avx2 && fma && os_saves_ymm;
+        case SweepIsa::Avx512: return avx512f && os_saves_zmm;
+        default: return true;
+        }
+#else
+        __builtin_cpu_init();
+
+        switch (isa)
+        {
+        case SweepIsa::Sse41: return __builtin_cpu_supports("sse4.1");
+        case SweepIsa::Avx2: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        case SweepIsa::Avx512: return __builtin_cpu_supports("avx512f");
+        default: return true;
+        }
+#endif
+    }
+
+#else
+
+    bool cpu_supports(SweepIsa isa)
+    {
+        // Only the scalar kernel is built for other architectures
+        return isa == SweepIsa::Scalar || isa == SweepIsa::Automatic;
+    }
+
+#endif
+
+    SweepIsa detect_sweep_isa()
+    {
+        static const SweepIsa detected = []()
+        {
+            for (const auto isa : { SweepIsa::Avx512, SweepIsa::Avx2, SweepIsa::Sse41 })
+            {
+                if (cpu_supports(isa))
+                {
+                    return isa;
+                }
+            }
+            return SweepIsa::Scalar;
+        }();
+
+        return detected;
+    }
+
+    /**
+     * Resolves `Automatic` and throws if `isa` cannot run on this CPU.
+     */
+    SweepIsa resolve_isa(SweepIsa isa)
+    {
+        if (isa == SweepIsa::Automatic)
+        {
+            isa = detect_sweep_isa();
+        }
+
+        if (!cpu_supports(isa))
+        {
+            throw std::runtime_error(std::string{ "The " } + to_string(isa) + " fiber sweep is not supported on this CPU");
+        }
+
+        return isa;
+    }
+
+    SweepFunction get_sweep_function(SweepIsa isa)
+    {
+        switch (resolve_isa(isa))
+        {
+#if defined(HOPF_X86_KERNELS)
+        case SweepIsa::Sse41: return sweep_fiber_sse41;
+        case SweepIsa::Avx2: return sweep_fiber_avx2;
+        case SweepIsa::Avx512: return sweep_fiber_avx512;
+#endif
+        default: return sweep_fiber_scalar;
+        }
+    }
+
+    TableSweepFunction get_table_sweep_function(SweepIsa isa)
+    {
+        switch (resolve_isa(isa))
+        {
+#if defined(HOPF_X86_KERNELS)
+        case SweepIsa::Sse41: return sweep_fiber_table_sse41;
+        case SweepIsa::Avx2: return sweep_fiber_table_avx2;
+        case SweepIsa::Avx512: return sweep_fiber_table_avx512;
+#endif
+        default: return sweep_fiber_table_scalar;
+        }
+    }
+
+    const char* to_string(SweepIsa isa)
+    {
+        switch (isa)
+        {
+        case SweepIsa::Automatic: return "Automatic";
+        case SweepIsa::Scalar: return "Scalar";
+        case SweepIsa::Sse41: return "SSE4.1";
+        case SweepIsa::Avx2: return "AVX2";
+        case SweepIsa::Avx512: return "AVX-512";
+        }
+        return "Unknown";
+    }
+
+}
@@ -0,0 +1,45 @@
+#include <immintrin.h>
+
+#include "sweep.h"
+#include "sweep_kernel.h"
+
+namespace hopf
+{
+
+    /**
+     * 8 lanes (compiled with AVX2 and FMA enabled, see `CMakeLists.txt`).
+     */
+    struct Avx2Ops
+    {
+        using type = __m256;
+        using mask = __m256;
+        static constexpr size_t width = 8;
+
+        static __m256 set1(float v) { return _mm256_set1_ps(v); }
+        static __m256 load(const float* p) { return _mm256_loadu_ps(p); }
+        static void store(float* p, __m256 v) { _mm256_storeu_ps(p, v); }
+        static __m256 add(__m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+        static __m256 sub(__m256 a, __m256 b) { return _mm256_sub_ps(a, b); }
+        static __m256 mul(__m256 a, __m256 b) { return _mm256_mul_ps(a, b); }
+        static __m256 div(__m256 a, __m256 b) { return _mm256_div_ps(a, b); }
+        static __m256 fmadd(__m256 a, __m256 b, __m256 c) { return _mm256_fmadd_ps(a, b, c); }
+        static __m256 sqrt(__m256 a) { return _mm256_sqrt_ps(a); }
+        static __m256 abs(__m256 a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+        static __m256 neg(__m256 a) { return _mm256_xor_ps(_mm256_set1_ps(-0.0f), a); }
+        static __m256 round(__m256 a) { return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+        static __m256 floor(__m256 a) { return _mm256_floor_ps(a); }
+        static __m256 gt(__m256 a, __m256 b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+        static __m256 select(__m256 m, __m256 a, __m256 b) { return _mm256_blendv_ps(b, a, m); }
+    };
+
+    void sweep_fiber_avx2(float a, float b, float c, const float* phis, size_t count, float* xs, float* ys, float* zs)
+    {
+        kernel::sweep_fiber<Avx2Ops>(a, b, c, phis, count, xs, ys, zs);
+    }
+
+    void sweep_fiber_table_avx2(float a, float b, float c, const float* cos_phis, const float* sin_phis, size_t count, float* xs, float* ys, float* zs)
+    {
+        kernel::sweep_fiber_table<Avx2Ops>(a, b, c, cos_phis, sin_phis, count, xs, ys, zs);
+    }
+
+}
@@ -0,0 +1,45 @@
+#include <immintrin.h>
+
+#include "sweep.h"
+#include "sweep_kernel.h"
+
+namespace hopf
+{
+
+    /**
+     * 16 lanes (compiled with AVX-512F and FMA enabled, see `CMakeLists.txt`).
+     */
+    struct Avx512Ops
+    {
+        using type = __m512;
+        using mask = __mmask16;
+        static constexpr size_t width = 16;
+
+        static __m512 set1(float v) { return _mm512_set1_ps(v); }
+        static __m512 load(const float* p) { return _mm512_loadu_ps(p); }
+        static void store(float* p, __m512 v) { _mm512_storeu_ps(p, v); }
+        static __m512 add(__m512 a, __m512 b) { return _mm512_add_ps(a, b); }
+        static __m512 sub(__m512 a, __m512 b) { return _mm512_sub_ps(a, b); }
+        static __m512 mul(__m512 a, __m512 b) { return _mm512_mul_ps(a, b); }
+        static __m512 div(__m512 a, __m512 b) { return _mm512_div_ps(a, b); }
+        static __m512 fmadd(__m512 a, __m512 b, __m512 c) { return _mm512_fmadd_ps(a, b, c); }
+        static __m512 sqrt(__m512 a) { return _mm512_maskz_sqrt_ps(0xFFFF, a); }
+        static __m512 abs(__m512 a) { return _mm512_abs_ps(a); }
+        static __m512 neg(__m512 a) { return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a), _mm512_castps_si512(_mm512_set1_ps(-0.0f)))); }
+        static __m512 round(__m512 a) { return _mm512_maskz_roundscale_ps(0xFFFF, a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+        static __m512 floor(__m512 a) { return _mm512_maskz_roundscale_ps(0xFFFF, a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+        static __mmask16 gt(__m512 a, __m512 b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+        static __m512 select(__mmask16 m, __m512 a, __m512 b) { return _mm512_mask_blend_ps(m, b, a); }
+    };
+
+    void sweep_fiber_avx512(float a, float b, float c, const float* phis, size_t count, float* xs, float* ys, float* zs)
+    {
+        kernel::sweep_fiber<Avx512Ops>(a, b, c, phis, count, xs, ys, zs);
+    }
+
+    void sweep_fiber_table_avx512(float a, float b, float c, const float* cos_phis, const float* sin_phis, size_t count, float* xs, float* ys, float* zs)
+    {
+        kernel::sweep_fiber_table<Avx512Ops>(a, b, c, cos_phis, sin_phis, count, xs, ys, zs);
+    }
+
+}
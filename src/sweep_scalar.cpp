@@ -0,0 +1,45 @@
+#include <cmath>
+
+#include "sweep.h"
+#include "sweep_kernel.h"
+
+namespace hopf
+{
+
+    /**
+     * One lane per "vector": the same polynomials as the SIMD paths, for CPUs without them.
+     */
+    struct ScalarOps
+    {
+        using type = float;
+        using mask = bool;
+        static constexpr size_t width = 1;
+
+        static float set1(float v) { return v; }
+        static float load(const float* p) { return *p; }
+        static void store(float* p, float v) { *p = v; }
+        static float add(float a, float b) { return a + b; }
+        static float sub(float a, float b) { return a - b; }
+        static float mul(float a, float b) { return a * b; }
+        static float div(float a, float b) { return a / b; }
+        static float fmadd(float a, float b, float c) { return a * b + c; }
+        static float sqrt(float a) { return sqrtf(a); }
+        static float abs(float a) { return fabsf(a); }
+        static float neg(float a) { return -a; }
+        static float round(float a) { return nearbyintf(a); }
+        static float floor(float a) { return floorf(a); }
+        static bool gt(float a, float b) { return a > b; }
+        static float select(bool m, float a, float b) { return m ? a : b; }
+    };
+
+    void sweep_fiber_scalar(float a, float b, float c, const float* phis, size_t count, float* xs, float* ys, float* zs)
+    {
+        kernel::sweep_fiber<ScalarOps>(a, b, c, phis, count, xs, ys, zs);
+    }
+
+    void sweep_fiber_table_scalar(float a, float b, float c, const float* cos_phis, const float* sin_phis, size_t count, float* xs, float* ys, float* zs)
+    {
+        kernel::sweep_fiber_table<ScalarOps>(a, b, c, cos_phis, sin_phis, count, xs, ys, zs);
+    }
+
+}
@@ -0,0 +1,45 @@
+#include <smmintrin.h>
+
+#include "sweep.h"
+#include "sweep_kernel.h"
+
+namespace hopf
+{
+
+    /**
+     * 4 lanes (compiled with SSE4.1 enabled, see `CMakeLists.txt`).
+     */
+    struct Sse41Ops
+    {
+        using type = __m128;
+        using mask = __m128;
+        static constexpr size_t width = 4;
+
+        static __m128 set1(float v) { return _mm_set1_ps(v); }
+        static __m128 load(const float* p) { return _mm_loadu_ps(p); }
+        static void store(float* p, __m128 v) { _mm_storeu_ps(p, v); }
+        static __m128 add(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+        static __m128 sub(__m128 a, __m128 b) { return _mm_sub_ps(a, b); }
+        static __m128 mul(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+        static __m128 div(__m128 a, __m128 b) { return _mm_div_ps(a, b); }
+        static __m128 fmadd(__m128 a, __m128 b, __m128 c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+        static __m128 sqrt(__m128 a) { return _mm_sqrt_ps(a); }
+        static __m128 abs(__m128 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+        static __m128 neg(__m128 a) { return _mm_xor_ps(_mm_set1_ps(-0.0f), a); }
+        static __m128 round(__m128 a) { return _mm_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+        static __m128 floor(__m128 a) { return _mm_floor_ps(a); }
+        static __m128 gt(__m128 a, __m128 b) { return _mm_cmpgt_ps(a, b); }
+        static __m128 select(__m128 m, __m128 a, __m128 b) { return _mm_blendv_ps(b, a, m); }
+    };
+
+    void sweep_fiber_sse41(float a, float b, float c, const float* phis, size_t count, float* xs, float* ys, float* zs)
+    {
+        kernel::sweep_fiber<Sse41Ops>(a, b, c, phis, count, xs, ys, zs);
+    }
+
+    void sweep_fiber_table_sse41(float a, float b, float c, const float* cos_phis, const float* sin_phis, size_t count, float* xs, float* ys, float* zs)
+    {
+        kernel::sweep_fiber_table<Sse41Ops>(a, b, c, cos_phis, sin_phis, count, xs, ys, zs);
+    }
+
+}